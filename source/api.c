@@ -16,10 +16,50 @@
 *                    float evaporate_speed, float gravity,
 *                    int radius )
 *       void override_heightmap( float* new_heightmap )
+*       void set_noise_precision( int precision )
+*       void set_noise_mode( int mode )
+*       void set_tileable( int tileable )
+*       void set_warp_strength( float warp )
+*       void set_noise_cache_budget( int megabytes )
 *       void erode_iter( int iterations )
 *       void save_obj( char* filename, int size ) 
+*       void save_obj_adaptive( char* filename, float max_error )
 *       void save_png( char* filename )
+*       void set_png_level( int level )
+*       void save_png16( char* filename )
 *       void save_stl(char* filename)
+*       void save_glb( char* filename, int flags )
+*       void save_ply( char* filename, int normals )
+*       void save_raw( char* filename, int format, float scale )
+*       int  load_raw( char* filename )
+*       int  load_png( char* filename )
+*       int  load_mapped( char* filename, int shared )
+*       void save_tiff( char* filename, int format, int tile_size,
+*                       int level )
+*       int  load_tiff( char* filename )
+*       int  load_tiff_window( char* filename, int x, int y, int size )
+*       void sync_heightmap( void )
+*       void save_lod( char* filename, int chunk_quads )
+*       void save_textures( char* basename, int maps, int depth,
+*                           float height_scale )
+*       void set_export_threads( int threads, int megabytes )
+*       void save_png_async( char* filename )
+*       void save_png16_async( char* filename )
+*       void save_stl_async( char* filename )
+*       void save_raw_async( char* filename, int format, float scale )
+*       void save_tiff_async( char* filename, int format, int tile_size,
+*                             int level )
+*       void wait_exports( void )
+*       int  save_checkpoint( char* filename )
+*       int  load_checkpoint( char* filename )
+*       int  start_timelapse( char* filename, int every, int keyframes,
+*                             int level )
+*       void stop_timelapse( void )
+*       int  timelapse_frames( char* filename )
+*       int  load_timelapse_frame( char* filename, int frame )
+*       void set_export_resolution( int size, int filter )
+*       float* get_preview( int size )
+*       void save_multi( char* basename, int formats )
 *
 * AUTHOR :    Henry Jiang         DATE :    Feb 13, 2021
 */
@@ -32,6 +72,15 @@
 #include "erosion.h"
 #include "heightmap_gen.h"
 #include "export.h"
+#include "raw.h"
+#include "import.h"
+#include "tiff.h"
+#include "lod.h"
+#include "texture.h"
+#include "async.h"
+#include "checkpoint.h"
+#include "timelapse.h"
+#include "resample.h"
 
 #ifdef _WASM
 #include "emscripten.h"
@@ -39,14 +88,61 @@
 
 int     map_size;
 float*  heightmap = NULL;
-struct setting noise_param;
+struct setting noise_param = { .warp = WARP_DEFAULT };
 struct erosion_param erode_param;
+struct octave_cache noise_cache; /* zero budget, disabled by default */
+int     png_level = 6;            /* deflate level of the png exports */
+struct raw_map heightmap_file;    /* set while heightmap is a mapped file */
+struct export_queue export_queue; /* started by the first async export */
+int     export_started = 0;
+int     export_threads = 2;
+int     export_megabytes = 256;   /* snapshots held by the async exports */
+uint64_t drop_rng = 0;            /* droplet_rand state, seeded by the parameters */
+int64_t drop_count = 0;           /* droplets eroded since the heightmap was set */
+struct checkpoint_log checkpoint; /* tiles eroded since the last checkpoint */
+struct timelapse capture;         /* open while a timelapse is captured */
+int     capture_every = 0;        /* droplets between timelapse frames */
+int     export_resolution = 0;    /* size of the exports, 0 for map_size */
+int     export_filter = RESAMPLE_BOX;
+
+
+/* the heightmap at the export resolution, free with release_export */
+static float* export_map(int* size) {
+  *size = map_size;
+  if (export_resolution <= 0 || export_resolution == map_size || heightmap == NULL)
+    return heightmap;
+
+  float* resampled = resample(heightmap, map_size, export_resolution, export_filter);
+  if (resampled == NULL)
+    return heightmap;
+  *size = export_resolution;
+  return resampled;
+}
+
+static void release_export(float* map) {
+  if (map != heightmap)
+    free(map);
+}
+
+/* frees the heightmap or unmaps it when it belongs to heightmap_file,
+   a timelapse of it ends with it */
+static void release_heightmap(void) {
+  stop_timelapse();
+  if (heightmap != NULL && heightmap == heightmap_file.heightmap)
+    unmap_raw(&heightmap_file);
+  else
+    free(heightmap);
+  heightmap = NULL;
+  checkpoint_changed(&checkpoint);
+  drop_count = 0;
+}
 
 
 #ifdef _WASM
 EMSCRIPTEN_KEEPALIVE
 #endif
 void initialize(int sim_size) {
+  release_heightmap();
   heightmap = (float*) calloc(sim_size * sim_size, sizeof(float));
   map_size = sim_size;
 }
@@ -80,10 +176,12 @@ void use_default_erosion_params(unsigned int seed,
                                 float scale, float map_height) {
   // configure heightmap generator noise settings
   noise_param.seed = seed;
+  drop_rng = seed;
   noise_param.octaves = octaves;
   noise_param.persistence = persistence;
   noise_param.scale = scale;
   noise_param.height = map_height;
+  noise_param.warp = WARP_DEFAULT;
   
   // configure default erosion parameters
   erode_param.DROPLET_LIFETIME          = 30;
@@ -111,6 +209,7 @@ void set_parameters(/* heightmap gen params */
                     float evaporate_speed, float gravity ) {
   // configure heightmap generator noise settings
   noise_param.seed = seed;
+  drop_rng = seed;
   noise_param.octaves = octaves;
   noise_param.persistence = persistence;
   noise_param.scale = scale;
@@ -128,11 +227,56 @@ void set_parameters(/* heightmap gen params */
 }
 
 
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_noise_precision(int precision) {
+  noise_param.precision = precision;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_noise_mode(int mode) {
+  noise_param.mode = mode;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_tileable(int tileable) {
+  noise_param.tileable = tileable;
+  erode_param.WRAP_EDGES = tileable;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_warp_strength(float warp) {
+  noise_param.warp = warp;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_noise_cache_budget(int megabytes) {
+  if (megabytes < 0)
+    return;
+  octave_cache_free(&noise_cache);
+  octave_cache_init(&noise_cache, (size_t) megabytes << 20);
+}
+
+
 #ifdef _WASM
 EMSCRIPTEN_KEEPALIVE
 #endif
 void generate_noise() {
-  gen_heightmap(heightmap, map_size, &noise_param);
+  gen_heightmap_cached(heightmap, map_size, &noise_param, &noise_cache);
+  checkpoint_changed(&checkpoint);
 }
 
 
@@ -140,7 +284,8 @@ void generate_noise() {
 EMSCRIPTEN_KEEPALIVE
 #endif
 void free_heightmap() {
-  free(heightmap);
+  release_heightmap();
+  octave_cache_free(&noise_cache);
   map_size = 0;
 }
 
@@ -152,11 +297,23 @@ void erode_iter(int iterations, int radius) {
   printf("Starting with %d iterations with radius %d.\n", iterations, radius);
   // computes the weights matrix only before erosion
   compute_weights_matrix(radius);
+  // a droplet moves a cell per step and erodes within radius of it
+  int reach = erode_param.DROPLET_LIFETIME + radius + 2;
   for (int i = 0; i < iterations; i++) {
-    // randomize droplet's position
+    // randomize droplet's position, from droplet_rand so checkpoints can
+    // store the generator, wrapped maps have no edge to keep away from
+    int x, y;
+    if (erode_param.WRAP_EDGES) {
+      x = droplet_rand(&drop_rng) % map_size;
+      y = droplet_rand(&drop_rng) % map_size;
+    } else {
+      x = (droplet_rand(&drop_rng) % (map_size - 2)) + 1;
+      y = (droplet_rand(&drop_rng) % (map_size - 2)) + 1;
+    }
+    checkpoint_mark(&checkpoint, map_size, x, y, reach, erode_param.WRAP_EDGES);
     struct droplet drop = {
-      .pos_x = (rand() % (map_size - 2)) + 1,
-      .pos_y = (rand() % (map_size - 2)) + 1,
+      .pos_x = x,
+      .pos_y = y,
       .dir_x = 0,
       .dir_y = 0,
       .speed = 1,
@@ -166,7 +323,13 @@ void erode_iter(int iterations, int radius) {
 
     // calculates the effect of drop on heightmap
     erode(heightmap, map_size, &drop, &erode_param);
+
+    // a failed frame ends the capture, the frames before it stay readable
+    if (capture_every > 0 && (drop_count + i + 1) % capture_every == 0
+        && !timelapse_frame(&capture, heightmap, map_size, drop_count + i + 1))
+      stop_timelapse();
   }
+  drop_count += iterations;
 
   // frees the weights matrix after erosion
   free_weights_matrix();
@@ -182,11 +345,44 @@ void save_obj(char* filename, int size) {
 }
 
 
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_obj_adaptive(char* filename, float max_error) {
+  int size;
+  float* map = export_map(&size);
+  export_obj_adaptive(map, size, max_error, filename);
+  release_export(map);
+}
+
+
 #ifdef _WASM
 EMSCRIPTEN_KEEPALIVE
 #endif
 void save_png(char* filename) {
-  export_png(heightmap, map_size, filename);
+  int size;
+  float* map = export_map(&size);
+  export_png_level(map, size, png_level, filename);
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_png_level(int level) {
+  png_level = level;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_png16(char* filename) {
+  int size;
+  float* map = export_map(&size);
+  export_png16(map, size, png_level, filename);
+  release_export(map);
 }
 
 
@@ -195,7 +391,394 @@ void save_png(char* filename) {
 EMSCRIPTEN_KEEPALIVE
 #endif
 void save_stl(char* filename) {
-  export_stl(heightmap, map_size, filename);
+  int size;
+  float* map = export_map(&size);
+  export_stl(map, size, filename);
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_glb(char* filename, int flags) {
+  int size;
+  float* map = export_map(&size);
+  export_glb(map, size, flags, filename);
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_ply(char* filename, int normals) {
+  int size;
+  float* map = export_map(&size);
+  export_ply(map, size, normals, filename);
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_raw(char* filename, int format, float scale) {
+  int size;
+  float* map = export_map(&size);
+  export_raw(map, size, format, scale, filename);
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int load_raw(char* filename) {
+  int size;
+  float* loaded = import_raw(filename, &size);
+
+  if (loaded == NULL)
+    return 0;
+
+  release_heightmap();
+  heightmap = loaded;
+  map_size = size;
+  return size;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int load_png(char* filename) {
+  int size;
+  float* loaded = import_heightmap(filename, &size);
+
+  if (loaded == NULL)
+    return 0;
+
+  release_heightmap();
+  heightmap = loaded;
+  map_size = size;
+  return size;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int load_mapped(char* filename, int shared) {
+  struct raw_map map;
+
+  if (!map_raw(&map, filename, shared ? RAW_MAP_SHARED : RAW_MAP_PRIVATE))
+    return 0;
+
+  release_heightmap();
+  heightmap_file = map;
+  heightmap = map.heightmap;
+  map_size = map.map_size;
+  return map_size;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void sync_heightmap() {
+  if (heightmap != NULL && heightmap == heightmap_file.heightmap)
+    sync_raw(&heightmap_file);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_tiff(char* filename, int format, int tile_size, int level) {
+  int size;
+  float* map = export_map(&size);
+  export_tiff(map, size, format, tile_size, level, filename);
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int load_tiff(char* filename) {
+  int size;
+  float* loaded = import_tiff(filename, &size);
+
+  if (loaded == NULL)
+    return 0;
+
+  release_heightmap();
+  heightmap = loaded;
+  map_size = size;
+  return size;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int load_tiff_window(char* filename, int x, int y, int size) {
+  float* loaded = import_tiff_window(filename, x, y, size);
+
+  if (loaded == NULL)
+    return 0;
+
+  release_heightmap();
+  heightmap = loaded;
+  map_size = size;
+  return size;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_lod(char* filename, int chunk_quads) {
+  int size;
+  float* map = export_map(&size);
+  export_lod(map, size, chunk_quads, filename);
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_textures(char* basename, int maps, int depth, float height_scale) {
+  int size;
+  float* map = export_map(&size);
+  export_textures(map, size, maps, depth, height_scale, png_level, basename);
+  release_export(map);
+}
+
+
+/* writers of the async exports, run on a snapshot */
+static void run_png(const struct export_task* task) {
+  export_png_level(task->heightmap, task->map_size, task->level, task->filename);
+}
+
+static void run_png16(const struct export_task* task) {
+  export_png16(task->heightmap, task->map_size, task->level, task->filename);
+}
+
+static void run_stl(const struct export_task* task) {
+  export_stl(task->heightmap, task->map_size, task->filename);
+}
+
+static void run_raw(const struct export_task* task) {
+  export_raw(task->heightmap, task->map_size, task->format, task->scale, task->filename);
+}
+
+static void run_tiff(const struct export_task* task) {
+  export_tiff(task->heightmap, task->map_size, task->format, task->tile_size, task->level,
+              task->filename);
+}
+
+/* queues the task, writes it right away when there is no queue or memory */
+static void save_async(struct export_task* task, char* filename) {
+  int size;
+  float* map = export_map(&size);
+
+  task->filename = filename;
+  if (!export_started)
+    export_started = export_queue_init(&export_queue, export_threads,
+                                       (size_t) export_megabytes << 20);
+  if (!export_started || !export_queue_submit(&export_queue, map, size, task)) {
+    task->heightmap = map;
+    task->map_size = size;
+    task->run(task);
+  }
+  release_export(map);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_export_threads(int threads, int megabytes) {
+  if (export_started) {
+    export_queue_free(&export_queue);
+    export_started = 0;
+  }
+  export_threads = threads;
+  export_megabytes = megabytes;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_png_async(char* filename) {
+  struct export_task task = {.run = run_png, .level = png_level};
+  save_async(&task, filename);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_png16_async(char* filename) {
+  struct export_task task = {.run = run_png16, .level = png_level};
+  save_async(&task, filename);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_stl_async(char* filename) {
+  struct export_task task = {.run = run_stl};
+  save_async(&task, filename);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_raw_async(char* filename, int format, float scale) {
+  struct export_task task = {.run = run_raw, .format = format, .scale = scale};
+  save_async(&task, filename);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_tiff_async(char* filename, int format, int tile_size, int level) {
+  struct export_task task = {.run = run_tiff, .format = format, .tile_size = tile_size,
+                             .level = level};
+  save_async(&task, filename);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void wait_exports() {
+  if (export_started)
+    export_queue_wait(&export_queue);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int save_checkpoint(char* filename) {
+  struct checkpoint_state state = {
+    .rng = drop_rng,
+    .drops = drop_count,
+    .erode = erode_param,
+    .noise = noise_param
+  };
+  return write_checkpoint(&checkpoint, heightmap, map_size, &state, filename);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int load_checkpoint(char* filename) {
+  int size;
+  struct checkpoint_state state;
+  float* loaded = read_checkpoint(filename, &size, &state);
+
+  if (loaded == NULL)
+    return 0;
+
+  release_heightmap();
+  heightmap = loaded;
+  map_size = size;
+  drop_rng = state.rng;
+  drop_count = state.drops;
+  erode_param = state.erode;
+  noise_param = state.noise;
+  return size;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int start_timelapse(char* filename, int every, int keyframes, int level) {
+  stop_timelapse();
+  if (every < 1 || !timelapse_begin(&capture, heightmap, map_size, keyframes, level, filename))
+    return 0;
+
+  // the first frame is the heightmap as it is now
+  capture_every = every;
+  if (!timelapse_frame(&capture, heightmap, map_size, drop_count)) {
+    stop_timelapse();
+    return 0;
+  }
+  return 1;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void stop_timelapse() {
+  if (capture_every > 0)
+    timelapse_end(&capture);
+  capture_every = 0;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int timelapse_frames(char* filename) {
+  return timelapse_count(filename);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+int load_timelapse_frame(char* filename, int frame) {
+  int size;
+  float* loaded = timelapse_read(filename, frame, &size, NULL);
+
+  if (loaded == NULL)
+    return 0;
+
+  release_heightmap();
+  heightmap = loaded;
+  map_size = size;
+  return size;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void set_export_resolution(int size, int filter) {
+  export_resolution = size;
+  export_filter = filter;
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+float* get_preview(int size) {
+  return resample(heightmap, map_size, size, RESAMPLE_BOX);
+}
+
+
+#ifdef _WASM
+EMSCRIPTEN_KEEPALIVE
+#endif
+void save_multi(char* basename, int formats) {
+  int size;
+  float* map = export_map(&size);
+  export_multi(map, size, formats, png_level, basename);
+  release_export(map);
 }
 
 
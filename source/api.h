@@ -17,16 +17,57 @@
 *       void use_default_erosion_params( unsigned int seed, 
                                          int octaves, float persistence, 
                                          float scale, float map_height )
+*       void set_noise_precision( int precision )
+*       void set_noise_mode( int mode )
+*       void set_tileable( int tileable )
+*       void set_warp_strength( float warp )
+*       void set_noise_cache_budget( int megabytes )
 *       void erode_iter( int iterations )
 *       void save_obj( char* filename, int size ) 
+*       void save_obj_adaptive( char* filename, float max_error )
 *       void save_png( char* filename )
+*       void set_png_level( int level )
+*       void save_png16( char* filename )
 *       void save_stl(char* filename)
+*       void save_glb( char* filename, int flags )
+*       void save_ply( char* filename, int normals )
+*       void save_raw( char* filename, int format, float scale )
+*       int  load_raw( char* filename )
+*       int  load_png( char* filename )
+*       int  load_mapped( char* filename, int shared )
+*       void save_tiff( char* filename, int format, int tile_size,
+*                       int level )
+*       int  load_tiff( char* filename )
+*       int  load_tiff_window( char* filename, int x, int y, int size )
+*       void sync_heightmap( void )
+*       void save_lod( char* filename, int chunk_quads )
+*       void save_textures( char* basename, int maps, int depth,
+*                           float height_scale )
+*       void set_export_threads( int threads, int megabytes )
+*       void save_png_async( char* filename )
+*       void save_png16_async( char* filename )
+*       void save_stl_async( char* filename )
+*       void save_raw_async( char* filename, int format, float scale )
+*       void save_tiff_async( char* filename, int format, int tile_size,
+*                             int level )
+*       void wait_exports( void )
+*       int  save_checkpoint( char* filename )
+*       int  load_checkpoint( char* filename )
+*       int  start_timelapse( char* filename, int every, int keyframes,
+*                             int level )
+*       void stop_timelapse( void )
+*       int  timelapse_frames( char* filename )
+*       int  load_timelapse_frame( char* filename, int frame )
+*       void set_export_resolution( int size, int filter )
+*       float* get_preview( int size )
+*       void save_multi( char* basename, int formats )
 *
 * AUTHOR :    Henry Jiang         DATE :    Feb 13, 2021
 */
 
 /**
- * @brief Initializes the internal states for the simulator
+ * @brief Initializes the internal states for the simulator, releasing
+ * the previous heightmap first (a mapped file is written back and closed)
  * 
  * @param sim_size  the size of the heightmap
  */
@@ -56,6 +97,43 @@ void use_default_erosion_params(unsigned int seed,
                                 int octaves, float persistence, 
                                 float scale, float map_height );
 
+/**
+ * @brief Selects the noise precision used by generate_noise
+ * 
+ * @param precision PRECISION_DOUBLE or PRECISION_FLOAT from heightmap_gen.h
+ */
+void set_noise_precision( int precision );
+
+/**
+ * @brief Selects how generate_noise combines the noise layers
+ * 
+ * @param mode one of the generator_mode values from heightmap_gen.h
+ */
+void set_noise_mode( int mode );
+
+/**
+ * @brief Makes the generated heightmap repeat with period sim_size and 
+ *        lets the erosion wrap around the edges, so the map can be tiled
+ *        without seams
+ */
+void set_tileable( int tileable );
+
+/**
+ * @brief Sets the displacement of MODE_WARP as a fraction of the map size,
+ *        WARP_DEFAULT until set
+ */
+void set_warp_strength( float warp );
+
+/**
+ * @brief Sets the memory generate_noise may use to cache the noise layers
+ * 
+ * With a cache, changing only the persistence or height between calls 
+ * to generate_noise reblends or rescales the cached layers instead of 
+ * recomputing the noise. 0 disables the cache, negative values are 
+ * ignored.
+ */
+void set_noise_cache_budget( int megabytes );
+
 /**
  * @brief Generates noise onto the heightmap 
  */
@@ -76,18 +154,230 @@ void erode_iter( int iterations, int radius );
  */
 void save_obj( char* filename, int size );
 
+/**
+ * @brief Export an adaptive obj mesh within @param max_error height
+ */
+void save_obj_adaptive( char* filename, float max_error );
+
 /**
  * @brief Export the png file 
  */
 void save_png( char* filename );
 
+/**
+ * @brief Sets the png compression @param level in [0, 9] [default 6]
+ */
+void set_png_level( int level );
+
+/**
+ * @brief Export the 16 bit grayscale png file 
+ */
+void save_png16( char* filename );
+
 /**
  * @brief Export the stl file 
  */
 void save_stl( char* filename );
 
+/**
+ * @brief Export the glb file, @param flags selects normals and UVs
+ */
+void save_glb( char* filename, int flags );
+
+/**
+ * @brief Export the binary ply file, optionally with @param normals
+ */
+void save_ply( char* filename, int normals );
+
+/**
+ * @brief Export the raw heightfield, @param format is a raw_format and
+ * @param scale the height stored as 1
+ */
+void save_raw( char* filename, int format, float scale );
+
+/**
+ * @brief Replaces the heightmap with a raw heightfield and its size
+ *
+ * @return the new map size, 0 if the file could not be read
+ */
+int load_raw( char* filename );
+
+/**
+ * @brief Replaces the heightmap with a square png, the height of a pixel
+ * is the mean of its color channels
+ *
+ * @return the new map size, 0 if the file could not be read
+ */
+int load_png( char* filename );
+
+/**
+ * @brief Replaces the heightmap with a memory mapped raw heightfield
+ *
+ * An unscaled f32 file is used in place without being read, pages load
+ * as the simulation touches them. With @param shared erosion writes
+ * through to the file, otherwise the mapping is copy on write. Other
+ * raw files, and builds without mmap, load a copy.
+ *
+ * @return the new map size, 0 if the file could not be mapped
+ */
+int load_mapped( char* filename, int shared );
+
+/**
+ * @brief Flushes the changes of a shared mapped heightmap to its file
+ */
+void sync_heightmap( void );
+
+/**
+ * @brief Export the heightmap as a tiff, @param format is a tiff_format,
+ * @param tile_size a multiple of 16 or 0 for strips and @param level the
+ * deflate level, 0 for uncompressed
+ */
+void save_tiff( char* filename, int format, int tile_size, int level );
+
+/**
+ * @brief Replaces the heightmap with a square tiff heightfield
+ *
+ * @return the new map size, 0 if the file could not be read
+ */
+int load_tiff( char* filename );
+
+/**
+ * @brief Replaces the heightmap with the @param size window at
+ * (@param x, @param y) of a larger tiff, reading only the tiles under it
+ *
+ * @return the new map size, 0 if the window could not be read
+ */
+int load_tiff_window( char* filename, int x, int y, int size );
+
+/**
+ * @brief Export the chunked quadtree lod meshes with @param chunk_quads
+ * quads per chunk side
+ */
+void save_lod( char* filename, int chunk_quads );
+
+/**
+ * @brief Export the heightmap and its normal, slope and curvature maps
+ * as basename_map.png, @param maps selects texture_map flags, @param depth
+ * is 8 or 16 bits and @param height_scale exaggerates the normals
+ */
+void save_textures( char* basename, int maps, int depth, float height_scale );
+
+/**
+ * @brief Sets the writer threads of the async exports and the most
+ * snapshot memory they hold, @param megabytes, before an async save
+ * blocks until a snapshot is written
+ */
+void set_export_threads( int threads, int megabytes );
+
+/**
+ * @brief Export the png from a snapshot of the heightmap on a writer
+ * thread, returns once the snapshot is taken so erosion can continue
+ */
+void save_png_async( char* filename );
+
+/**
+ * @brief save_png16 on a snapshot of the heightmap, see save_png_async
+ */
+void save_png16_async( char* filename );
+
+/**
+ * @brief save_stl on a snapshot of the heightmap, see save_png_async
+ */
+void save_stl_async( char* filename );
+
+/**
+ * @brief save_raw on a snapshot of the heightmap, see save_png_async
+ */
+void save_raw_async( char* filename, int format, float scale );
+
+/**
+ * @brief save_tiff on a snapshot of the heightmap, see save_png_async
+ */
+void save_tiff_async( char* filename, int format, int tile_size, int level );
+
+/**
+ * @brief Blocks until every async export is written, the Webassembly
+ * build writes them before the save returns
+ */
+void wait_exports( void );
+
+/**
+ * @brief Saves the heightmap, parameters, droplet generator and droplet
+ * count to a checkpoint, after the first save only the tiles eroded since
+ * the last one are appended
+ *
+ * @return 1 on success, 0 if the file could not be written
+ */
+int save_checkpoint( char* filename );
+
+/**
+ * @brief Restores the last complete checkpoint in the file, erode_iter
+ * then continues the run exactly as if it never stopped. The checkpoint
+ * log starts over, the next save_checkpoint writes a full file.
+ *
+ * @return the map size, 0 if the file could not be read
+ */
+int load_checkpoint( char* filename );
+
+/**
+ * @brief Starts capturing a timelapse, erode_iter adds a frame every
+ * @param every droplets. Frames are delta compressed against the frame
+ * before, with a full keyframe every @param keyframes frames, and
+ * deflated at @param level. The current heightmap is the first frame.
+ * The capture stops when the heightmap is replaced by initialize, a load
+ * or free_heightmap, and when a frame cannot be written, keeping the
+ * frames written before it.
+ *
+ * @return 1 on success, 0 if the file or the first frame could not be
+ *         written
+ */
+int start_timelapse( char* filename, int every, int keyframes, int level );
+
+/**
+ * @brief Stops the timelapse capture and closes its file
+ */
+void stop_timelapse( void );
+
+/**
+ * @brief The number of frames in a timelapse file
+ */
+int timelapse_frames( char* filename );
+
+/**
+ * @brief Replaces the heightmap with @param frame of a timelapse file,
+ * stops a running capture
+ *
+ * @return the map size, 0 if the frame could not be read
+ */
+int load_timelapse_frame( char* filename, int frame );
+
+/**
+ * @brief Sets the size of the png, png16, stl, glb, ply, raw, tiff,
+ * adaptive obj, lod and texture exports and of the async exports, the
+ * heightmap is resampled with @param filter, a resample_filter. 0
+ * exports at the map size. save_multi uses it too, save_obj takes its
+ * own size.
+ */
+void set_export_resolution( int size, int filter );
+
+/**
+ * @brief The heightmap area filtered to @param size per side for
+ * previews
+ *
+ * @return the preview [free with free], NULL on failure
+ */
+float* get_preview( int size );
+
+/**
+ * @brief Export several formats, @param formats export_format flags, in
+ * one pass over the heightmap as basename.png, basename_16.png,
+ * basename.stl and basename.obj
+ */
+void save_multi( char* basename, int formats );
+
 
 /**
- * @brief Frees the allocated heightmap
+ * @brief Frees the allocated heightmap, a mapped heightmap is synced and
+ * unmapped
  */
 void free_heightmap( void );
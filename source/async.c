@@ -0,0 +1,184 @@
+/***********************************************************************
+* FILENAME :        async.h   async.c
+*
+* DESCRIPTION :
+*       Background export queue, heightmap snapshots are written by a
+*       pool of writer threads while the simulation continues
+*
+* PUBLIC FUNCTIONS :
+*       int  export_queue_init( struct export_queue* queue, int threads,
+*                               size_t max_bytes )
+*       int  export_queue_submit( struct export_queue* queue,
+*                                 const float* heightmap, int map_size,
+*                                 const struct export_task* task )
+*       void export_queue_wait( struct export_queue* queue )
+*       void export_queue_free( struct export_queue* queue )
+*
+* PRIVATE FUNCTIONS :
+*       copy_task, free_task, writer
+*
+* NOTES :
+*       The slot and snapshot bytes are reserved under the lock before
+*       the copy, so concurrent submits cannot overshoot the cap, and the
+*       copy itself runs outside the lock. A task is only queued once its
+*       snapshot is complete.
+*H*/
+
+#include "async.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/* task with its own filename, the snapshot is filled in later */
+static int copy_task(struct export_task* copy, const struct export_task* task) {
+  *copy = *task;
+  copy->filename = malloc(strlen(task->filename) + 1);
+  if (copy->filename == NULL)
+    return 0;
+  strcpy(copy->filename, task->filename);
+  return 1;
+}
+
+static void free_task(struct export_task* task) {
+  free(task->heightmap);
+  free(task->filename);
+}
+
+#ifdef ASYNC_THREADS
+/* takes tasks until the queue stops and is empty */
+static void* writer(void* arg) {
+  struct export_queue* queue = arg;
+
+  pthread_mutex_lock(&queue->lock);
+  for (;;) {
+    while (queue->count == 0 && !queue->stop) {
+      pthread_cond_wait(&queue->ready, &queue->lock);
+    }
+    if (queue->count == 0)
+      break;
+
+    struct export_task task = queue->tasks[queue->head];
+    queue->head = (queue->head + 1) % ASYNC_MAX_TASKS;
+    queue->count--;
+    queue->active++;
+    pthread_mutex_unlock(&queue->lock);
+
+    task.run(&task);
+    free_task(&task);
+
+    pthread_mutex_lock(&queue->lock);
+    queue->active--;
+    queue->pending_bytes -= task.bytes;
+    pthread_cond_broadcast(&queue->space);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return NULL;
+}
+#endif
+
+
+int export_queue_init(struct export_queue* queue, int threads, size_t max_bytes) {
+  memset(queue, 0, sizeof(struct export_queue));
+  queue->threads = threads < 1 ? 1 : threads > ASYNC_MAX_THREADS ? ASYNC_MAX_THREADS : threads;
+  queue->max_bytes = max_bytes;
+
+#ifdef ASYNC_THREADS
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->ready, NULL);
+  pthread_cond_init(&queue->space, NULL);
+  for (int t = 0; t < queue->threads; t++) {
+    if (pthread_create(&queue->workers[t], NULL, writer, queue) != 0) {
+      queue->threads = t;
+      export_queue_free(queue);
+      return 0;
+    }
+  }
+#endif
+  return 1;
+}
+
+int export_queue_submit(struct export_queue* queue, const float* heightmap, int map_size,
+                        const struct export_task* task) {
+  size_t bytes = (size_t) map_size * map_size * sizeof(float);
+
+#ifdef ASYNC_THREADS
+  struct export_task copy;
+  if (!copy_task(&copy, task))
+    return 0;
+  copy.map_size = map_size;
+  copy.bytes = bytes;
+
+  // reserve a slot and the snapshot, an empty queue takes any size
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count + queue->reserved == ASYNC_MAX_TASKS
+         || (queue->pending_bytes > 0 && queue->pending_bytes + bytes > queue->max_bytes)) {
+    pthread_cond_wait(&queue->space, &queue->lock);
+  }
+  queue->reserved++;
+  queue->pending_bytes += bytes;
+  pthread_mutex_unlock(&queue->lock);
+
+  copy.heightmap = malloc(bytes);
+  if (copy.heightmap != NULL)
+    memcpy(copy.heightmap, heightmap, bytes);
+
+  pthread_mutex_lock(&queue->lock);
+  queue->reserved--;
+  if (copy.heightmap != NULL) {
+    queue->tasks[(queue->head + queue->count) % ASYNC_MAX_TASKS] = copy;
+    queue->count++;
+    pthread_cond_signal(&queue->ready);
+  } else {
+    queue->pending_bytes -= bytes;
+    pthread_cond_broadcast(&queue->space);
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  if (copy.heightmap == NULL) {
+    free_task(&copy);
+    return 0;
+  }
+  return 1;
+#else
+  // no threads, the live heightmap is written right away
+  struct export_task now = *task;
+  now.heightmap = (float*) heightmap;
+  now.map_size = map_size;
+  now.bytes = bytes;
+  (void) queue;
+  (void) copy_task;
+  (void) free_task;
+  now.run(&now);
+  return 1;
+#endif
+}
+
+void export_queue_wait(struct export_queue* queue) {
+#ifdef ASYNC_THREADS
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count + queue->reserved + queue->active > 0) {
+    pthread_cond_wait(&queue->space, &queue->lock);
+  }
+  pthread_mutex_unlock(&queue->lock);
+#else
+  (void) queue;
+#endif
+}
+
+void export_queue_free(struct export_queue* queue) {
+#ifdef ASYNC_THREADS
+  pthread_mutex_lock(&queue->lock);
+  queue->stop = 1;
+  pthread_cond_broadcast(&queue->ready);
+  pthread_mutex_unlock(&queue->lock);
+
+  for (int t = 0; t < queue->threads; t++) {
+    pthread_join(queue->workers[t], NULL);
+  }
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->ready);
+  pthread_cond_destroy(&queue->space);
+#endif
+  queue->threads = 0;
+}
@@ -0,0 +1,110 @@
+/***********************************************************************
+* FILENAME :        async.h   async.c
+*
+* DESCRIPTION :
+*       Background export queue, heightmap snapshots are written by a
+*       pool of writer threads while the simulation continues
+*
+* PUBLIC FUNCTIONS :
+*       int  export_queue_init( struct export_queue* queue, int threads,
+*                               size_t max_bytes )
+*       int  export_queue_submit( struct export_queue* queue,
+*                                 const float* heightmap, int map_size,
+*                                 const struct export_task* task )
+*       void export_queue_wait( struct export_queue* queue )
+*       void export_queue_free( struct export_queue* queue )
+*
+* NOTES :
+*       Every submitted task owns a copy of the heightmap, so erosion
+*       can change the live heightmap right after the submit returns. The
+*       snapshots waiting or being written are capped at max_bytes and
+*       ASYNC_MAX_TASKS, a submit over the cap blocks until a writer has
+*       finished [back pressure]. The Webassembly build has no threads,
+*       there a submit writes the heightmap before it returns.
+*H*/
+
+#ifndef ASYNC_H_
+#define ASYNC_H_
+
+#include <stddef.h>
+
+#ifndef __EMSCRIPTEN__
+#define ASYNC_THREADS
+#include <pthread.h>
+#endif
+
+#define ASYNC_MAX_TASKS   16
+#define ASYNC_MAX_THREADS 8
+
+/**
+ * @brief One export of a heightmap snapshot
+ *
+ * run writes heightmap to filename with the exporter specific
+ * arguments, the queue fills in heightmap and map_size.
+ */
+struct export_task {
+  void (*run)( const struct export_task* task );
+  float* heightmap;
+  int map_size;
+  int format, level, tile_size;
+  float scale;
+  char* filename;
+  size_t bytes;           /* of the snapshot, counted against the cap */
+};
+
+struct export_queue {
+  int threads;
+  size_t max_bytes;
+  struct export_task tasks[ASYNC_MAX_TASKS];
+  int head, count;        /* ring buffer of waiting tasks */
+  int reserved;           /* slots of submits still copying */
+  int active;             /* tasks being written */
+  size_t pending_bytes;   /* snapshots waiting or being written */
+  int stop;
+#ifdef ASYNC_THREADS
+  pthread_t workers[ASYNC_MAX_THREADS];
+  pthread_mutex_t lock;
+  pthread_cond_t ready;   /* a task was queued or the queue stops */
+  pthread_cond_t space;   /* a task finished */
+#endif
+};
+
+/**
+ * @brief Starts @param threads writer threads
+ *
+ * @param queue     the queue to start
+ * @param threads   writer threads, 1 to ASYNC_MAX_THREADS
+ * @param max_bytes the most snapshot bytes held at once, a single
+ *                  snapshot over it is still accepted when the queue is
+ *                  empty
+ * @return          1 on success, 0 when the threads could not start
+ */
+int export_queue_init( struct export_queue* queue, int threads, size_t max_bytes );
+
+/**
+ * @brief Queues an export of a copy of the heightmap
+ *
+ * Blocks while the queue is full, then copies @param heightmap and
+ * returns while a writer exports the copy with @param task.
+ *
+ * @param queue     a started queue
+ * @param heightmap the heightmap to snapshot
+ * @param map_size  the heightmap size
+ * @param task      the exporter and its arguments, the filename is copied
+ * @return          1 when queued or written, 0 when there was no memory
+ *                  for the snapshot and nothing was written
+ */
+int export_queue_submit( struct export_queue* queue, const float* heightmap, int map_size,
+                         const struct export_task* task );
+
+/**
+ * @brief Blocks until every queued export is written
+ */
+void export_queue_wait( struct export_queue* queue );
+
+/**
+ * @brief Writes the queued exports and stops the writer threads
+ */
+void export_queue_free( struct export_queue* queue );
+
+#endif
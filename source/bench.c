@@ -0,0 +1,1117 @@
+/***********************************************************************
+* FILENAME :        bench.c
+*
+* DESCRIPTION :
+*       Benchmark driver for the noise generator and the exporters
+*
+* NOTES :
+*       Build with make bench. Runs every benchmark by default, or only
+*       the ones named on the command line: bench.exe noise
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "noise.h"
+#include "heightmap_gen.h"
+#include "export.h"
+#include "raw.h"
+#include "rtin.h"
+#include "lod.h"
+#include "texture.h"
+#include "import.h"
+#include "tiff.h"
+#include "async.h"
+#include "checkpoint.h"
+#include "timelapse.h"
+#include "resample.h"
+#include "api.h"
+
+// uncompressed png writer used by export_png before deflate.c
+#define SVPNG_LINKAGE static
+#include "svpng.c"
+
+#define BENCH_SIZE 1024
+
+/* wall clock time in seconds */
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* checks if benchmark name is selected on the command line */
+static int selected(const char* name, int argc, char** argv) {
+  if (argc < 2)
+    return 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], name) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+
+/* float noise kernel error against the double kernel, and throughput */
+static void bench_noise(void) {
+  enum { SAMPLES = 1 << 20 };
+  double* xd = malloc(SAMPLES * sizeof(double));
+  double* yd = malloc(SAMPLES * sizeof(double));
+  double* outd = malloc(SAMPLES * sizeof(double));
+  float* xf = malloc(SAMPLES * sizeof(float));
+  float* yf = malloc(SAMPLES * sizeof(float));
+  float* outf = malloc(SAMPLES * sizeof(float));
+
+  init_perm();
+  set_random_seed(42);
+
+  // error at increasing distance from the origin
+  double bases[] = { 0, 1e3, 1e6 };
+  for (int b = 0; b < 3; b++) {
+    int cell_i, cell_j;
+    double origin_x, origin_y;
+    noise_rebase(bases[b], bases[b], &cell_i, &cell_j, &origin_x, &origin_y);
+
+    for (int k = 0; k < SAMPLES; k++) {
+      xd[k] = bases[b] + (double) defined_random() / 32768 * 64;
+      yd[k] = bases[b] + (double) defined_random() / 32768 * 64;
+      xf[k] = (float) (xd[k] - origin_x);
+      yf[k] = (float) (yd[k] - origin_y);
+    }
+    noise_batch(outd, xd, yd, SAMPLES);
+    noisef_batch(outf, xf, yf, SAMPLES, cell_i, cell_j);
+
+    double max_error = 0;
+    for (int k = 0; k < SAMPLES; k++) {
+      double error = fabs(outd[k] - outf[k]);
+      if (error > max_error)
+        max_error = error;
+    }
+    printf("noise: base %g max abs error %.3g\n", bases[b], max_error);
+  }
+
+  double start = now();
+  for (int rep = 0; rep < 8; rep++)
+    noise_batch(outd, xd, yd, SAMPLES);
+  double time_d = now() - start;
+
+  start = now();
+  for (int rep = 0; rep < 8; rep++)
+    noisef_batch(outf, xf, yf, SAMPLES, 0, 0);
+  double time_f = now() - start;
+
+  printf("noise: double %.1f Msamples/s, float %.1f Msamples/s\n",
+         8.0 * SAMPLES / time_d / 1e6, 8.0 * SAMPLES / time_f / 1e6);
+
+  free(xd); free(yd); free(outd);
+  free(xf); free(yf); free(outf);
+}
+
+
+/* analytic gradient against central differences, and its cost */
+static void bench_deriv(void) {
+  enum { SAMPLES = 1 << 20 };
+  const double h = 1e-5;
+  double* xs = malloc(SAMPLES * sizeof(double));
+  double* ys = malloc(SAMPLES * sizeof(double));
+  double* out = malloc(SAMPLES * sizeof(double));
+  double* dx = malloc(SAMPLES * sizeof(double));
+  double* dy = malloc(SAMPLES * sizeof(double));
+
+  init_perm();
+  set_random_seed(7);
+  for (int k = 0; k < SAMPLES; k++) {
+    xs[k] = (double) defined_random() / 32768 * 256;
+    ys[k] = (double) defined_random() / 32768 * 256;
+  }
+
+  noise_deriv_batch(out, dx, dy, xs, ys, SAMPLES);
+  double max_error = 0;
+  for (int k = 0; k < SAMPLES; k++) {
+    double fd_x = (noise(xs[k] + h, ys[k]) - noise(xs[k] - h, ys[k])) / (2 * h);
+    double fd_y = (noise(xs[k], ys[k] + h) - noise(xs[k], ys[k] - h)) / (2 * h);
+    double error = fmax(fabs(fd_x - dx[k]), fabs(fd_y - dy[k]));
+    if (error > max_error)
+      max_error = error;
+  }
+  printf("deriv: max abs error against central difference %.3g\n", max_error);
+
+  double start = now();
+  noise_batch(out, xs, ys, SAMPLES);
+  double time_value = now() - start;
+
+  start = now();
+  noise_deriv_batch(out, dx, dy, xs, ys, SAMPLES);
+  double time_deriv = now() - start;
+
+  printf("deriv: value %.1f Msamples/s, value + gradient %.1f Msamples/s\n",
+         SAMPLES / time_value / 1e6, SAMPLES / time_deriv / 1e6);
+
+  free(xs); free(ys); free(out); free(dx); free(dy);
+}
+
+
+/* heightmap generator in both precisions */
+static void bench_gen(void) {
+  float* map_d = malloc(BENCH_SIZE * BENCH_SIZE * sizeof(float));
+  float* map_f = malloc(BENCH_SIZE * BENCH_SIZE * sizeof(float));
+  struct setting setting = {
+    .seed = 12345,
+    .octaves = 8,
+    .persistence = 0.5f,
+    .height = 1,
+    .scale = 1,
+    .precision = PRECISION_DOUBLE,
+    .mode = MODE_FBM
+  };
+
+  double start = now();
+  gen_heightmap(map_d, BENCH_SIZE, &setting);
+  double time_d = now() - start;
+
+  setting.precision = PRECISION_FLOAT;
+  start = now();
+  gen_heightmap(map_f, BENCH_SIZE, &setting);
+  double time_f = now() - start;
+
+  double max_error = 0;
+  for (int i = 0; i < BENCH_SIZE * BENCH_SIZE; i++) {
+    double error = fabs(map_d[i] - map_f[i]);
+    if (error > max_error)
+      max_error = error;
+  }
+  printf("gen %d: double %.3fs, float %.3fs, max abs error %.3g\n",
+         BENCH_SIZE, time_d, time_f, max_error);
+
+  setting.precision = PRECISION_DOUBLE;
+  setting.mode = MODE_SLOPE;
+  start = now();
+  gen_heightmap(map_d, BENCH_SIZE, &setting);
+  time_d = now() - start;
+
+  setting.precision = PRECISION_FLOAT;
+  start = now();
+  gen_heightmap(map_f, BENCH_SIZE, &setting);
+  time_f = now() - start;
+  printf("gen %d: slope weighted fBm double %.3fs, float %.3fs\n", 
+         BENCH_SIZE, time_d, time_f);
+
+  const char* names[] = { "ridged", "billow", "warp" };
+  int modes[] = { MODE_RIDGED, MODE_BILLOW, MODE_WARP };
+  setting.warp = 0.1f;
+  for (int m = 0; m < 3; m++) {
+    setting.mode = modes[m];
+    setting.precision = PRECISION_DOUBLE;
+    start = now();
+    gen_heightmap(map_d, BENCH_SIZE, &setting);
+    time_d = now() - start;
+
+    setting.precision = PRECISION_FLOAT;
+    start = now();
+    gen_heightmap(map_f, BENCH_SIZE, &setting);
+    time_f = now() - start;
+    printf("gen %d: %s double %.3fs, float %.3fs\n", 
+           BENCH_SIZE, names[m], time_d, time_f);
+  }
+
+  // the api warps by default, without set_warp_strength
+  initialize(BENCH_SIZE);
+  use_default_erosion_params(12345, 6, 0.5f, 1, 1);
+  set_noise_mode(MODE_FBM);
+  generate_noise();
+  memcpy(map_d, get_heightmap(), BENCH_SIZE * BENCH_SIZE * sizeof(float));
+  set_noise_mode(MODE_WARP);
+  generate_noise();
+  int warped = memcmp(map_d, get_heightmap(), BENCH_SIZE * BENCH_SIZE * sizeof(float)) != 0;
+  printf("gen %d: default warp output %s fBm\n", BENCH_SIZE,
+         warped ? "differs from" : "SAME AS");
+  set_noise_mode(MODE_FBM);
+  free_heightmap();
+
+  free(map_d);
+  free(map_f);
+}
+
+
+/* octave cache: first fill, reblend on persistence and rescale on height */
+static void bench_cache(void) {
+  float* map = malloc(BENCH_SIZE * BENCH_SIZE * sizeof(float));
+  float* ref = malloc(BENCH_SIZE * BENCH_SIZE * sizeof(float));
+  struct setting setting = {
+    .seed = 12345,
+    .octaves = 8,
+    .persistence = 0.5f,
+    .height = 1,
+    .scale = 1,
+    .precision = PRECISION_FLOAT,
+    .mode = MODE_FBM
+  };
+  size_t cells = BENCH_SIZE * BENCH_SIZE;
+  size_t budgets[] = { (8 + 1) * cells * sizeof(float), 
+                       (8 + 2) * cells * sizeof(uint16_t) + 2 * 8 * BENCH_SIZE * sizeof(float) };
+  const char* names[] = { "float", "quantized" };
+  // large scales blend over a small range, which normalizing amplifies
+  float scales[] = { 1, 50, 200 };
+
+  for (int s = 0; s < 3; s++) {
+    setting.scale = scales[s];
+    for (int b = 0; b < 2; b++) {
+      struct octave_cache cache;
+      octave_cache_init(&cache, budgets[b]);
+      setting.persistence = 0.5f;
+      setting.height = 1;
+
+      double start = now();
+      gen_heightmap_cached(map, BENCH_SIZE, &setting, &cache);
+      double time_fill = now() - start;
+
+      setting.persistence = 0.6f;
+      start = now();
+      gen_heightmap_cached(map, BENCH_SIZE, &setting, &cache);
+      double time_blend = now() - start;
+
+      setting.height = 0.5f;
+      start = now();
+      gen_heightmap_cached(map, BENCH_SIZE, &setting, &cache);
+      double time_height = now() - start;
+
+      gen_heightmap(ref, BENCH_SIZE, &setting);
+      double max_error = 0;
+      for (size_t i = 0; i < cells; i++) {
+        double error = fabs(map[i] - ref[i]);
+        if (error > max_error)
+          max_error = error;
+      }
+
+      printf("cache %d scale %g %s: fill %.3fs, persistence %.3fs, height %.3fs, "
+             "max abs error %.3g of height\n", BENCH_SIZE, scales[s], names[b], 
+             time_fill, time_blend, time_height, max_error / setting.height);
+      octave_cache_free(&cache);
+    }
+  }
+
+  free(map);
+  free(ref);
+}
+
+
+/* export_obj before the buffered writer, one fprintf per line */
+static void legacy_export_obj(float* heightmap, int map_size, int export_size, char* filename) {
+  int export_scale = map_size / export_size; 
+  FILE* fp = fopen(filename, "w");
+
+  for (int x = 0; x < export_size; x++) {
+    for (int z = 0; z < export_size; z++) {
+      float coord_y = heightmap[(x * export_scale) * map_size + (z * export_scale)];
+      fprintf(fp, "v %f %f %f\n", (float) x / export_size, coord_y, (float) z / export_size);
+    }
+  }
+  for (int x = 0; x < export_size - 1; x++) {
+    for (int z = 0; z < export_size - 1; z++) {
+      int top_left  = x * export_size + z + 1;
+      int top_right = (x + 1) * export_size + z + 1;
+      int bot_left  = x * export_size + z + 2;
+      int bot_right = (x + 1) * export_size + z + 2;
+      fprintf(fp, "f %d %d %d\n", top_left,  top_right, bot_left);
+      fprintf(fp, "f %d %d %d\n", top_right, bot_right, bot_left);
+    }
+  }
+  fclose(fp);
+}
+
+/* size of a file in MB */
+static double file_mb(const char* filename) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL)
+    return 0;
+  fseek(fp, 0, SEEK_END);
+  double size = ftell(fp) / 1e6;
+  fclose(fp);
+  return size;
+}
+
+/* a heightmap to export */
+static float* bench_map(void) {
+  float* map = malloc(BENCH_SIZE * BENCH_SIZE * sizeof(float));
+  struct setting setting = {
+    .seed = 12345,
+    .octaves = 8,
+    .persistence = 0.5f,
+    .height = 1,
+    .scale = 1,
+    .precision = PRECISION_FLOAT,
+    .mode = MODE_FBM
+  };
+  gen_heightmap(map, BENCH_SIZE, &setting);
+  return map;
+}
+
+
+/* buffered obj writer against the fprintf writer, and round trip check */
+static void bench_obj(void) {
+  float* map = bench_map();
+
+  double start = now();
+  legacy_export_obj(map, BENCH_SIZE, BENCH_SIZE, "bench_legacy.obj");
+  double time_legacy = now() - start;
+
+  start = now();
+  export_obj(map, BENCH_SIZE, BENCH_SIZE, "bench.obj");
+  double time_obj = now() - start;
+
+  // every height must read back exactly
+  FILE* fp = fopen("bench.obj", "r");
+  char line[128];
+  int index = 0, mismatches = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    float x, y, z;
+    if (line[0] == 'v' && sscanf(line, "v %f %f %f", &x, &y, &z) == 3) {
+      if (y != map[index] || x != (float) (index / BENCH_SIZE) / BENCH_SIZE)
+        mismatches++;
+      index++;
+    }
+  }
+  fclose(fp);
+
+  printf("obj %d: fprintf %.3fs %.1fMB, buffered %.3fs %.1fMB, "
+         "%d vertices, %d not round tripped\n", BENCH_SIZE, 
+         time_legacy, file_mb("bench_legacy.obj"), 
+         time_obj, file_mb("bench.obj"), index, mismatches);
+  remove("bench_legacy.obj");
+  remove("bench.obj");
+  free(map);
+}
+
+
+/* export_stl before the single buffer writer, fwrite per vector */
+static void legacy_export_stl(float* heightmap, int map_size, char* filename) {
+  FILE* fp = fopen(filename, "wb");
+  uint8_t header[80] = "# Exported from Hydraulic Erosion https://github.com/mustartt/hydraulic-erosion";
+  uint32_t face_count = 2 * (map_size - 1) * (map_size - 1);
+  uint16_t attr = 0;
+  fwrite(header, 1, 80, fp);
+  fwrite(&face_count, sizeof(uint32_t), 1, fp);
+
+  for (int z = 0; z < map_size - 1; z++) {
+    for (int x = 0; x < map_size - 1; x++) {
+      float v1[3] = { (float) x / (map_size - 1),       heightmap[z * map_size + x],             (float) z / (map_size - 1) };
+      float v2[3] = { (float) (x + 1) / (map_size - 1), heightmap[z * map_size + x + 1],         (float) z / (map_size - 1) };
+      float v3[3] = { (float) (x + 1) / (map_size - 1), heightmap[(z + 1) * map_size + x + 1],   (float) (z + 1) / (map_size - 1) };
+      float v4[3] = { (float) x / (map_size - 1),       heightmap[(z + 1) * map_size + x],       (float) (z + 1) / (map_size - 1) };
+      float a[3] = { v4[0] - v1[0], v4[1] - v1[1], v4[2] - v1[2] };
+      float b[3] = { v2[0] - v1[0], v2[1] - v1[1], v2[2] - v1[2] };
+      float n1[3] = { a[1] * b[2] - a[2] * b[1], -(a[0] * b[2] - a[2] * b[0]), a[0] * b[1] - a[1] * b[0] };
+      float c[3] = { v2[0] - v3[0], v2[1] - v3[1], v2[2] - v3[2] };
+      float d[3] = { v4[0] - v3[0], v4[1] - v3[1], v4[2] - v3[2] };
+      float n2[3] = { c[1] * d[2] - c[2] * d[1], -(c[0] * d[2] - c[2] * d[0]), c[0] * d[1] - c[1] * d[0] };
+      fwrite(n1, sizeof(n1), 1, fp);
+      fwrite(v1, sizeof(v1), 1, fp);
+      fwrite(v2, sizeof(v2), 1, fp);
+      fwrite(v4, sizeof(v4), 1, fp);
+      fwrite(&attr, sizeof(attr), 1, fp);
+      fwrite(n2, sizeof(n2), 1, fp);
+      fwrite(v2, sizeof(v2), 1, fp);
+      fwrite(v3, sizeof(v3), 1, fp);
+      fwrite(v4, sizeof(v4), 1, fp);
+      fwrite(&attr, sizeof(attr), 1, fp);
+    }
+  }
+  fclose(fp);
+}
+
+/* 1 when both files have the same bytes */
+static int same_file(const char* a, const char* b) {
+  FILE* fa = fopen(a, "rb");
+  FILE* fb = fopen(b, "rb");
+  int same = fa != NULL && fb != NULL;
+  while (same) {
+    int ca = fgetc(fa), cb = fgetc(fb);
+    same = ca == cb;
+    if (ca == EOF)
+      break;
+  }
+  if (fa) fclose(fa);
+  if (fb) fclose(fb);
+  return same;
+}
+
+/* single buffer stl writer against the fwrite per vector writer */
+static void bench_stl(void) {
+  float* map = bench_map();
+
+  double start = now();
+  legacy_export_stl(map, BENCH_SIZE, "bench_legacy.stl");
+  double time_legacy = now() - start;
+
+  start = now();
+  export_stl(map, BENCH_SIZE, "bench.stl");
+  double time_stl = now() - start;
+
+  printf("stl %d: fwrite %.3fs, single buffer %.3fs, %.1fMB, %s\n", BENCH_SIZE,
+         time_legacy, time_stl, file_mb("bench.stl"),
+         same_file("bench.stl", "bench_legacy.stl") ? "identical" : "DIFFERENT");
+  remove("bench_legacy.stl");
+  remove("bench.stl");
+  free(map);
+}
+
+/* indexed glb and ply against the stl writer */
+static void bench_mesh(void) {
+  float* map = bench_map();
+
+  double start = now();
+  export_stl(map, BENCH_SIZE, "bench.stl");
+  double time_stl = now() - start;
+
+  start = now();
+  export_glb(map, BENCH_SIZE, 0, "bench.glb");
+  double time_glb = now() - start;
+
+  start = now();
+  export_glb(map, BENCH_SIZE, GLB_NORMALS | GLB_UVS, "bench_full.glb");
+  double time_full = now() - start;
+
+  start = now();
+  export_ply(map, BENCH_SIZE, 1, "bench.ply");
+  double time_ply = now() - start;
+
+  printf("mesh %d: stl %.3fs %.1fMB, glb %.3fs %.1fMB, "
+         "glb with normals and uvs %.3fs %.1fMB, "
+         "ply with normals %.3fs %.1fMB\n", BENCH_SIZE,
+         time_stl, file_mb("bench.stl"), time_glb, file_mb("bench.glb"),
+         time_full, file_mb("bench_full.glb"), time_ply, file_mb("bench.ply"));
+  remove("bench.stl");
+  remove("bench.glb");
+  remove("bench_full.glb");
+  remove("bench.ply");
+  free(map);
+}
+
+/* export_png before the compressing encoder */
+static void legacy_export_png(float* heightmap, int map_size, char* filename) {
+  unsigned char* rgb_buffer = malloc(map_size * map_size * 3);
+  FILE* fp = fopen(filename, "wb");
+  for (int i = 0; i < map_size * map_size; i++) {
+    float val = heightmap[i] < 0 ? 0 : heightmap[i] > 1 ? 1 : heightmap[i];
+    rgb_buffer[3 * i] = rgb_buffer[3 * i + 1] = rgb_buffer[3 * i + 2] = (unsigned char) (val * 255);
+  }
+  svpng(fp, map_size, map_size, rgb_buffer, 0);
+  free(rgb_buffer);
+  fclose(fp);
+}
+
+/* compressed png at several levels against svpng */
+static void bench_png(void) {
+  float* map = bench_map();
+  double raw_mb = BENCH_SIZE * BENCH_SIZE * 3 / 1e6;
+
+  double start = now();
+  legacy_export_png(map, BENCH_SIZE, "bench_legacy.png");
+  double time_legacy = now() - start;
+  printf("png %d: svpng    %.3fs %6.1fMB/s %.2fMB\n", BENCH_SIZE, time_legacy, 
+         raw_mb / time_legacy, file_mb("bench_legacy.png"));
+  remove("bench_legacy.png");
+
+  int levels[] = { 0, 1, 6, 9 };
+  for (int i = 0; i < 4; i++) {
+    start = now();
+    export_png_level(map, BENCH_SIZE, levels[i], "bench.png");
+    double time_png = now() - start;
+    printf("png %d: level %d  %.3fs %6.1fMB/s %.2fMB\n", BENCH_SIZE, levels[i], 
+           time_png, raw_mb / time_png, file_mb("bench.png"));
+  }
+  remove("bench.png");
+
+  // 16 bit gray keeps 256 times more height levels in less space
+  start = now();
+  export_png16(map, BENCH_SIZE, 6, "bench16.png");
+  double time_png16 = now() - start;
+  printf("png %d: gray16 level 6  %.3fs %.2fMB\n", BENCH_SIZE, 
+         time_png16, file_mb("bench16.png"));
+  remove("bench16.png");
+  free(map);
+}
+
+/* raw round trips against the npy debug format */
+static void bench_raw(void) {
+  float* map = bench_map();
+  double mb = BENCH_SIZE * BENCH_SIZE * sizeof(float) / 1e6;
+
+  double start = now();
+  int npy_size = 0;
+  write_map(map, BENCH_SIZE, "bench.npy");
+  float* npy = read_map("bench.npy", &npy_size);
+  double time_npy = now() - start;
+  int npy_same = npy != NULL && npy_size == BENCH_SIZE
+                 && memcmp(npy, map, BENCH_SIZE * BENCH_SIZE * sizeof(float)) == 0;
+  free(npy);
+  remove("bench.npy");
+  printf("raw %d: npy map round trip %.3fs, %s\n", BENCH_SIZE, time_npy,
+         npy_same ? "exact" : "MISMATCH");
+
+  const char* names[] = { "r16", "f32" };
+  for (int format = RAW_R16; format <= RAW_F32; format++) {
+    int size = 0;
+    start = now();
+    export_raw(map, BENCH_SIZE, format, 2, "bench.raw");
+    double time_export = now() - start;
+    start = now();
+    float* loaded = import_raw("bench.raw", &size);
+    double time_import = now() - start;
+
+    double max_err = 0;
+    for (int i = 0; loaded && i < BENCH_SIZE * BENCH_SIZE; i++) {
+      double err = fabs(loaded[i] - map[i]);
+      max_err = err > max_err ? err : max_err;
+    }
+    printf("raw %d: %s export %.3fs import %.3fs [%.0fMB/s of heights], "
+           "size %d, max error %.2g\n", BENCH_SIZE, names[format], time_export, 
+           time_import, mb / (time_export + time_import), size, max_err);
+    free(loaded);
+  }
+  remove("bench.raw");
+  remove("bench.raw.meta");
+  free(map);
+}
+
+/* adaptive triangulation of an eroded map at several error bounds */
+static void bench_rtin(void) {
+  initialize(BENCH_SIZE);
+  set_parameters(1, 8, 0.5, 1, 1, 30, 0.05, 4, 0.01, 0.3, 0.3, 0.01, 4);
+  generate_noise();
+  erode_iter(BENCH_SIZE * BENCH_SIZE, 3);
+  float* map = get_heightmap();
+
+  struct rtin rtin;
+  double start = now();
+  rtin_init(&rtin, map, BENCH_SIZE);
+  double time_init = now() - start;
+  int full = 2 * (rtin.grid_size - 1) * (rtin.grid_size - 1);
+  printf("rtin %d: hierarchy %.3fs, full grid %d triangles\n", BENCH_SIZE, time_init, full);
+
+  float errors[] = { 0.0005f, 0.001f, 0.002f, 0.005f, 0.01f };
+  for (int i = 0; i < 5; i++) {
+    struct rtin_mesh mesh;
+    start = now();
+    rtin_mesh(&rtin, errors[i], &mesh);
+    double time_mesh = now() - start;
+    printf("rtin %d: max error %.4f  %.3fs  %8d triangles  %5.1fx fewer\n", BENCH_SIZE, 
+           errors[i], time_mesh, mesh.triangle_count, (double) full / mesh.triangle_count);
+    rtin_mesh_free(&mesh);
+  }
+  rtin_free(&rtin);
+
+  start = now();
+  export_obj_adaptive(map, BENCH_SIZE, 0.002f, "bench_rtin.obj");
+  double time_obj = now() - start;
+  printf("rtin %d: adaptive obj at 0.002 %.3fs %.1fMB\n", BENCH_SIZE, time_obj, 
+         file_mb("bench_rtin.obj"));
+  remove("bench_rtin.obj");
+  free_heightmap();
+}
+
+/* chunked lod export at several chunk sizes */
+static void bench_lod(void) {
+  float* map = bench_map();
+
+  double start = now();
+  export_glb(map, BENCH_SIZE, 0, "bench.glb");
+  double time_glb = now() - start;
+  printf("lod %d: single glb %.3fs %.1fMB\n", BENCH_SIZE, time_glb, file_mb("bench.glb"));
+  remove("bench.glb");
+
+  int quads[] = { 32, 64, 128 };
+  for (int i = 0; i < 3; i++) {
+    start = now();
+    export_lod(map, BENCH_SIZE, quads[i], "bench.lod");
+    double time_lod = now() - start;
+    printf("lod %d: %3d quad chunks %.3fs %.1fMB\n", BENCH_SIZE, quads[i], time_lod, 
+           file_mb("bench.lod"));
+  }
+  remove("bench.lod");
+  free(map);
+}
+
+/* derived textures in one pass against one export per texture */
+static void bench_texture(void) {
+  float* map = bench_map();
+  const char* suffixes[] = { "_height.png", "_normal.png", "_slope.png", "_curvature.png" };
+  int all = TEXTURE_HEIGHT | TEXTURE_NORMAL | TEXTURE_SLOPE | TEXTURE_CURVATURE;
+
+  double start = now();
+  export_png16(map, BENCH_SIZE, 6, "bench16.png");
+  double time_png16 = now() - start;
+  remove("bench16.png");
+  printf("texture %d: png16 heightmap alone %.3fs\n", BENCH_SIZE, time_png16);
+
+  for (int depth = 8; depth <= 16; depth += 8) {
+    start = now();
+    for (int t = 0; t < 4; t++) {
+      export_textures(map, BENCH_SIZE, 1 << t, depth, 1, 6, "bench");
+    }
+    double time_separate = now() - start;
+
+    start = now();
+    export_textures(map, BENCH_SIZE, all, depth, 1, 6, "bench");
+    double time_single = now() - start;
+
+    double mb = 0;
+    char name[64];
+    for (int t = 0; t < 4; t++) {
+      sprintf(name, "bench%s", suffixes[t]);
+      mb += file_mb(name);
+      remove(name);
+    }
+    printf("texture %d: %2d bit height, normal, slope, curvature: "
+           "one pass %.3fs, pass per texture %.3fs, %.1fMB\n", 
+           BENCH_SIZE, depth, time_single, time_separate, mb);
+  }
+  free(map);
+}
+
+/* png decoding of the rgb and 16 bit gray exports */
+static void bench_import(void) {
+  float* map = bench_map();
+  double mb = BENCH_SIZE * BENCH_SIZE * sizeof(float) / 1e6;
+  const char* names[] = { "rgb8", "gray16" };
+
+  for (int format = 0; format < 2; format++) {
+    int size = 0;
+    if (format == 0)
+      export_png(map, BENCH_SIZE, "bench.png");
+    else
+      export_png16(map, BENCH_SIZE, 6, "bench.png");
+
+    double start = now();
+    float* loaded = import_heightmap("bench.png", &size);
+    double time_import = now() - start;
+
+    double max_err = 0;
+    for (int i = 0; loaded && i < BENCH_SIZE * BENCH_SIZE; i++) {
+      float height = map[i] < 0 ? 0 : map[i] > 1 ? 1 : map[i];
+      double err = fabs(loaded[i] - height);
+      max_err = err > max_err ? err : max_err;
+    }
+    printf("import %d: %-6s %.3fs [%.0fMB/s of heights], size %d, max error %.2g\n",
+           BENCH_SIZE, names[format], time_import, mb / time_import, size, max_err);
+    free(loaded);
+  }
+  remove("bench.png");
+  free(map);
+}
+
+/* mapped heightmap startup against reading the file, and whether erosion
+   reaches the file */
+static void bench_mmap(void) {
+  int size = 4 * BENCH_SIZE;
+  size_t count = (size_t) size * size;
+  float* map = malloc(count * sizeof(float));
+  for (size_t i = 0; i < count; i++) {
+    map[i] = 0.5f + 0.25f * sinf(i % size * 0.01f) * cosf(i / size * 0.013f);
+  }
+  export_raw(map, size, RAW_F32, 1, "bench.raw");
+
+  set_parameters(1, 8, 0.5, 1, 1, 30, 0.05, 4, 0.01, 0.3, 0.3, 0.01, 4);
+  double start = now();
+  load_raw("bench.raw");
+  double time_read = now() - start;
+  start = now();
+  load_mapped("bench.raw", 0);
+  double time_map = now() - start;
+  printf("mmap %d: load_raw %.4fs, load_mapped %.6fs\n", size, time_read, time_map);
+
+  const char* modes[] = { "private", "shared" };
+  for (int shared = 0; shared <= 1; shared++) {
+    load_mapped("bench.raw", shared);
+    start = now();
+    erode_iter(100000, 3);
+    double time_erode = now() - start;
+    free_heightmap();
+
+    int loaded_size;
+    float* loaded = import_raw("bench.raw", &loaded_size);
+    size_t changed = 0;
+    for (size_t i = 0; loaded && i < count; i++) {
+      changed += loaded[i] != map[i];
+    }
+    printf("mmap %d: %-7s erode 100000 drops %.3fs, %zu file heights changed\n",
+           size, modes[shared], time_erode, changed);
+    free(loaded);
+  }
+  remove("bench.raw");
+  remove("bench.raw.meta");
+  free(map);
+}
+
+/* tiff layouts round trip, and a window read against the whole map */
+static void bench_tiff(void) {
+  float* map = bench_map();
+  double mb = BENCH_SIZE * BENCH_SIZE * sizeof(float) / 1e6;
+  const char* names[] = { "u16", "f32" };
+  int tiles[] = { 0, 256 };
+  int levels[] = { 0, 6 };
+
+  for (int format = TIFF_U16; format <= TIFF_F32; format++) {
+    for (int t = 0; t < 2; t++) {
+      for (int l = 0; l < 2; l++) {
+        int size = 0;
+        double start = now();
+        export_tiff(map, BENCH_SIZE, format, tiles[t], levels[l], "bench.tif");
+        double time_export = now() - start;
+        start = now();
+        float* loaded = import_tiff("bench.tif", &size);
+        double time_import = now() - start;
+
+        double max_err = 0;
+        for (int i = 0; loaded && i < BENCH_SIZE * BENCH_SIZE; i++) {
+          float height = format == TIFF_U16 ? (map[i] < 0 ? 0 : map[i] > 1 ? 1 : map[i]) : map[i];
+          double err = fabs(loaded[i] - height);
+          max_err = err > max_err ? err : max_err;
+        }
+        printf("tiff %d: %s %-6s level %d export %.3fs import %.3fs [%.0fMB/s of heights] "
+               "%.2fMB, max error %.2g\n", BENCH_SIZE, names[format],
+               tiles[t] ? "tiled" : "strips", levels[l], time_export, time_import,
+               mb / (time_export + time_import), file_mb("bench.tif"), max_err);
+        free(loaded);
+      }
+    }
+  }
+
+  // a 256 window of the last file only decodes the tiles under it
+  double start = now();
+  float* window = import_tiff_window("bench.tif", 384, 384, 256);
+  double time_window = now() - start;
+  int same = window != NULL;
+  for (int y = 0; same && y < 256; y++) {
+    same = memcmp(window + y * 256, map + (size_t) (384 + y) * BENCH_SIZE + 384,
+                  256 * sizeof(float)) == 0;
+  }
+  printf("tiff %d: 256 window %.4fs, %s\n", BENCH_SIZE, time_window, same ? "exact" : "MISMATCH");
+  free(window);
+  remove("bench.tif");
+  free(map);
+}
+
+/* erosion with png16 snapshots written in line against async writers */
+static void bench_async(void) {
+  int size = 2 * BENCH_SIZE;
+  int snapshots = 8;
+  int drops = 20000;
+  const char* modes[] = { "sync", "async" };
+  double loops[2];
+  char filename[64];
+
+  for (int async = 0; async <= 1; async++) {
+    initialize(size);
+    set_parameters(1, 8, 0.5, 1, 1, 30, 0.05, 4, 0.01, 0.3, 0.3, 0.01, 4);
+    generate_noise();
+    set_export_threads(2, 128);
+
+    double start = now();
+    for (int i = 0; i < snapshots; i++) {
+      erode_iter(drops, 3);
+      sprintf(filename, "bench_%s_%d.png", modes[async], i);
+      if (async)
+        save_png16_async(filename);
+      else
+        save_png16(filename);
+    }
+    loops[async] = now() - start;
+    wait_exports();
+    double time_all = now() - start;
+    printf("\nasync %d: %-5s %d snapshots, erosion loop %.3fs, all written %.3fs\n", size,
+           modes[async], snapshots, loops[async], time_all);
+    free_heightmap();
+  }
+
+  // the snapshots must be the heightmap at the time of the save
+  int same = 1;
+  for (int i = 0; i < snapshots; i++) {
+    char other[64];
+    sprintf(filename, "bench_sync_%d.png", i);
+    sprintf(other, "bench_async_%d.png", i);
+    same &= same_file(filename, other);
+    remove(filename);
+    remove(other);
+  }
+  // with one core the writers only overlap the loop, not speed it up
+  printf("async %d: erosion loop %.2fx shorter, snapshots %s\n", size, loops[0] / loops[1],
+         same ? "identical" : "DIFFER");
+}
+
+/* checkpointed run resumed from its file against an uninterrupted run */
+static void bench_checkpoint(void) {
+  int size = 4 * BENCH_SIZE;
+  int rounds = 4;
+  int drops = 2000;
+  double mb = (double) size * size * sizeof(float) / 1e6;
+
+  initialize(size);
+  set_parameters(1, 8, 0.5, 1, 1, 30, 0.05, 4, 0.01, 0.3, 0.3, 0.01, 4);
+  generate_noise();
+  erode_iter(rounds * drops, 3);
+  float* straight = malloc((size_t) size * size * sizeof(float));
+  memcpy(straight, get_heightmap(), (size_t) size * size * sizeof(float));
+  free_heightmap();
+
+  initialize(size);
+  set_parameters(1, 8, 0.5, 1, 1, 30, 0.05, 4, 0.01, 0.3, 0.3, 0.01, 4);
+  generate_noise();
+  for (int i = 0; i < rounds; i++) {
+    // the run stops after the second round and resumes from the file
+    if (i == 2) {
+      free_heightmap();
+      double start = now();
+      load_checkpoint("bench.ckpt");
+      printf("\ncheckpoint %d: resumed in %.3fs\n", size, now() - start);
+    }
+    erode_iter(drops, 3);
+    double before = file_mb("bench.ckpt");
+    double start = now();
+    save_checkpoint("bench.ckpt");
+    double time_save = now() - start;
+    printf("\ncheckpoint %d: round %d save %.3fs, %.1fMB written, heightmap %.1fMB\n", size, i,
+           time_save, file_mb("bench.ckpt") - (i == 0 || i == 2 ? 0 : before), mb);
+  }
+
+  int same = memcmp(straight, get_heightmap(), (size_t) size * size * sizeof(float)) == 0;
+  printf("checkpoint %d: resumed run %s the uninterrupted run\n", size,
+         same ? "matches" : "DIFFERS from");
+  free_heightmap();
+  free(straight);
+  remove("bench.ckpt");
+}
+
+/* timelapse capture against a png16 per frame, and random frame reads */
+static void bench_timelapse(void) {
+  int size = 2 * BENCH_SIZE;
+  int frames = 24;
+  int every = 2000;
+  size_t count = (size_t) size * size;
+  float* reference[2] = { malloc(count * sizeof(float)), malloc(count * sizeof(float)) };
+  int checked[2] = { 7, 22 };
+
+  initialize(size);
+  set_parameters(1, 8, 0.5, 1, 1, 30, 0.05, 4, 0.01, 0.3, 0.3, 0.01, 4);
+  generate_noise();
+  start_timelapse("bench.etl", every, 16, 1);
+
+  double time_png = 0, png_mb = 0, time_erode = 0;
+  for (int f = 1; f < frames; f++) {
+    double start = now();
+    erode_iter(every, 3);
+    time_erode += now() - start;
+    for (int c = 0; c < 2; c++) {
+      if (f == checked[c])
+        memcpy(reference[c], get_heightmap(), count * sizeof(float));
+    }
+    start = now();
+    save_png16("bench_frame.png");
+    time_png += now() - start;
+    png_mb += file_mb("bench_frame.png");
+  }
+  stop_timelapse();
+  remove("bench_frame.png");
+
+  double time_capture = 0;
+  {
+    // capture alone, the erosion above includes it
+    struct timelapse tl;
+    float* map = get_heightmap();
+    timelapse_begin(&tl, map, size, 16, 1, "bench_alone.etl");
+    double start = now();
+    for (int f = 0; f < frames; f++) {
+      map[(size_t) f * 97 % count] += 0.001f;
+      timelapse_frame(&tl, map, size, f);
+    }
+    time_capture = now() - start;
+    timelapse_end(&tl);
+    remove("bench_alone.etl");
+  }
+  printf("\ntimelapse %d: %d frames, erosion %.3fs, png16 per frame %.3fs %.1fMB, "
+         "timelapse %.1fMB, capture of %d frames alone %.3fs\n", size, frames, time_erode,
+         time_png, png_mb, file_mb("bench.etl"), frames, time_capture);
+
+  for (int c = 0; c < 2; c++) {
+    int read_size;
+    double start = now();
+    float* frame = timelapse_read("bench.etl", checked[c], &read_size, NULL);
+    double time_read = now() - start;
+    double max_err = 0;
+    for (size_t i = 0; frame && i < count; i++) {
+      double err = fabs(frame[i] - reference[c][i]);
+      max_err = err > max_err ? err : max_err;
+    }
+    printf("timelapse %d: frame %d of %d read %.3fs, max error %.2g\n", size, checked[c],
+           timelapse_frames("bench.etl"), time_read, frame ? max_err : -1.0);
+    free(frame);
+    free(reference[c]);
+  }
+  remove("bench.etl");
+  free_heightmap();
+
+  // a smaller map loaded while capturing ends the capture, the frames
+  // after it would read past the smaller heightmap
+  initialize(64);
+  generate_noise();
+  save_png("bench_small.png");
+  free_heightmap();
+  initialize(256);
+  generate_noise();
+  start_timelapse("bench_swap.etl", 100, 16, 1);
+  load_png("bench_small.png");
+  erode_iter(1000, 3);
+  int kept = timelapse_frames("bench_swap.etl");
+  struct timelapse tl;
+  timelapse_begin(&tl, get_heightmap(), 64, 16, 1, "bench_swap.etl");
+  int rejected = !timelapse_frame(&tl, get_heightmap(), 32, 0);
+  timelapse_end(&tl);
+  printf("timelapse: map swapped while capturing, %d frame kept%s, other sizes %s\n", kept,
+         kept == 1 ? "" : " [WRONG]", rejected ? "rejected" : "WRITTEN");
+  remove("bench_small.png");
+  remove("bench_swap.etl");
+  free_heightmap();
+}
+
+/* resampler speed, block mean exactness and aliasing against point sampling */
+static void bench_resample(void) {
+  int size = 4 * BENCH_SIZE;
+  size_t count = (size_t) size * size;
+  float* map = malloc(count * sizeof(float));
+  float* smooth = malloc(count * sizeof(float));
+  // a smooth terrain with near nyquist ripples, the ripples should average out
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      size_t i = (size_t) y * size + x;
+      smooth[i] = 0.5f + 0.25f * sinf(x * 0.004f) * cosf(y * 0.003f);
+      map[i] = smooth[i] + 0.05f * sinf(x * 2.9f + y * 0.7f);
+    }
+  }
+
+  const char* names[] = { "box", "lanczos" };
+  int sizes[] = { 1024, 1000, 333, 6000 };
+  for (int filter = RESAMPLE_BOX; filter <= RESAMPLE_LANCZOS; filter++) {
+    for (int s = 0; s < 4; s++) {
+      double start = now();
+      float* out = resample(map, size, sizes[s], filter);
+      double time = now() - start;
+      printf("resample %d: %-7s to %4d %.3fs\n", size, names[filter], sizes[s], time);
+      free(out);
+    }
+  }
+
+  // an integer factor box is the mean of each block
+  int factor = 8, small = size / factor;
+  float* box = resample(map, size, small, RESAMPLE_BOX);
+  float* truth = resample(smooth, size, small, RESAMPLE_BOX);
+  double max_err = 0, point_rms = 0, box_rms = 0;
+  for (int y = 0; y < small; y++) {
+    for (int x = 0; x < small; x++) {
+      double mean = 0;
+      for (int j = 0; j < factor; j++) {
+        for (int i = 0; i < factor; i++) {
+          mean += map[(size_t) (y * factor + j) * size + x * factor + i];
+        }
+      }
+      mean /= factor * factor;
+      size_t o = (size_t) y * small + x;
+      double err = fabs(box[o] - mean);
+      max_err = err > max_err ? err : max_err;
+      // the old export_obj picked every k-th height
+      double point = map[(size_t) y * factor * size + x * factor] - truth[o];
+      point_rms += point * point;
+      box_rms += (box[o] - truth[o]) * (box[o] - truth[o]);
+    }
+  }
+  printf("resample %d: box to %d max error to block means %.2g, ripple rms point %.4f box %.4f\n",
+         size, small, max_err, sqrt(point_rms / small / small), sqrt(box_rms / small / small));
+  free(box);
+  free(truth);
+
+  double start = now();
+  export_obj(map, size, 1000, "bench_resample.obj");
+  printf("resample %d: obj at 1000 %.3fs %.1fMB\n", size, now() - start,
+         file_mb("bench_resample.obj"));
+  remove("bench_resample.obj");
+  free(map);
+  free(smooth);
+}
+
+/* png, png16, stl and obj one after another against one traversal */
+static void bench_multi(void) {
+  float* map = bench_map();
+  const char* separate[] = { "bench_sep.png", "bench_sep_16.png", "bench_sep.stl", "bench_sep.obj" };
+  const char* combined[] = { "bench_multi.png", "bench_multi_16.png", "bench_multi.stl",
+                             "bench_multi.obj" };
+
+  double start = now();
+  export_png_level(map, BENCH_SIZE, 6, (char*) separate[0]);
+  export_png16(map, BENCH_SIZE, 6, (char*) separate[1]);
+  export_stl(map, BENCH_SIZE, (char*) separate[2]);
+  export_obj(map, BENCH_SIZE, BENCH_SIZE, (char*) separate[3]);
+  double time_separate = now() - start;
+
+  start = now();
+  export_multi(map, BENCH_SIZE, EXPORT_PNG | EXPORT_PNG16 | EXPORT_STL | EXPORT_OBJ, 6,
+               "bench_multi");
+  double time_multi = now() - start;
+
+  int same = 1;
+  for (int i = 0; i < 4; i++) {
+    same &= same_file(separate[i], combined[i]);
+    remove(separate[i]);
+    remove(combined[i]);
+  }
+  printf("multi %d: png png16 stl obj separate %.3fs, one traversal %.3fs, files %s\n",
+         BENCH_SIZE, time_separate, time_multi, same ? "identical" : "DIFFER");
+  free(map);
+}
+
+
+int main(int argc, char** argv) {
+  if (selected("noise", argc, argv))
+    bench_noise();
+  if (selected("deriv", argc, argv))
+    bench_deriv();
+  if (selected("gen", argc, argv))
+    bench_gen();
+  if (selected("cache", argc, argv))
+    bench_cache();
+  if (selected("obj", argc, argv))
+    bench_obj();
+  if (selected("stl", argc, argv))
+    bench_stl();
+  if (selected("mesh", argc, argv))
+    bench_mesh();
+  if (selected("png", argc, argv))
+    bench_png();
+  if (selected("raw", argc, argv))
+    bench_raw();
+  if (selected("rtin", argc, argv))
+    bench_rtin();
+  if (selected("lod", argc, argv))
+    bench_lod();
+  if (selected("texture", argc, argv))
+    bench_texture();
+  if (selected("import", argc, argv))
+    bench_import();
+  if (selected("mmap", argc, argv))
+    bench_mmap();
+  if (selected("tiff", argc, argv))
+    bench_tiff();
+  if (selected("async", argc, argv))
+    bench_async();
+  if (selected("checkpoint", argc, argv))
+    bench_checkpoint();
+  if (selected("timelapse", argc, argv))
+    bench_timelapse();
+  if (selected("resample", argc, argv))
+    bench_resample();
+  if (selected("multi", argc, argv))
+    bench_multi();
+  return 0;
+}
@@ -0,0 +1,329 @@
+/***********************************************************************
+* FILENAME :        checkpoint.h   checkpoint.c
+*
+* DESCRIPTION :
+*       Checkpoints of long erosion runs, the heightmap, parameters,
+*       droplet generator and droplet count, written incrementally so a
+*       resumed run continues exactly where it stopped
+*
+* PUBLIC FUNCTIONS :
+*       void   checkpoint_changed( struct checkpoint_log* log )
+*       void   checkpoint_mark( struct checkpoint_log* log, int map_size,
+*                               int x, int y, int reach, int wrap )
+*       int    write_checkpoint( struct checkpoint_log* log,
+*                                const float* heightmap, int map_size,
+*                                const struct checkpoint_state* state,
+*                                char* filename )
+*       float* read_checkpoint( char* filename, int* map_size,
+*                               struct checkpoint_state* state )
+*       void   checkpoint_free( struct checkpoint_log* log )
+*
+* PRIVATE FUNCTIONS :
+*       put, put32, tile_extent, spans, write_record, append_record,
+*       rewrite, read_record
+*
+* NOTES :
+*       File layout, all little endian:
+*         header  "ERCK", version, map size, tile size     [4 x uint32]
+*         record  "CKPT" [uint32], payload bytes [uint64], payload,
+*                 crc32 of the payload [uint32]
+*         payload droplet_rand state [uint64], droplets [int64],
+*                 sizeof erosion_param [uint32], erosion_param,
+*                 sizeof setting [uint32], setting, tile count [uint32],
+*                 per tile its index [uint32, row major] and its rows
+*       A record is only applied once its whole payload passed the crc.
+*H*/
+
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deflate.h"
+
+#define CHECKPOINT_MAGIC   0x4b435245u  /* "ERCK" */
+#define CHECKPOINT_VERSION 1
+#define RECORD_MAGIC       0x54504b43u  /* "CKPT" */
+#define HEADER_BYTES       16
+#define READ_CHUNK         (1 << 16)
+
+/* payload writer, keeps the crc of everything written */
+struct record_writer {
+  FILE* fp;
+  uint32_t crc;
+  int error;
+};
+
+
+static void put(struct record_writer* w, const void* data, size_t length) {
+  w->crc = deflate_crc32(w->crc, data, length);
+  if (fwrite(data, 1, length, w->fp) != length)
+    w->error = 1;
+}
+
+static void put32(struct record_writer* w, uint32_t value) {
+  put(w, &value, sizeof(uint32_t));
+}
+
+/* width of tile column t, or height of tile row t, the last may be cut */
+static int tile_extent(int map_size, int t) {
+  int extent = map_size - t * CHECKPOINT_TILE;
+  return extent < CHECKPOINT_TILE ? extent : CHECKPOINT_TILE;
+}
+
+/* splits cells [c0, c1] into at most two spans inside the map */
+static int spans(int c0, int c1, int map_size, int wrap, int span[4]) {
+  if (!wrap || c1 - c0 + 1 >= map_size) {
+    span[0] = c0 < 0 ? 0 : c0;
+    span[1] = c1 >= map_size ? map_size - 1 : c1;
+    return 1;
+  }
+  c0 = (c0 % map_size + map_size) % map_size;
+  c1 = (c1 % map_size + map_size) % map_size;
+  span[0] = c0;
+  span[1] = c0 <= c1 ? c1 : map_size - 1;
+  span[2] = 0;
+  span[3] = c1;
+  return c0 <= c1 ? 1 : 2;
+}
+
+/* writes one record of the tiles with a set flag, every tile when dirty is NULL */
+static int write_record(FILE* fp, const float* heightmap, int map_size, const uint8_t* dirty,
+                        const struct checkpoint_state* state) {
+  int tiles = (map_size + CHECKPOINT_TILE - 1) / CHECKPOINT_TILE;
+  uint32_t count = 0;
+  uint64_t length = 8 + 8 + 4 + sizeof(struct erosion_param) + 4 + sizeof(struct setting) + 4;
+  for (int t = 0; t < tiles * tiles; t++) {
+    if (dirty == NULL || dirty[t]) {
+      count++;
+      length += 4 + (uint64_t) tile_extent(map_size, t % tiles)
+                * tile_extent(map_size, t / tiles) * sizeof(float);
+    }
+  }
+
+  uint32_t magic = RECORD_MAGIC;
+  if (fwrite(&magic, sizeof(uint32_t), 1, fp) != 1 || fwrite(&length, sizeof(uint64_t), 1, fp) != 1)
+    return 0;
+
+  struct record_writer w = { fp, 0, 0 };
+  put(&w, &state->rng, sizeof(uint64_t));
+  put(&w, &state->drops, sizeof(int64_t));
+  put32(&w, sizeof(struct erosion_param));
+  put(&w, &state->erode, sizeof(struct erosion_param));
+  put32(&w, sizeof(struct setting));
+  put(&w, &state->noise, sizeof(struct setting));
+  put32(&w, count);
+
+  for (int t = 0; t < tiles * tiles && !w.error; t++) {
+    if (dirty != NULL && !dirty[t])
+      continue;
+    int tx = t % tiles;
+    int ty = t / tiles;
+    int width = tile_extent(map_size, tx);
+    int height = tile_extent(map_size, ty);
+    put32(&w, t);
+    for (int y = 0; y < height; y++) {
+      size_t row = (size_t) (ty * CHECKPOINT_TILE + y) * map_size + tx * CHECKPOINT_TILE;
+      put(&w, heightmap + row, width * sizeof(float));
+    }
+  }
+  return !w.error && fwrite(&w.crc, sizeof(uint32_t), 1, fp) == 1;
+}
+
+/* appends the dirty tiles to the file of the last checkpoint */
+static int append_record(struct checkpoint_log* log, const float* heightmap, int map_size,
+                         const struct checkpoint_state* state) {
+  FILE* fp = fopen(log->filename, "r+b");
+  if (fp == NULL)
+    return 0;
+
+  // a file that is gone short or grew past the limit is rewritten instead
+  long limit = HEADER_BYTES + CHECKPOINT_COMPACT * (long) map_size * map_size * sizeof(float);
+  long length = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+  int ok = length >= HEADER_BYTES && length <= limit
+           && write_record(fp, heightmap, map_size, log->dirty, state);
+  return (fclose(fp) == 0) && ok;
+}
+
+/* writes a new file of a single full record next to filename, then replaces it */
+static int rewrite(const float* heightmap, int map_size, const struct checkpoint_state* state,
+                   char* filename) {
+  char* temp = malloc(strlen(filename) + 5);
+  if (temp == NULL)
+    return 0;
+  sprintf(temp, "%s.tmp", filename);
+
+  FILE* fp = fopen(temp, "wb");
+  if (fp == NULL) {
+    free(temp);
+    return 0;
+  }
+  uint32_t header[4] = { CHECKPOINT_MAGIC, CHECKPOINT_VERSION, map_size, CHECKPOINT_TILE };
+  int ok = fwrite(header, sizeof(uint32_t), 4, fp) == 4
+           && write_record(fp, heightmap, map_size, NULL, state);
+  ok = (fclose(fp) == 0) && ok;
+
+  if (ok && rename(temp, filename) != 0) {
+    // rename does not replace an existing file on windows
+    remove(filename);
+    ok = rename(temp, filename) == 0;
+  }
+  if (!ok)
+    remove(temp);
+  free(temp);
+  return ok;
+}
+
+/* reads the payload of a record that passed its crc into heightmap and state */
+static int read_record(FILE* fp, float* heightmap, int map_size, int first,
+                       struct checkpoint_state* state) {
+  int tiles = (map_size + CHECKPOINT_TILE - 1) / CHECKPOINT_TILE;
+  struct checkpoint_state record;
+  uint32_t bytes, count;
+
+  if (fread(&record.rng, sizeof(uint64_t), 1, fp) != 1
+      || fread(&record.drops, sizeof(int64_t), 1, fp) != 1
+      || fread(&bytes, sizeof(uint32_t), 1, fp) != 1 || bytes != sizeof(struct erosion_param)
+      || fread(&record.erode, bytes, 1, fp) != 1
+      || fread(&bytes, sizeof(uint32_t), 1, fp) != 1 || bytes != sizeof(struct setting)
+      || fread(&record.noise, bytes, 1, fp) != 1
+      || fread(&count, sizeof(uint32_t), 1, fp) != 1 || count > (uint32_t) tiles * tiles)
+    return 0;
+  // the first record is the base every later one changes
+  if (first && count != (uint32_t) tiles * tiles)
+    return 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t t;
+    if (fread(&t, sizeof(uint32_t), 1, fp) != 1 || t >= (uint32_t) tiles * tiles)
+      return 0;
+    int tx = t % tiles;
+    int ty = t / tiles;
+    int width = tile_extent(map_size, tx);
+    int height = tile_extent(map_size, ty);
+    for (int y = 0; y < height; y++) {
+      size_t row = (size_t) (ty * CHECKPOINT_TILE + y) * map_size + tx * CHECKPOINT_TILE;
+      if (fread(heightmap + row, sizeof(float), width, fp) != (size_t) width)
+        return 0;
+    }
+  }
+  *state = record;
+  return 1;
+}
+
+
+void checkpoint_changed(struct checkpoint_log* log) {
+  log->full = 1;
+}
+
+void checkpoint_mark(struct checkpoint_log* log, int map_size, int x, int y, int reach,
+                     int wrap) {
+  // nothing to track until a checkpoint of this heightmap exists
+  if (log->full || log->dirty == NULL || log->map_size != map_size)
+    return;
+
+  int span_x[4], span_y[4];
+  int count_x = spans(x - reach, x + reach, map_size, wrap, span_x);
+  int count_y = spans(y - reach, y + reach, map_size, wrap, span_y);
+  for (int j = 0; j < count_y; j++) {
+    for (int ty = span_y[2 * j] / CHECKPOINT_TILE; ty <= span_y[2 * j + 1] / CHECKPOINT_TILE; ty++) {
+      for (int i = 0; i < count_x; i++) {
+        for (int tx = span_x[2 * i] / CHECKPOINT_TILE; tx <= span_x[2 * i + 1] / CHECKPOINT_TILE; tx++) {
+          log->dirty[ty * log->tiles + tx] = 1;
+        }
+      }
+    }
+  }
+}
+
+int write_checkpoint(struct checkpoint_log* log, const float* heightmap, int map_size,
+                     const struct checkpoint_state* state, char* filename) {
+  int full = log->full || log->dirty == NULL || log->map_size != map_size
+             || strcmp(log->filename, filename) != 0;
+
+  if (!full && append_record(log, heightmap, map_size, state)) {
+    memset(log->dirty, 0, (size_t) log->tiles * log->tiles);
+    return 1;
+  }
+  // a failed append may have left a torn record, later ones would not be read
+  log->full = 1;
+  if (!rewrite(heightmap, map_size, state, filename))
+    return 0;
+
+  int tiles = (map_size + CHECKPOINT_TILE - 1) / CHECKPOINT_TILE;
+  checkpoint_free(log);
+  log->dirty = calloc((size_t) tiles * tiles, sizeof(uint8_t));
+  log->filename = malloc(strlen(filename) + 1);
+  if (log->dirty == NULL || log->filename == NULL) {
+    // the file is written, the next checkpoint is full again
+    checkpoint_free(log);
+    log->full = 1;
+    return 1;
+  }
+  strcpy(log->filename, filename);
+  log->map_size = map_size;
+  log->tiles = tiles;
+  log->full = 0;
+  return 1;
+}
+
+float* read_checkpoint(char* filename, int* map_size, struct checkpoint_state* state) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL)
+    return NULL;
+
+  uint32_t header[4];
+  if (fread(header, sizeof(uint32_t), 4, fp) != 4 || header[0] != CHECKPOINT_MAGIC
+      || header[1] != CHECKPOINT_VERSION || header[2] < 2 || header[2] > 65536
+      || header[3] != CHECKPOINT_TILE) {
+    fclose(fp);
+    return NULL;
+  }
+  int size = header[2];
+  float* heightmap = calloc((size_t) size * size, sizeof(float));
+  uint8_t* buffer = malloc(READ_CHUNK);
+  int records = 0;
+
+  while (heightmap != NULL && buffer != NULL) {
+    uint32_t magic, crc = 0, stored;
+    uint64_t length;
+    if (fread(&magic, sizeof(uint32_t), 1, fp) != 1 || magic != RECORD_MAGIC
+        || fread(&length, sizeof(uint64_t), 1, fp) != 1)
+      break;
+
+    // check the whole payload before applying any of it
+    long start = ftell(fp);
+    uint64_t left = length;
+    while (left > 0) {
+      size_t chunk = left < READ_CHUNK ? (size_t) left : READ_CHUNK;
+      if (fread(buffer, 1, chunk, fp) != chunk)
+        break;
+      crc = deflate_crc32(crc, buffer, chunk);
+      left -= chunk;
+    }
+    if (left > 0 || fread(&stored, sizeof(uint32_t), 1, fp) != 1 || stored != crc)
+      break;
+
+    if (fseek(fp, start, SEEK_SET) != 0
+        || !read_record(fp, heightmap, size, records == 0, state)
+        || fseek(fp, start + (long) length + sizeof(uint32_t), SEEK_SET) != 0)
+      break;
+    records++;
+  }
+  fclose(fp);
+  free(buffer);
+
+  if (records == 0) {
+    free(heightmap);
+    return NULL;
+  }
+  *map_size = size;
+  return heightmap;
+}
+
+void checkpoint_free(struct checkpoint_log* log) {
+  free(log->dirty);
+  free(log->filename);
+  memset(log, 0, sizeof(struct checkpoint_log));
+}
@@ -0,0 +1,117 @@
+/***********************************************************************
+* FILENAME :        checkpoint.h   checkpoint.c
+*
+* DESCRIPTION :
+*       Checkpoints of long erosion runs, the heightmap, parameters,
+*       droplet generator and droplet count, written incrementally so a
+*       resumed run continues exactly where it stopped
+*
+* PUBLIC FUNCTIONS :
+*       void   checkpoint_changed( struct checkpoint_log* log )
+*       void   checkpoint_mark( struct checkpoint_log* log, int map_size,
+*                               int x, int y, int reach, int wrap )
+*       int    write_checkpoint( struct checkpoint_log* log,
+*                                const float* heightmap, int map_size,
+*                                const struct checkpoint_state* state,
+*                                char* filename )
+*       float* read_checkpoint( char* filename, int* map_size,
+*                               struct checkpoint_state* state )
+*       void   checkpoint_free( struct checkpoint_log* log )
+*
+* NOTES :
+*       The file is a header and an append only list of records. Each
+*       record holds the state and the CHECKPOINT_TILE tiles changed since
+*       the record before it, and ends with the crc32 of its payload. The
+*       first record holds every tile. A record cut off by a crash fails
+*       its crc and is ignored on read, so the run resumes from the
+*       record before it. Once the records add up to CHECKPOINT_COMPACT
+*       heightmaps the file is rewritten with a single full record, next
+*       to the old one and renamed over it.
+*       Records are little endian, the parameter structs are stored as
+*       they are in memory with their sizes, which must match on read.
+*H*/
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include "erosion.h"
+#include "heightmap_gen.h"
+
+#define CHECKPOINT_TILE    32
+#define CHECKPOINT_COMPACT 4
+
+/**
+ * @brief Everything besides the heightmap a resumed run needs
+ */
+struct checkpoint_state {
+  uint64_t rng;                 /* droplet_rand state */
+  int64_t drops;                /* droplets eroded so far */
+  struct erosion_param erode;
+  struct setting noise;
+};
+
+/**
+ * @brief Tiles changed since the last checkpoint written to filename
+ */
+struct checkpoint_log {
+  int map_size;
+  int tiles;                    /* tiles per side */
+  uint8_t* dirty;               /* one flag per tile */
+  int full;                     /* the next checkpoint writes every tile */
+  char* filename;               /* of the last checkpoint */
+};
+
+/**
+ * @brief Marks the whole heightmap changed, call when it is replaced or
+ * changed by anything but checkpoint_mark'ed droplets
+ */
+void checkpoint_changed( struct checkpoint_log* log );
+
+/**
+ * @brief Marks the tiles a droplet may change
+ *
+ * @param log       the log, zero initialized before the first use
+ * @param map_size  the heightmap size
+ * @param x         the droplet start column
+ * @param y         the droplet start row
+ * @param reach     the most cells from the start the droplet changes
+ * @param wrap      the droplet wraps around the map edges
+ */
+void checkpoint_mark( struct checkpoint_log* log, int map_size, int x, int y, int reach,
+                      int wrap );
+
+/**
+ * @brief Appends the changed tiles and @param state to the checkpoint
+ *
+ * Writes a new file when @param filename is not the file of the last
+ * checkpoint, the heightmap changed as a whole or the file needs
+ * compacting.
+ *
+ * @param log       the log of the changed tiles, cleared on success
+ * @param heightmap the heightmap
+ * @param map_size  the heightmap size
+ * @param state     the run state to store
+ * @param filename  the filename [include extension]
+ * @return          1 on success, 0 when the file could not be written
+ */
+int write_checkpoint( struct checkpoint_log* log, const float* heightmap, int map_size,
+                      const struct checkpoint_state* state, char* filename );
+
+/**
+ * @brief Reads the heightmap and state of the last complete record
+ *
+ * @param filename  the filename [include extension]
+ * @param map_size  set to the heightmap size
+ * @param state     set to the stored run state
+ * @return          the heightmap [free with free], NULL on failure
+ */
+float* read_checkpoint( char* filename, int* map_size, struct checkpoint_state* state );
+
+/**
+ * @brief Frees the log and zeroes it
+ */
+void checkpoint_free( struct checkpoint_log* log );
+
+#endif
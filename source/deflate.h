@@ -0,0 +1,106 @@
+/***********************************************************************
+* FILENAME :        deflate.h   deflate.c
+*
+* DESCRIPTION :
+*       Self contained deflate [RFC 1951] compressor and decompressor and
+*       the adler32 and crc32 checksums used by the zlib and png containers.
+*
+* PUBLIC FUNCTIONS :
+*       size_t   deflate_bound( size_t length )
+*       size_t   deflate_raw( const uint8_t* in, size_t length, int level,
+*                             int final, uint8_t* out )
+*       int      inflate_raw( inflate_input input, inflate_output output,
+*                             void* ctx )
+*       uint32_t deflate_adler32( uint32_t adler, const uint8_t* data,
+*                                 size_t length )
+*       uint32_t deflate_adler32_combine( uint32_t adler1, uint32_t adler2,
+*                                         size_t length2 )
+*       uint32_t deflate_crc32( uint32_t crc, const uint8_t* data,
+*                               size_t length )
+*
+* NOTES :
+*       Every call to deflate_raw is independent [no shared dictionary]
+*       and ends on a byte boundary, so separate pieces of a stream can be
+*       compressed on different threads and concatenated in order, in the
+*       same way as pigz.
+*H*/
+
+#ifndef DEFLATE_H_
+#define DEFLATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Upper bound of the compressed size of @param length bytes
+ */
+size_t deflate_bound( size_t length );
+
+/**
+ * @brief Compresses @param in into raw deflate blocks in @param out
+ *
+ * Compresses @param length bytes with LZ77 hash chains and dynamic
+ * huffman blocks, falling back to fixed or stored blocks when they are
+ * smaller. @param level 0 only stores, 1 is the fastest and 9 searches
+ * the longest chains. When @param final is set the last block is marked
+ * as the end of the stream, otherwise the output ends with an empty
+ * stored block [a sync flush] so another piece can follow it.
+ *
+ * @param in      the data to compress
+ * @param length  the number of bytes in @param in
+ * @param level   the compression level in [0, 9]
+ * @param final   whether this piece ends the deflate stream
+ * @param out     at least deflate_bound( @param length ) bytes
+ * @return        the number of bytes written to @param out
+ */
+size_t deflate_raw( const uint8_t* in, size_t length, int level, int final, uint8_t* out );
+
+/**
+ * @brief Supplies the next piece of compressed input
+ *
+ * Points @param data at the next bytes and returns their count, 0 at the
+ * end of the input. The bytes stay valid until the next call.
+ */
+typedef size_t (*inflate_input)( void* ctx, const uint8_t** data );
+
+/**
+ * @brief Receives the next piece of decompressed output
+ *
+ * @return 0 to stop decompressing, non zero to continue
+ */
+typedef int (*inflate_output)( void* ctx, const uint8_t* data, size_t length );
+
+/**
+ * @brief Decompresses a raw deflate stream
+ *
+ * Pulls compressed bytes from @param input and pushes the decompressed
+ * bytes to @param output in pieces of up to 128K, both are called with
+ * @param ctx. Stops at the final block; bytes the input supplied past
+ * it are not consumed by anything else.
+ *
+ * @return 1 when the stream was complete and valid, 0 on corrupt or
+ *         truncated data, allocation failure or a stop from the output
+ */
+int inflate_raw( inflate_input input, inflate_output output, void* ctx );
+
+/**
+ * @brief Updates the adler32 checksum @param adler [start with 1]
+ */
+uint32_t deflate_adler32( uint32_t adler, const uint8_t* data, size_t length );
+
+/**
+ * @brief Adler32 of two concatenated pieces from the adler32 of each
+ *
+ * @param adler1  the adler32 of the first piece
+ * @param adler2  the adler32 of the second piece
+ * @param length2 the length of the second piece
+ */
+uint32_t deflate_adler32_combine( uint32_t adler1, uint32_t adler2, size_t length2 );
+
+/**
+ * @brief Updates the crc32 checksum @param crc [start with 0], safe to
+ * call from any thread
+ */
+uint32_t deflate_crc32( uint32_t crc, const uint8_t* data, size_t length );
+
+#endif
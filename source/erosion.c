@@ -57,11 +57,12 @@ struct interp_result {
  * @param map_size    size of the heightheight_map
  * @param pos_x       x coordinate to sample
  * @param pos_y       y coordinate to sample
+ * @param wrap        if the right and bottom neighbours wrap around 
  * @param[out] result struct of type interp_result where the information is 
  *                    stored
  */
 void interpolate( float* height_map, int map_size, float pos_x, float pos_y, 
-                  struct interp_result* result ) {
+                  int wrap, struct interp_result* result ) {
     int coord_x = (int) pos_x;
     int coord_y = (int) pos_y;
 
@@ -70,11 +71,12 @@ void interpolate( float* height_map, int map_size, float pos_x, float pos_y,
     float y = pos_y - coord_y;
 
     // Calculate heights of the four nodes of the droplet's cell
-    int height_map_index = coord_y * map_size + coord_x;
-    float height_tl = height_map[height_map_index];
-    float height_tr = height_map[height_map_index + 1];
-    float height_bl = height_map[height_map_index + map_size];
-    float height_sr = height_map[height_map_index + map_size + 1];
+    int next_x = (wrap && coord_x == map_size - 1) ? 0 : coord_x + 1;
+    int next_y = (wrap && coord_y == map_size - 1) ? 0 : coord_y + 1;
+    float height_tl = height_map[coord_y * map_size + coord_x];
+    float height_tr = height_map[coord_y * map_size + next_x];
+    float height_bl = height_map[next_y * map_size + coord_x];
+    float height_sr = height_map[next_y * map_size + next_x];
 
     // Calculate droplet's direction of flow with bilinear interpolation of height difference along the edges
     float gradient_x = (height_tr - height_tl)   * (1 - y) 
@@ -107,6 +109,16 @@ float GRAVITY                   = 4;
 */
 
 
+/* wraps coordinate v into [0, size), v is at most one map off */
+float wrap_coord(float v, int size) {
+  if (v < 0)
+    v += size;
+  if (v >= size)   /* also catches -epsilon + size rounding up to size */
+    v -= size;
+  return v;
+}
+
+
 /* interal states for the weights matrix */
 float* weights;
 int    weights_radius;
@@ -161,21 +173,32 @@ void free_weights_matrix() {
 }
 
 
+uint32_t droplet_rand(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return (uint32_t) ((z ^ (z >> 31)) >> 32);
+}
+
+
 
 void erode( float* height_map, int map_size, struct droplet* drop, struct erosion_param* param ) {
   assert(height_map);
   assert(drop);
 
+  int wrap = param->WRAP_EDGES;
+
   for (int life = 0; life < param->DROPLET_LIFETIME; life++) {
     int node_x = (int) drop->pos_x;
     int node_y = (int) drop->pos_y;
-    int drop_index = node_y * map_size + node_x;
+    int next_x = (wrap && node_x == map_size - 1) ? 0 : node_x + 1;
+    int next_y = (wrap && node_y == map_size - 1) ? 0 : node_y + 1;
     // Calculate droplet's offset inside the cell (0,0) = at NW node, (1,1) = at SE node
     float cell_offset_x = drop->pos_x - node_x;
     float cell_offset_y = drop->pos_y - node_y;
 
     struct interp_result gradient = { 0 };
-    interpolate(height_map, map_size, drop->pos_x, drop->pos_y, &gradient);
+    interpolate(height_map, map_size, drop->pos_x, drop->pos_y, wrap, &gradient);
 
     drop->dir_x = (drop->dir_x * param->INERTA - gradient.gradient_x * (1 - param->INERTA));
     drop->dir_y = (drop->dir_y * param->INERTA - gradient.gradient_y * (1 - param->INERTA));
@@ -189,16 +212,22 @@ void erode( float* height_map, int map_size, struct droplet* drop, struct erosio
     drop->pos_x += drop->dir_x;
     drop->pos_y += drop->dir_y;
 
+    if (wrap) {
+      // Droplet flows over the edge onto the opposite side of the map
+      drop->pos_x = wrap_coord(drop->pos_x, map_size);
+      drop->pos_y = wrap_coord(drop->pos_y, map_size);
+    }
+
     // Stop simulating droplet if it's not moving or has flowed over edge of map
     if ((drop->dir_x == 0 && drop->dir_y == 0) || 
-        drop->pos_x < 0 || drop->pos_y >= map_size - 1 || 
-        drop->pos_y < 0 || drop->pos_y >= map_size - 1) {
+        (!wrap && (drop->pos_x < 0 || drop->pos_x >= map_size - 1 || 
+                   drop->pos_y < 0 || drop->pos_y >= map_size - 1))) {
         break;
     }
 
     // Find the droplet's new height and calculate the deltaHeight
     struct interp_result new_result = { 0 };
-    interpolate(height_map, map_size, drop->pos_x, drop->pos_y, &new_result);
+    interpolate(height_map, map_size, drop->pos_x, drop->pos_y, wrap, &new_result);
     float new_height = new_result.height;
     float delta_height = new_height - gradient.height;
 
@@ -220,10 +249,10 @@ void erode( float* height_map, int map_size, struct droplet* drop, struct erosio
 
       // Add the sediment to the four nodes of the current cell using bilinear interpolation
       // Deposition is not distributed over a radius (like erosion) so that it can fill small pits
-      height_map[drop_index] += amount_deposit * (1 - cell_offset_x) * (1 - cell_offset_y);
-      height_map[drop_index + 1] += amount_deposit * cell_offset_x * (1 - cell_offset_y);
-      height_map[drop_index + map_size] += amount_deposit * (1 - cell_offset_x) * cell_offset_y;
-      height_map[drop_index + map_size + 1] += amount_deposit * cell_offset_x * cell_offset_y;
+      height_map[node_y * map_size + node_x] += amount_deposit * (1 - cell_offset_x) * (1 - cell_offset_y);
+      height_map[node_y * map_size + next_x] += amount_deposit * cell_offset_x * (1 - cell_offset_y);
+      height_map[next_y * map_size + node_x] += amount_deposit * (1 - cell_offset_x) * cell_offset_y;
+      height_map[next_y * map_size + next_x] += amount_deposit * cell_offset_x * cell_offset_y;
     }
     else {
       // Erode a fraction of the droplet's current carry capacity.
@@ -241,6 +270,10 @@ void erode( float* height_map, int map_size, struct droplet* drop, struct erosio
           
           int map_coord_x = drop->pos_x + x;
           int map_coord_y = drop->pos_y + y;
+          if (wrap) {
+            map_coord_x = ((int) drop->pos_x + x + map_size) % map_size;
+            map_coord_y = ((int) drop->pos_y + y + map_size) % map_size;
+          }
           
           // check if coord is in heightmap
           if ((map_coord_x >= 0 && map_coord_x < map_size) && 
@@ -8,6 +8,7 @@
 *       void    erode( float* height_map, int map_size, struct droplet* drop )
 *       void    compute_weights_matrix( int radius )
 *       void    free_weights_matrix( void )
+*       uint32_t droplet_rand( uint64_t* state )
 *          
 * NOTES :
 *       Call create_brush before using erode with the same map_size
@@ -21,6 +22,8 @@
 #ifndef EROSION_H_
 #define EROSION_H_
 
+#include <stdint.h>
+
 struct droplet {
     float pos_x, pos_y;
     float dir_x, dir_y;
@@ -39,6 +42,7 @@ struct erosion_param {
   float ERODE_SPEED;
   float EVAPORATE_SPEED;
   float GRAVITY;
+  int   WRAP_EDGES;   /* treat the map as periodic, see below */
 };
 
 
@@ -59,6 +63,10 @@ struct erosion_param {
  * height_map is a buffer of size map_size^2
  * Erosion parameters and inital parameters for the simulation is in the 
  * source file.
+ * If param->WRAP_EDGES is set, droplets leaving one edge of the map enter
+ * on the opposite edge and the erosion brush wraps around, so a tileable
+ * heightmap stays seamless after erosion. Otherwise droplets stop at the 
+ * edge of the map.
  */ 
 void erode( float* height_map, int map_size, struct droplet* drop, struct erosion_param* param );
 
@@ -83,4 +91,16 @@ void compute_weights_matrix( int radius );
  */
 void free_weights_matrix( void );
 
+
+/**
+ * @brief Next random number for droplet positions
+ *
+ * Unlike rand() the whole generator state is @param state, so it can be
+ * seeded, saved and restored with a checkpoint [splitmix64].
+ *
+ * @param state any value, advanced by each call
+ * @return      32 random bits
+ */
+uint32_t droplet_rand( uint64_t* state );
+
 #endif
\ No newline at end of file
@@ -2,8 +2,8 @@
 * FILENAME :        export.h   export.c
 *
 * DESCRIPTION :
-*       Utility Functions for exporting heightmap as .obj files
-*       or png heightmaps
+*       Utility Functions for exporting heightmap as .obj files,
+*       binary .stl meshes, indexed .glb and .ply meshes or png heightmaps
 *
 * PUBLIC FUNCTIONS :
 *       
@@ -14,6 +14,14 @@
 *       the js module: example code snippet
 *       https://motley-coder.com/2019/04/01/download-files-emscripten/
 *
+*       Every binary stl record is 50 bytes at a fixed offset, so the stl
+*       body is generated into one buffer by row bands in parallel and
+*       written with a single fwrite.
+*
+*       read_map and write_map exchange heightmaps with the python helpers
+*       as .npy version 1.0 files: a short dict header padded to 64 bytes
+*       followed by the float32 heights exactly as they are in memory.
+*
 * AUTHOR :    Henry Jiang         DATE :    Feb 06, 2021
 *H*/
 
@@ -24,40 +32,86 @@
 #include <string.h>
 #include <math.h>
 #include <stdint.h>
-#include <assert.h>
 
-// Uncompressed PNG Library
-#include "svpng.c"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Compressed PNG encoder
+#include "png.h"
+#include "rtin.h"
+#include "resample.h"
 
 #define EXPORT_MSG "# Exported from Hydraulic Erosion https://github.com/mustartt/hydraulic-erosion"
 
-float* read_map(char* filename, int size) {
-  FILE* file = fopen(filename, "r");
+#define NPY_MAGIC       "\x93NUMPY"
+#define NPY_MAGIC_SIZE  6
+#define NPY_ALIGN       64      /* header padding of numpy 1.0 files */
 
-  float* height_map = (float*) malloc(size * size * sizeof(float));
-  for (int y = 0; y < size; y++) {
-    for (int x = 0; x < size; x++) {
-      int val;
-      fscanf(file, "%d", &val);
-      height_map[x * size + y] = (float) val / 255.0f;
-    }
+float* read_map(char* filename, int* size) {
+  FILE* file = fopen(filename, "rb");
+
+  if (file == NULL)
+    return NULL;
+
+  // magic, version 1.0, little endian header length, python dict header
+  uint8_t head[10];
+  char header[4096];
+  int rows = 0, cols = 0;
+  if (fread(head, 1, 10, file) != 10 || memcmp(head, NPY_MAGIC, NPY_MAGIC_SIZE) != 0
+      || head[6] != 1) {
+    fclose(file);
+    return NULL;
+  }
+  size_t header_len = head[8] | head[9] << 8;
+  if (header_len >= sizeof(header) || fread(header, 1, header_len, file) != header_len) {
+    fclose(file);
+    return NULL;
+  }
+  header[header_len] = '\0';
+
+  const char* shape = strstr(header, "'shape':");
+  if (strstr(header, "'descr': '<f4'") == NULL
+      || strstr(header, "'fortran_order': False") == NULL || shape == NULL
+      || sscanf(shape, "'shape': (%d, %d)", &rows, &cols) != 2
+      || rows != cols || rows <= 0) {
+    fclose(file);
+    return NULL;
+  }
+
+  size_t count = (size_t) rows * cols;
+  float* height_map = (float*) malloc(count * sizeof(float));
+  if (height_map == NULL || fread(height_map, sizeof(float), count, file) != count) {
+    free(height_map);
+    fclose(file);
+    return NULL;
   }
 
   fclose(file);
+  *size = rows;
   return height_map;
 }
 
 void write_map(float* height_map, int size, char* filename) {
-  FILE* file = fopen(filename, "w");
+  FILE* file = fopen(filename, "wb");
 
-  for (int y = 0; y < size; y++) {
-    for (int x = 0; x < size; x++) {
-      int val = (int) (height_map[x * size + y] * 255);
-      fprintf(file, "%d ", val);
-    }
-    fprintf(file, "\n");
-  }
+  if (file == NULL)
+    return;
+
+  // the dict is padded with spaces so the data starts 64 byte aligned
+  char header[128];
+  int len = sprintf(header, "{'descr': '<f4', 'fortran_order': False, 'shape': (%d, %d), }",
+                    size, size);
+  int total = (10 + len + 1 + NPY_ALIGN - 1) / NPY_ALIGN * NPY_ALIGN;
+  memset(header + len, ' ', total - 10 - len - 1);
+  header[total - 11] = '\n';
 
+  uint8_t head[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0 };
+  head[8] = (uint8_t) (total - 10);
+  head[9] = (uint8_t) ((total - 10) >> 8);
+  fwrite(head, 1, 10, file);
+  fwrite(header, 1, total - 10, file);
+  fwrite(height_map, sizeof(float), (size_t) size * size, file);
   fclose(file);
 }
 
@@ -68,47 +122,392 @@ int calc_vertex_index(int x, int z, int size) {
 }
 
 
+/* ========================= text formatting ========================= */
+
+static const char digit_pairs[] = 
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static const double powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14
+};
+
+// writes the decimal digits of val to p, returns the end of the digits
+static char* write_uint(char* p, uint64_t val) {
+  char tmp[20];
+  char* end = tmp + sizeof(tmp);
+  char* q = end;
+
+  // two digits at a time
+  while (val >= 100) {
+    int pair = (int) (val % 100) * 2;
+    val /= 100;
+    *--q = digit_pairs[pair + 1];
+    *--q = digit_pairs[pair];
+  }
+  if (val >= 10) {
+    *--q = digit_pairs[val * 2 + 1];
+    *--q = digit_pairs[val * 2];
+  }
+  else {
+    *--q = (char) ('0' + val);
+  }
+
+  memcpy(p, q, end - q);
+  return p + (end - q);
+}
+
+// candidate = mant * 10^-shift parses back to val under round to nearest
+// lo and hi are the midpoints to the neighbouring floats, which are exact
+// in double, so a strict check is safe against double rounding
+static int round_trips(double candidate, double lo, double hi) {
+  return lo < candidate && candidate < hi;
+}
+
+// scales positive val to a digits long integer mantissa, see write_float
+static uint64_t float_mantissa(double val, int shift) {
+  double scaled = shift >= 0 ? val * powers_of_ten[shift] : val / powers_of_ten[-shift];
+  return (uint64_t) (scaled + 0.5);
+}
+
+static double mantissa_value(uint64_t mant, int shift) {
+  return shift >= 0 ? mant / powers_of_ten[shift] : mant * powers_of_ten[-shift];
+}
+
+// writes val with the fewest significant digits that parse back to val
+// returns the end of the written text
+static char* write_float(char* p, float val) {
+  if (val == 0) {
+    *p++ = '0';
+    return p;
+  }
+  if (val < 0) {
+    *p++ = '-';
+    val = -val;
+  }
+  if (!(val >= 1e-4f && val < 1e7f)) {
+    // outside the fixed notation range, or nan and inf
+    return p + sprintf(p, "%.9g", val);
+  }
+
+  double lo = ((double) val + nextafterf(val, 0)) / 2;
+  double hi = ((double) val + nextafterf(val, INFINITY)) / 2;
+  int exp10 = (int) floor(log10(val));
+
+  // round tripping is monotonic in the digit count, 9 digits always do
+  int min_digits = 1, max_digits = 9;
+  while (min_digits < max_digits) {
+    int digits = (min_digits + max_digits) / 2;
+    int shift = digits - 1 - exp10;
+    if (round_trips(mantissa_value(float_mantissa(val, shift), shift), lo, hi))
+      max_digits = digits;
+    else
+      min_digits = digits + 1;
+  }
+
+  int shift = min_digits - 1 - exp10;
+  uint64_t mant = float_mantissa(val, shift);
+  if (!round_trips(mantissa_value(mant, shift), lo, hi)) {
+    // exact tie, leave the rounding to printf
+    return p + sprintf(p, "%.9g", val);
+  }
+
+  // drop trailing zeros of the fraction
+  while (shift > 0 && mant % 10 == 0) {
+    mant /= 10;
+    shift--;
+  }
+
+  if (shift <= 0) {
+    p = write_uint(p, mant);
+    for (int i = 0; i < -shift; i++)
+      *p++ = '0';
+    return p;
+  }
+
+  char digits[20];
+  int len = write_uint(digits, mant) - digits;
+  if (len <= shift) {
+    // 0.000ddd
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = 0; i < shift - len; i++)
+      *p++ = '0';
+    memcpy(p, digits, len);
+    return p + len;
+  }
+  // ddd.ddd
+  memcpy(p, digits, len - shift);
+  p += len - shift;
+  *p++ = '.';
+  memcpy(p, digits + len - shift, shift);
+  return p + shift;
+}
+
+
+/* ======================= buffered obj writer ======================= */
+
+#define OBJ_MAX_VERTEX_LINE 64      /* "v " + 3 floats of at most 16 chars */
+#define OBJ_MAX_FACE_LINE   40      /* "f " + 3 ints of at most 10 digits */
+#define OBJ_CHUNK_BYTES     (1 << 20)
+
+struct obj_job {
+  float* heightmap;
+  int    export_size;
+  char*  coords;         /* formatted x / export_size, OBJ_COORD_LEN each */
+  int*   coord_len;
+};
+
+#define OBJ_COORD_LEN 16
+
+/* formats rows [begin, end) of job into buf, returns the byte count */
+typedef size_t (*obj_formatter)(void* job, int begin, int end, char* buf);
+
+// formats vertex rows [begin, end) into buf, returns the byte count
+static size_t format_vertex_rows(void* data, int begin, int end, char* buf) {
+  struct obj_job* job = data;
+  char* p = buf;
+  for (int x = begin; x < end; x++) {
+    const char* coord_x = job->coords + x * OBJ_COORD_LEN;
+    int len_x = job->coord_len[x];
+    float* row = job->heightmap + (size_t) x * job->export_size;
+
+    for (int z = 0; z < job->export_size; z++) {
+      // format is "v coord_x coord_y coord_z"
+      *p++ = 'v';
+      *p++ = ' ';
+      memcpy(p, coord_x, len_x);
+      p += len_x;
+      *p++ = ' ';
+      p = write_float(p, row[z]);
+      *p++ = ' ';
+      memcpy(p, job->coords + z * OBJ_COORD_LEN, job->coord_len[z]);
+      p += job->coord_len[z];
+      *p++ = '\n';
+    }
+  }
+  return p - buf;
+}
+
+// formats the faces of quad rows [begin, end) into buf, returns the byte count
+static size_t format_face_rows(void* data, int begin, int end, char* buf) {
+  struct obj_job* job = data;
+  char* p = buf;
+  for (int x = begin; x < end; x++) {
+    for (int z = 0; z < job->export_size - 1; z++) {
+      int top_left  = calc_vertex_index(x,     z,     job->export_size);
+      int top_right = calc_vertex_index(x + 1, z,     job->export_size);
+      int bot_left  = calc_vertex_index(x,     z + 1, job->export_size);
+      int bot_right = calc_vertex_index(x + 1, z + 1, job->export_size);
+
+      // face1: (x, z)      (x + 1, z)  (x, z + 1)
+      *p++ = 'f'; *p++ = ' ';
+      p = write_uint(p, top_left);  *p++ = ' ';
+      p = write_uint(p, top_right); *p++ = ' ';
+      p = write_uint(p, bot_left);  *p++ = '\n';
+      // face2: (x + 1, z)  (x + 1, z + 1)  (x, z + 1)
+      *p++ = 'f'; *p++ = ' ';
+      p = write_uint(p, top_right); *p++ = ' ';
+      p = write_uint(p, bot_right); *p++ = ' ';
+      p = write_uint(p, bot_left);  *p++ = '\n';
+    }
+  }
+  return p - buf;
+}
+
+// closes the file and removes it unless everything was written, a
+// truncated file would pass for a complete one
+static void close_obj(FILE* fp, int written, const char* filename) {
+  written = written && !ferror(fp);
+  if (fclose(fp) != 0 || !written)
+    remove(filename);
+}
+
+// formats rows [0, rows) in chunks of chunk_rows in parallel and writes
+// the chunks in order with one fwrite per chunk, returns 0 when out of 
+// memory
+static int write_obj_rows(FILE* fp, obj_formatter format, void* job, int rows, 
+                          int chunk_rows, size_t chunk_bytes) {
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  char* buffers = malloc(threads * chunk_bytes);
+  size_t* lengths = malloc(threads * sizeof(size_t));
+  if (buffers == NULL || lengths == NULL) {
+    free(buffers);
+    free(lengths);
+    return 0;
+  }
+
+  int chunks = (rows + chunk_rows - 1) / chunk_rows;
+  for (int first = 0; first < chunks; first += threads) {
+    int count = chunks - first < threads ? chunks - first : threads;
+
+    #pragma omp parallel for schedule(static, 1)
+    for (int c = 0; c < count; c++) {
+      int begin = (first + c) * chunk_rows;
+      int end = begin + chunk_rows < rows ? begin + chunk_rows : rows;
+      char* buf = buffers + c * chunk_bytes;
+      lengths[c] = format(job, begin, end, buf);
+    }
+
+    for (int c = 0; c < count; c++) {
+      fwrite(buffers + c * chunk_bytes, 1, lengths[c], fp);
+    }
+  }
+
+  free(buffers);
+  free(lengths);
+  return 1;
+}
+
+
 void export_obj(float* heightmap, int map_size, int export_size, char* filename) {
-  assert(export_size <= map_size);            /* export_size less than map_size */
-  assert(map_size % export_size == 0);        /* must be integer multiple */ 
-  int export_scale = map_size / export_size; 
+  // other sizes are area filtered instead of picking every k-th height
+  float* resampled = NULL;
+  if (export_size != map_size) {
+    resampled = resample(heightmap, map_size, export_size, RESAMPLE_BOX);
+    heightmap = resampled;
+  }
+
+  char* coords = malloc(export_size * OBJ_COORD_LEN);
+  int* coord_len = malloc(export_size * sizeof(int));
+  FILE* fp = NULL;
+  if (coords != NULL && coord_len != NULL && heightmap != NULL)
+    fp = fopen(filename, "w");
+
+  if (fp == NULL) {
+    free(coords);
+    free(coord_len);
+    free(resampled);
+    return;
+  }
+
+  // x and z coordinates repeat every row, format them once
+  for (int i = 0; i < export_size; i++) {
+    char* end = write_float(coords + i * OBJ_COORD_LEN, (float) i / export_size);
+    coord_len[i] = end - (coords + i * OBJ_COORD_LEN);
+  }
 
-  FILE* fp = fopen(filename, "w");
-  fprintf(fp, EXPORT_MSG);
+  struct obj_job job = {
+    .heightmap = heightmap,
+    .export_size = export_size,
+    .coords = coords,
+    .coord_len = coord_len
+  };
+
+  // rows per chunk so that a chunk is about OBJ_CHUNK_BYTES
+  int vertex_rows = OBJ_CHUNK_BYTES / (export_size * OBJ_MAX_VERTEX_LINE) + 1;
+  int face_rows = OBJ_CHUNK_BYTES / (export_size * 2 * OBJ_MAX_FACE_LINE) + 1;
+
+  fprintf(fp, EXPORT_MSG "\n");
   fprintf(fp, "# List of geometric vertices coordinate (x, y, z)\n");
+  int written = write_obj_rows(fp, format_vertex_rows, &job, export_size, vertex_rows, 
+                               (size_t) vertex_rows * export_size * OBJ_MAX_VERTEX_LINE);
 
-  // format is "v coord_x, coord_y, coord_z"
-  for (int x = 0; x < export_size; x++) {
-    for (int z = 0; z < export_size; z++) {
-      int map_index = (x * export_scale) * map_size + (z * export_scale);
-      float coord_y = heightmap[map_index];
-
-      float coord_x = (float) x / export_size;
-      float coord_z = (float) z / export_size;
-      
-      // write rows
-      fprintf(fp, "v %f %f %f\n", coord_x, coord_y, coord_z);
-    }
+  if (written) {
+    fprintf(fp, "# List of faces: f (v1 index, v2 index, v3 index) \n");
+    written = write_obj_rows(fp, format_face_rows, &job, export_size - 1, face_rows, 
+                             (size_t) face_rows * export_size * 2 * OBJ_MAX_FACE_LINE);
   }
-  
-  fprintf(fp, "# List of faces: f (v1 index, v2 index, v3 index) \n");
-
-  // write face vertex indicies
-  // face1: (x, z)      (x + 1, z)  (x, z + 1)
-  // face2: (x + 1, z)  (x, z + 1)  (x + 1, z + 1)
-  for (int x = 0; x < export_size - 1; x++) {
-    for (int z = 0; z < export_size - 1; z++) {
-      int top_left  = calc_vertex_index(x,     z,     export_size);
-      int top_right = calc_vertex_index(x + 1, z,     export_size);
-      int bot_left  = calc_vertex_index(x,     z + 1, export_size);
-      int bot_right = calc_vertex_index(x + 1, z + 1, export_size);
-      
-      fprintf(fp, "f %d %d %d\n", top_left,  top_right, bot_left);
-      fprintf(fp, "f %d %d %d\n", top_right, bot_right, bot_left);
+
+  free(coords);
+  free(coord_len);
+  free(resampled);
+  close_obj(fp, written, filename);
+}
+
+
+#define MESH_CHUNK_ITEMS 16384      /* vertices or faces formatted per chunk */
+
+struct mesh_job {
+  struct rtin_mesh* mesh;
+  const float* heights;  /* grid_size^2 heights of the mesh grid */
+  char* coords;          /* formatted x / (grid_size - 1), OBJ_COORD_LEN each */
+  int*  coord_len;
+};
+
+// formats mesh vertices [begin, end) into buf, returns the byte count
+static size_t format_mesh_vertices(void* data, int begin, int end, char* buf) {
+  struct mesh_job* job = data;
+  int size = job->mesh->grid_size;
+  char* p = buf;
+  for (int i = begin; i < end; i++) {
+    uint32_t x = job->mesh->vertices[2 * i];
+    uint32_t z = job->mesh->vertices[2 * i + 1];
+    *p++ = 'v';
+    *p++ = ' ';
+    memcpy(p, job->coords + x * OBJ_COORD_LEN, job->coord_len[x]);
+    p += job->coord_len[x];
+    *p++ = ' ';
+    p = write_float(p, job->heights[(size_t) z * size + x]);
+    *p++ = ' ';
+    memcpy(p, job->coords + z * OBJ_COORD_LEN, job->coord_len[z]);
+    p += job->coord_len[z];
+    *p++ = '\n';
+  }
+  return p - buf;
+}
+
+// formats mesh triangles [begin, end) into buf, returns the byte count
+static size_t format_mesh_faces(void* data, int begin, int end, char* buf) {
+  struct mesh_job* job = data;
+  char* p = buf;
+  for (int i = begin; i < end; i++) {
+    const uint32_t* t = job->mesh->triangles + 3 * (size_t) i;
+    *p++ = 'f'; *p++ = ' ';
+    p = write_uint(p, t[0] + 1); *p++ = ' ';
+    p = write_uint(p, t[1] + 1); *p++ = ' ';
+    p = write_uint(p, t[2] + 1); *p++ = '\n';
+  }
+  return p - buf;
+}
+
+void export_obj_adaptive(float* heightmap, int map_size, float max_error, char* filename) {
+  struct rtin rtin;
+  struct rtin_mesh mesh;
+  if (!rtin_init(&rtin, heightmap, map_size))
+    return;
+  if (!rtin_mesh(&rtin, max_error, &mesh)) {
+    rtin_free(&rtin);
+    return;
+  }
+
+  int size = rtin.grid_size;
+  char* coords = malloc(size * OBJ_COORD_LEN);
+  int* coord_len = malloc(size * sizeof(int));
+  FILE* fp = NULL;
+  if (coords != NULL && coord_len != NULL)
+    fp = fopen(filename, "w");
+
+  if (fp != NULL) {
+    for (int i = 0; i < size; i++) {
+      char* end = write_float(coords + i * OBJ_COORD_LEN, (float) i / (size - 1));
+      coord_len[i] = end - (coords + i * OBJ_COORD_LEN);
     }
+
+    struct mesh_job job = { &mesh, rtin.heights, coords, coord_len };
+
+    fprintf(fp, EXPORT_MSG "\n");
+    fprintf(fp, "# Adaptive mesh, max error %g, %d vertices, %d faces\n", 
+            max_error, mesh.vertex_count, mesh.triangle_count);
+    fprintf(fp, "# List of geometric vertices coordinate (x, y, z)\n");
+    int written = write_obj_rows(fp, format_mesh_vertices, &job, mesh.vertex_count,
+                                 MESH_CHUNK_ITEMS, (size_t) MESH_CHUNK_ITEMS * OBJ_MAX_VERTEX_LINE);
+    if (written) {
+      fprintf(fp, "# List of faces: f (v1 index, v2 index, v3 index) \n");
+      written = write_obj_rows(fp, format_mesh_faces, &job, mesh.triangle_count,
+                               MESH_CHUNK_ITEMS, (size_t) MESH_CHUNK_ITEMS * OBJ_MAX_FACE_LINE);
+    }
+    close_obj(fp, written, filename);
   }
 
-  fclose(fp);
+  free(coords);
+  free(coord_len);
+  rtin_mesh_free(&mesh);
+  rtin_free(&rtin);
 }
 
 
@@ -120,31 +519,87 @@ float clamp(float val, float min, float max) {
 
 
 void export_png(float* heightmap, int map_size, char* filename) {
-  // create temporary buffer
-  unsigned char* rgb_buffer = malloc(map_size * map_size * 3 * sizeof(char));
-  unsigned char* ptr = rgb_buffer;
+  export_png_level(heightmap, map_size, PNG_DEFAULT_LEVEL, filename);
+}
 
-  FILE* fp = fopen(filename, "wb");
-  
-  if (rgb_buffer == NULL || fp == NULL)
-    return;
-  
-  // encode heightmap to color data
-  unsigned int x, y;
-  for (y = 0; y < map_size; y++) {
-    for (x = 0; x < map_size; x++) {
-      float val = clamp(heightmap[y * map_size + x], 0, 1);    /* in [0, 1] */
+/* 8 bit gray as rgb pixels of heightmap rows [y0, y0 + rows) */
+static void encode_rgb_rows(const float* heightmap, int map_size, int y0, int rows,
+                            unsigned char* out) {
+  for (int y = y0; y < y0 + rows; y++) {
+    for (int x = 0; x < map_size; x++) {
+      float val = clamp(heightmap[(size_t) y * map_size + x], 0, 1);    /* in [0, 1] */
       unsigned char pixel_val = (unsigned char) (val * 255);
       // set channel colors
-      *ptr++ = pixel_val;         /* R */
-      *ptr++ = pixel_val;         /* G */
-      *ptr++ = pixel_val;         /* B */
+      *out++ = pixel_val;         /* R */
+      *out++ = pixel_val;         /* G */
+      *out++ = pixel_val;         /* B */
     }
   }
+}
 
-  svpng(fp, map_size, map_size, rgb_buffer, 0);
-  free(rgb_buffer);
-  fclose(fp);
+/* one big endian 16 bit sample per height of rows [y0, y0 + rows) */
+static void encode_gray16_rows(const float* heightmap, int map_size, int y0, int rows,
+                               unsigned char* out) {
+  for (int y = y0; y < y0 + rows; y++) {
+    for (int x = 0; x < map_size; x++) {
+      float val = clamp(heightmap[(size_t) y * map_size + x], 0, 1);    /* in [0, 1] */
+      uint16_t sample = (uint16_t) (val * 65535 + 0.5f);
+      *out++ = sample >> 8;
+      *out++ = sample & 0xFF;
+    }
+  }
+}
+
+void export_png_level(float* heightmap, int map_size, int level, char* filename) {
+  FILE* fp = fopen(filename, "wb");
+
+  if (fp == NULL)
+    return;
+
+  // rows are encoded one at a time and streamed to the encoder
+  struct png_writer png;
+  unsigned char* rgb_row = malloc(map_size * 3 * sizeof(char));
+
+  if (rgb_row == NULL || !png_write_begin(&png, fp, map_size, map_size, 3, 8, level)) {
+    free(rgb_row);
+    close_obj(fp, 0, filename);
+    return;
+  }
+
+  // encode heightmap to color data
+  for (int y = 0; y < map_size; y++) {
+    encode_rgb_rows(heightmap, map_size, y, 1, rgb_row);
+    png_write_rows(&png, rgb_row, 1);
+  }
+
+  int written = png_write_end(&png);
+  free(rgb_row);
+  close_obj(fp, written, filename);
+}
+
+void export_png16(float* heightmap, int map_size, int level, char* filename) {
+  FILE* fp = fopen(filename, "wb");
+
+  if (fp == NULL)
+    return;
+
+  struct png_writer png;
+  unsigned char* gray_row = malloc(map_size * 2 * sizeof(char));
+
+  if (gray_row == NULL || !png_write_begin(&png, fp, map_size, map_size, 1, 16, level)) {
+    free(gray_row);
+    close_obj(fp, 0, filename);
+    return;
+  }
+
+  for (int y = 0; y < map_size; y++) {
+    encode_gray16_rows(heightmap, map_size, y, 1, gray_row);
+    png_write_rows(&png, gray_row, 1);
+  }
+
+  int written = png_write_end(&png);
+  free(gray_row);
+  close_obj(fp, written, filename);
 }
 
 typedef struct {
@@ -172,8 +627,70 @@ void print_vec(vec3 vec) {
   printf("vec: %f %f %f\n", vec.x, vec.y, vec.z);
 }
 
-void write_vec(vec3* vec, FILE* fp) {
-  fwrite(vec, sizeof(vec3), 1, fp);
+/* x / (map_size - 1) for every column */
+static float* grid_coords(int map_size) {
+  float* coords = malloc(map_size * sizeof(float));
+  if (coords == NULL)
+    return NULL;
+  for (int i = 0; i < map_size; i++) {
+    coords[i] = (float) i / (map_size - 1);
+  }
+  return coords;
+}
+
+#define STL_HEADER_SIZE 84      /* 80 byte header and uint32 face count */
+#define STL_RECORD_SIZE 50      /* normal, 3 vertices and uint16 attribute */
+
+/* copies vec into an stl record, returns the end of the copied bytes */
+static unsigned char* put_vec(unsigned char* rec, vec3* vec) {
+  memcpy(rec, vec, sizeof(vec3));
+  return rec + sizeof(vec3);
+}
+
+/* writes the two triangles of quad row z into rec */
+static void write_stl_row(unsigned char* rec, float* heightmap, int map_size, 
+                          float* coords, int z) {
+  // v1 is top-left, v2 is top-right, v3 is bottom-right, v4 is bottom-left
+  for (int x = 0; x < map_size - 1; x++) {
+    // sample height map
+    float sample1 = heightmap[z * map_size + x];
+    float sample2 = heightmap[z * map_size + (x + 1)];
+    float sample3 = heightmap[(z + 1) * map_size + (x + 1)];
+    float sample4 = heightmap[(z + 1) * map_size + x];
+
+    vec3 v1 = { coords[x],     sample1, coords[z]     };
+    vec3 v2 = { coords[x + 1], sample2, coords[z]     };
+    vec3 v3 = { coords[x + 1], sample3, coords[z + 1] };
+    vec3 v4 = { coords[x],     sample4, coords[z + 1] };
+
+    // triangle 1 -> 124
+    vec3 edge21, edge41, normal1;
+    subtract(&v2, &v1, &edge21);
+    subtract(&v4, &v1, &edge41);
+    cross_product(&edge41, &edge21, &normal1);
+
+    // triangel 2 -> 234
+    vec3 edge23, edge43, normal2; 
+    subtract(&v2, &v3, &edge23);
+    subtract(&v4, &v3, &edge43);
+    cross_product(&edge23, &edge43, &normal2);
+
+    // normal1, v1 v2 v4 and uint16_t attribute byte of 0
+    rec = put_vec(rec, &normal1);
+    rec = put_vec(rec, &v1);
+    rec = put_vec(rec, &v2);
+    rec = put_vec(rec, &v4);
+    *rec++ = 0;
+    *rec++ = 0;
+
+    // normal2, v2 v3 v4 and uint16_t attribute byte of 0
+    rec = put_vec(rec, &normal2);
+    rec = put_vec(rec, &v2);
+    rec = put_vec(rec, &v3);
+    rec = put_vec(rec, &v4);
+    *rec++ = 0;
+    *rec++ = 0;
+  }
 }
 
 void export_stl(float* heightmap, int map_size, char* filename) {
@@ -182,59 +699,466 @@ void export_stl(float* heightmap, int map_size, char* filename) {
   if (fp == NULL)
     return;
 
+  int rows = map_size - 1;
+  size_t row_bytes = (size_t) 2 * rows * STL_RECORD_SIZE;
+
+  // every record has a fixed offset, so the whole body is generated into
+  // one buffer, or into as large bands of rows as memory allows
+  int band_rows = rows;
+  unsigned char* buffer = malloc(STL_HEADER_SIZE + band_rows * row_bytes);
+  while (buffer == NULL && band_rows > 1) {
+    band_rows /= 2;
+    buffer = malloc(STL_HEADER_SIZE + band_rows * row_bytes);
+  }
+
+  // vertex coordinates repeat every row
+  float* coords = grid_coords(map_size);
+  if (buffer == NULL || coords == NULL) {
+    free(buffer);
+    free(coords);
+    fclose(fp);
+    return;
+  }
+
   // Header
   uint8_t  header[80] = EXPORT_MSG;
-  uint32_t face_count = 2 * (map_size - 1) * (map_size - 1);
-  uint16_t attr_buffer[1] = { 0 };
+  uint32_t face_count = 2 * rows * rows;
+  memcpy(buffer, header, 80);
+  memcpy(buffer + 80, &face_count, sizeof(uint32_t));
+  size_t header_bytes = STL_HEADER_SIZE;
 
-  fwrite(header, sizeof(uint8_t), 80, fp);
-  fwrite(&face_count, sizeof(uint32_t), 1, fp); 
+  for (int band = 0; band < rows; band += band_rows) {
+    int count = rows - band < band_rows ? rows - band : band_rows;
+    unsigned char* body = buffer + header_bytes;
 
-  // v1 is top-left, v2 is top-right, v3 is bottom-right, v4 is bottom-left
-  for (int z = 0; z < map_size - 1; z++) {
-    for (int x = 0; x < map_size - 1; x++) {
-      // sample height map
-      float sample1 = heightmap[z * map_size + x];
-      float sample2 = heightmap[z * map_size + (x + 1)];
-      float sample3 = heightmap[(z + 1) * map_size + (x + 1)];
-      float sample4  = heightmap[(z + 1) * map_size + x];
-
-      vec3 v1 = { (float) x / (map_size - 1),       sample1, (float) z / (map_size - 1)};
-      vec3 v2 = { (float) (x + 1) / (map_size - 1), sample2, (float) z / (map_size - 1)};
-      vec3 v3 = { (float) (x + 1) / (map_size - 1), sample3, (float) (z + 1) / (map_size - 1)};
-      vec3 v4 = { (float) x / (map_size - 1),       sample4, (float) (z + 1) / (map_size - 1)};
-      
-      // triangle 1 -> 124
-      vec3 edge21, edge41, normal1;
-      subtract(&v2, &v1, &edge21);
-      subtract(&v4, &v1, &edge41);
-      cross_product(&edge41, &edge21, &normal1);
-
-      // triangel 2 -> 234
-      vec3 edge23, edge43, normal2; 
-      subtract(&v2, &v3, &edge23);
-      subtract(&v4, &v3, &edge43);
-      cross_product(&edge23, &edge43, &normal2);
-      
-      // write normal1
-      write_vec(&normal1, fp);
-      // write v1 v2 v4
-      write_vec(&v1, fp);
-      write_vec(&v2, fp);
-      write_vec(&v4, fp);
-      // write uint16_t attribute byte of 0
-      fwrite(attr_buffer, sizeof(uint16_t), 1, fp);
-
-      // write normal2
-      write_vec(&normal2, fp);
-      // write v2 v3 v4
-      write_vec(&v2, fp);
-      write_vec(&v3, fp);
-      write_vec(&v4, fp);
-      // write uint16_t attribute byte of 0
-      fwrite(attr_buffer, sizeof(uint16_t), 1, fp);
+    #pragma omp parallel for schedule(static)
+    for (int z = band; z < band + count; z++) {
+      write_stl_row(body + (z - band) * row_bytes, heightmap, map_size, coords, z);
     }
+
+    fwrite(buffer, 1, header_bytes + count * row_bytes, fp);
+    header_bytes = 0; /* only the first write contains the header */
   }
 
+  free(coords);
+  free(buffer);
   fclose(fp);
 }
+
+
+/* position of grid vertex (x, z) in the [1, 1, 1] mesh */
+static void grid_position(float* heightmap, int map_size, float* coords, 
+                          int x, int z, float* position) {
+  position[0] = coords[x];
+  position[1] = heightmap[z * map_size + x];
+  position[2] = coords[z];
+}
+
+/* unit normal of grid vertex (x, z) by central differences */
+static void grid_normal(float* heightmap, int map_size, int x, int z, float* normal) {
+  int x0 = x > 0 ? x - 1 : x;
+  int x1 = x < map_size - 1 ? x + 1 : x;
+  int z0 = z > 0 ? z - 1 : z;
+  int z1 = z < map_size - 1 ? z + 1 : z;
+
+  float dhdx = (heightmap[z * map_size + x1] - heightmap[z * map_size + x0]) 
+               * (map_size - 1) / (x1 - x0);
+  float dhdz = (heightmap[z1 * map_size + x] - heightmap[z0 * map_size + x]) 
+               * (map_size - 1) / (z1 - z0);
+  float inv_len = 1.0f / sqrtf(dhdx * dhdx + 1.0f + dhdz * dhdz);
+
+  normal[0] = -dhdx * inv_len;
+  normal[1] = inv_len;
+  normal[2] = -dhdz * inv_len;
+}
+
+/* the two counter clockwise [seen from above] triangles of quad (x, z) */
+static void grid_quad(int map_size, int x, int z, uint32_t* indices) {
+  uint32_t top_left  = z * map_size + x;
+  uint32_t top_right = top_left + 1;
+  uint32_t bot_left  = top_left + map_size;
+  uint32_t bot_right = bot_left + 1;
+
+  indices[0] = top_left;
+  indices[1] = bot_left;
+  indices[2] = top_right;
+  indices[3] = top_right;
+  indices[4] = bot_left;
+  indices[5] = bot_right;
+}
+
+
+#define GLB_MAGIC       0x46546C67  /* "glTF" */
+#define GLB_CHUNK_JSON  0x4E4F534A  /* "JSON" */
+#define GLB_CHUNK_BIN   0x004E4942  /* "BIN\0" */
+#define GLB_JSON_MAX    2048
+
+/* appends a bufferView and its accessor to the json arrays */
+static void glb_view(char* views, char* accessors, int index, size_t offset, 
+                     size_t length, int target, int component, size_t count, 
+                     const char* type, const char* bounds) {
+  sprintf(views + strlen(views), 
+          "%s{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":%d}",
+          index ? "," : "", offset, length, target);
+  sprintf(accessors + strlen(accessors), 
+          "%s{\"bufferView\":%d,\"componentType\":%d,\"count\":%zu,\"type\":\"%s\"%s}",
+          index ? "," : "", index, component, count, type, bounds);
+}
+
+void export_glb(float* heightmap, int map_size, int flags, char* filename) {
+  size_t vertices = (size_t) map_size * map_size;
+  size_t indices  = (size_t) 6 * (map_size - 1) * (map_size - 1);
+
+  // binary chunk layout: positions, [normals], [uvs], indices
+  size_t position_offset = 0;
+  size_t normal_offset   = position_offset + vertices * 3 * sizeof(float);
+  size_t uv_offset       = normal_offset + (flags & GLB_NORMALS ? vertices * 3 * sizeof(float) : 0);
+  size_t index_offset    = uv_offset + (flags & GLB_UVS ? vertices * 2 * sizeof(float) : 0);
+  size_t bin_length      = index_offset + indices * sizeof(uint32_t);
+
+  // the mesh bounds are required on the position accessor
+  float min_height = heightmap[0], max_height = heightmap[0];
+  #pragma omp parallel for reduction(min:min_height) reduction(max:max_height)
+  for (size_t i = 0; i < vertices; i++) {
+    min_height = fminf(min_height, heightmap[i]);
+    max_height = fmaxf(max_height, heightmap[i]);
+  }
+
+  char bounds[128];
+  char views[GLB_JSON_MAX / 2] = "", accessors[GLB_JSON_MAX / 2] = "", attributes[128];
+  char* json = malloc(GLB_JSON_MAX);
+  int view = 0;
+
+  snprintf(bounds, sizeof(bounds), ",\"min\":[0,%.9g,0],\"max\":[1,%.9g,1]", 
+           min_height, max_height);
+  sprintf(attributes, "\"POSITION\":%d", view);
+  glb_view(views, accessors, view++, position_offset, normal_offset - position_offset, 
+           34962, 5126, vertices, "VEC3", bounds);
+  if (flags & GLB_NORMALS) {
+    sprintf(attributes + strlen(attributes), ",\"NORMAL\":%d", view);
+    glb_view(views, accessors, view++, normal_offset, uv_offset - normal_offset, 
+             34962, 5126, vertices, "VEC3", "");
+  }
+  if (flags & GLB_UVS) {
+    sprintf(attributes + strlen(attributes), ",\"TEXCOORD_0\":%d", view);
+    glb_view(views, accessors, view++, uv_offset, index_offset - uv_offset, 
+             34962, 5126, vertices, "VEC2", "");
+  }
+  glb_view(views, accessors, view, index_offset, bin_length - index_offset, 
+           34963, 5125, indices, "SCALAR", "");
+
+  int json_length = 0;
+  if (json != NULL) {
+    json_length = snprintf(json, GLB_JSON_MAX,
+      "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Hydraulic Erosion\"},"
+      "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+      "\"meshes\":[{\"primitives\":[{\"attributes\":{%s},\"indices\":%d,\"mode\":4}]}],"
+      "\"buffers\":[{\"byteLength\":%zu}],\"bufferViews\":[%s],\"accessors\":[%s]}",
+      attributes, view, bin_length, views, accessors);
+  }
+
+  // chunks are 4 byte aligned, json is padded with spaces
+  size_t json_chunk = (json_length + 3) & ~3;
+  size_t total = 12 + 8 + json_chunk + 8 + bin_length;
+  float* coords = grid_coords(map_size);
+  uint8_t* buffer = total <= UINT32_MAX ? malloc(total) : NULL;
+
+  if (json == NULL || coords == NULL || buffer == NULL) {
+    free(json);
+    free(coords);
+    free(buffer);
+    return;
+  }
+
+  uint32_t header[5] = { GLB_MAGIC, 2, (uint32_t) total, (uint32_t) json_chunk, GLB_CHUNK_JSON };
+  uint32_t bin_header[2] = { (uint32_t) bin_length, GLB_CHUNK_BIN };
+  memcpy(buffer, header, sizeof(header));
+  memcpy(buffer + 20, json, json_length);
+  memset(buffer + 20 + json_length, ' ', json_chunk - json_length);
+  memcpy(buffer + 20 + json_chunk, bin_header, sizeof(bin_header));
+
+  uint8_t* bin = buffer + 28 + json_chunk;
+  float* positions = (float*) (bin + position_offset);
+  float* normals   = (float*) (bin + normal_offset);
+  float* uvs       = (float*) (bin + uv_offset);
+  uint32_t* quads  = (uint32_t*) (bin + index_offset);
+
+  #pragma omp parallel for schedule(static)
+  for (int z = 0; z < map_size; z++) {
+    for (int x = 0; x < map_size; x++) {
+      size_t vertex = (size_t) z * map_size + x;
+      grid_position(heightmap, map_size, coords, x, z, positions + 3 * vertex);
+      if (flags & GLB_NORMALS)
+        grid_normal(heightmap, map_size, x, z, normals + 3 * vertex);
+      if (flags & GLB_UVS) {
+        uvs[2 * vertex]     = coords[x];
+        uvs[2 * vertex + 1] = coords[z];
+      }
+      if (x < map_size - 1 && z < map_size - 1)
+        grid_quad(map_size, x, z, quads + 6 * ((size_t) z * (map_size - 1) + x));
+    }
+  }
+
+  // the file is only created once there is something to write
+  FILE* fp = fopen(filename, "wb");
+  if (fp != NULL)
+    close_obj(fp, fwrite(buffer, 1, total, fp) == total, filename);
+
+  free(json);
+  free(coords);
+  free(buffer);
+}
+
+
+#define PLY_FACE_SIZE 13   /* uchar count and 3 uint32 indices */
+
+void export_ply(float* heightmap, int map_size, int normals, char* filename) {
+  size_t vertices = (size_t) map_size * map_size;
+  size_t faces    = (size_t) 2 * (map_size - 1) * (map_size - 1);
+  size_t vertex_size = (normals ? 6 : 3) * sizeof(float);
+
+  char header[512];
+  int header_length = snprintf(header, sizeof(header),
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "comment %s\n"
+    "element vertex %zu\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "%s"
+    "element face %zu\n"
+    "property list uchar uint vertex_indices\n"
+    "end_header\n",
+    EXPORT_MSG + 2, vertices, 
+    normals ? "property float nx\nproperty float ny\nproperty float nz\n" : "", 
+    faces);
+
+  size_t total = header_length + vertices * vertex_size + faces * PLY_FACE_SIZE;
+  float* coords = grid_coords(map_size);
+  uint8_t* buffer = malloc(total);
+
+  if (coords == NULL || buffer == NULL) {
+    free(coords);
+    free(buffer);
+    return;
+  }
+
+  memcpy(buffer, header, header_length);
+  uint8_t* vertex_data = buffer + header_length;
+  uint8_t* face_data   = vertex_data + vertices * vertex_size;
+
+  // records are packed and unaligned, so they are assembled and copied in
+  #pragma omp parallel for schedule(static)
+  for (int z = 0; z < map_size; z++) {
+    for (int x = 0; x < map_size; x++) {
+      float vertex[6];
+      grid_position(heightmap, map_size, coords, x, z, vertex);
+      if (normals)
+        grid_normal(heightmap, map_size, x, z, vertex + 3);
+      memcpy(vertex_data + ((size_t) z * map_size + x) * vertex_size, vertex, vertex_size);
+
+      if (x < map_size - 1 && z < map_size - 1) {
+        uint32_t quad[6];
+        uint8_t* face = face_data + 2 * ((size_t) z * (map_size - 1) + x) * PLY_FACE_SIZE;
+        grid_quad(map_size, x, z, quad);
+        face[0] = 3;
+        memcpy(face + 1, quad, 3 * sizeof(uint32_t));
+        face[PLY_FACE_SIZE] = 3;
+        memcpy(face + PLY_FACE_SIZE + 1, quad + 3, 3 * sizeof(uint32_t));
+      }
+    }
+  }
+
+  // the file is only created once there is something to write
+  FILE* fp = fopen(filename, "wb");
+  if (fp != NULL)
+    close_obj(fp, fwrite(buffer, 1, total, fp) == total, filename);
+
+  free(coords);
+  free(buffer);
+}
+
+
+/* ==================== single traversal exports ===================== */
+
+#define MULTI_BAND_HEIGHTS (1 << 16)    /* heights per band, 256K stays in L2 */
+#define MULTI_FORMATS      4
+
+/* a format written band by band, begin and end [optional] run on the
+   calling thread and band on any one thread */
+struct band_writer {
+  int  (*begin)(struct band_writer* w);
+  void (*band)(struct band_writer* w, int y0, int rows);
+  int  (*end)(struct band_writer* w);
+  FILE* fp;
+  char* filename;
+  float* heightmap;
+  int map_size;
+  int band_rows;
+  int level;
+  unsigned char* buffer;  /* one band of encoded rows */
+  float* coords;          /* stl vertex coordinates */
+  struct obj_job obj;
+  struct png_writer png;
+};
+
+static int png_begin(struct band_writer* w) {
+  w->buffer = malloc((size_t) w->band_rows * w->map_size * 3);
+  return w->buffer != NULL
+         && png_write_begin(&w->png, w->fp, w->map_size, w->map_size, 3, 8, w->level);
+}
+
+static void png_band(struct band_writer* w, int y0, int rows) {
+  encode_rgb_rows(w->heightmap, w->map_size, y0, rows, w->buffer);
+  png_write_rows(&w->png, w->buffer, rows);
+}
+
+static int png16_begin(struct band_writer* w) {
+  w->buffer = malloc((size_t) w->band_rows * w->map_size * 2);
+  return w->buffer != NULL
+         && png_write_begin(&w->png, w->fp, w->map_size, w->map_size, 1, 16, w->level);
+}
+
+static void png16_band(struct band_writer* w, int y0, int rows) {
+  encode_gray16_rows(w->heightmap, w->map_size, y0, rows, w->buffer);
+  png_write_rows(&w->png, w->buffer, rows);
+}
+
+static int png_end(struct band_writer* w) {
+  return png_write_end(&w->png);
+}
+
+static int stl_begin(struct band_writer* w) {
+  size_t row_bytes = (size_t) 2 * (w->map_size - 1) * STL_RECORD_SIZE;
+  w->coords = grid_coords(w->map_size);
+  w->buffer = malloc(w->band_rows * row_bytes);
+  if (w->coords == NULL || w->buffer == NULL)
+    return 0;
+
+  uint8_t  header[80] = EXPORT_MSG;
+  uint32_t face_count = 2 * (w->map_size - 1) * (w->map_size - 1);
+  fwrite(header, 1, 80, w->fp);
+  fwrite(&face_count, sizeof(uint32_t), 1, w->fp);
+  return 1;
+}
+
+static void stl_band(struct band_writer* w, int y0, int rows) {
+  size_t row_bytes = (size_t) 2 * (w->map_size - 1) * STL_RECORD_SIZE;
+  // quad row z joins heightmap rows z and z + 1, the last row starts none
+  int end = y0 + rows < w->map_size - 1 ? y0 + rows : w->map_size - 1;
+  for (int z = y0; z < end; z++) {
+    write_stl_row(w->buffer + (z - y0) * row_bytes, w->heightmap, w->map_size, w->coords, z);
+  }
+  if (end > y0)
+    fwrite(w->buffer, 1, (end - y0) * row_bytes, w->fp);
+}
+
+static int obj_begin(struct band_writer* w) {
+  int size = w->map_size;
+  w->obj.heightmap = w->heightmap;
+  w->obj.export_size = size;
+  w->obj.coords = malloc(size * OBJ_COORD_LEN);
+  w->obj.coord_len = malloc(size * sizeof(int));
+  w->buffer = malloc((size_t) w->band_rows * size * OBJ_MAX_VERTEX_LINE);
+  if (w->obj.coords == NULL || w->obj.coord_len == NULL || w->buffer == NULL)
+    return 0;
+
+  for (int i = 0; i < size; i++) {
+    char* end = write_float(w->obj.coords + i * OBJ_COORD_LEN, (float) i / size);
+    w->obj.coord_len[i] = end - (w->obj.coords + i * OBJ_COORD_LEN);
+  }
+  fprintf(w->fp, EXPORT_MSG "\n");
+  fprintf(w->fp, "# List of geometric vertices coordinate (x, y, z)\n");
+  return 1;
+}
+
+static void obj_band(struct band_writer* w, int y0, int rows) {
+  size_t length = format_vertex_rows(&w->obj, y0, y0 + rows, (char*) w->buffer);
+  fwrite(w->buffer, 1, length, w->fp);
+}
+
+/* the faces only hold vertex indices, they do not read the heightmap */
+static int obj_end(struct band_writer* w) {
+  int size = w->map_size;
+  int face_rows = OBJ_CHUNK_BYTES / (size * 2 * OBJ_MAX_FACE_LINE) + 1;
+  fprintf(w->fp, "# List of faces: f (v1 index, v2 index, v3 index) \n");
+  return write_obj_rows(w->fp, format_face_rows, &w->obj, size - 1, face_rows,
+                        (size_t) face_rows * size * 2 * OBJ_MAX_FACE_LINE);
+}
+
+/* closes the file, removes it unless it is complete */
+static void free_band_writer(struct band_writer* w, int complete) {
+  free(w->buffer);
+  free(w->coords);
+  free(w->obj.coords);
+  free(w->obj.coord_len);
+  if (w->fp) {
+    complete = complete && !ferror(w->fp);
+    if (fclose(w->fp) != 0 || !complete)
+      remove(w->filename);
+  }
+  free(w->filename);
+}
+
+
+void export_multi(float* heightmap, int map_size, int formats, int level, char* basename) {
+  static const struct {
+    int format;
+    const char* suffix;
+    int (*begin)(struct band_writer* w);
+    void (*band)(struct band_writer* w, int y0, int rows);
+    int  (*end)(struct band_writer* w);
+  } table[MULTI_FORMATS] = {
+    { EXPORT_PNG,   ".png",    png_begin,   png_band,   png_end },
+    { EXPORT_PNG16, "_16.png", png16_begin, png16_band, png_end },
+    { EXPORT_STL,   ".stl",    stl_begin,   stl_band,   NULL    },
+    { EXPORT_OBJ,   ".obj",    obj_begin,   obj_band,   obj_end }
+  };
+
+  struct band_writer writers[MULTI_FORMATS];
+  int count = 0;
+  int band_rows = MULTI_BAND_HEIGHTS / map_size;
+  if (band_rows < 2)
+    band_rows = 2;
+
+  for (int f = 0; f < MULTI_FORMATS; f++) {
+    if (!(formats & table[f].format))
+      continue;
+    struct band_writer* w = &writers[count];
+    memset(w, 0, sizeof(struct band_writer));
+    w->begin = table[f].begin;
+    w->band = table[f].band;
+    w->end = table[f].end;
+    w->heightmap = heightmap;
+    w->map_size = map_size;
+    w->band_rows = band_rows;
+    w->level = level;
+
+    w->filename = malloc(strlen(basename) + 8);
+    if (w->filename == NULL)
+      continue;
+    sprintf(w->filename, "%s%s", basename, table[f].suffix);
+    w->fp = fopen(w->filename, table[f].format == EXPORT_OBJ ? "w" : "wb");
+    if (w->fp != NULL && w->begin(w))
+      count++;
+    else
+      free_band_writer(w, 0);
+  }
+
+  // every writer takes a band while it is in cache, the barrier at the
+  // end of the omp for keeps them on the same band
+  #pragma omp parallel
+  for (int y = 0; y < map_size; y += band_rows) {
+    int rows = map_size - y < band_rows ? map_size - y : band_rows;
+    #pragma omp for schedule(dynamic, 1)
+    for (int i = 0; i < count; i++) {
+      writers[i].band(&writers[i], y, rows);
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    int complete = writers[i].end == NULL || writers[i].end(&writers[i]);
+    free_band_writer(&writers[i], complete);
+  }
+}
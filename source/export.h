@@ -2,12 +2,23 @@
 * FILENAME :        export.h   export.c
 *
 * DESCRIPTION :
-*       Utility Functions for exporting heightmap as .obj files
-*       or png heightmaps
+*       Utility Functions for exporting heightmap as .obj files,
+*       binary .stl meshes, indexed .glb and .ply meshes or png heightmaps
 *
 * PUBLIC FUNCTIONS :
 *       void export_obj( float* heightmap, int map_size, char* filename )
+*       void export_obj_adaptive( float* heightmap, int map_size,
+*                                 float max_error, char* filename )
 *       void export_png( float* heightmap, int map_size, char* filename )
+*       void export_png_level( float* heightmap, int map_size, int level,
+*                              char* filename )
+*       void export_png16( float* heightmap, int map_size, int level,
+*                          char* filename )
+*       void export_stl( float* heightmap, int map_size, char* filename )
+*       void export_glb( float* heightmap, int map_size, int flags, char* filename )
+*       void export_ply( float* heightmap, int map_size, int normals, char* filename )
+*       void export_multi( float* heightmap, int map_size, int formats,
+*                          int level, char* basename )
 *
 * NOTES :
 *       This export utils function export file to the virtual file system
@@ -29,8 +40,12 @@
  * the .obj format with only verticies and faces exported [does not include
  * the noramls or UVs]. The exported mesh has dimension [1, 1, 1].
  * The obj file can be exported in lower quality to reduce file size 
- * controlled by @param export_size. and @param export_size must be 
- * less and an interger multiple of @param map_size.
+ * controlled by @param export_size, any size, the heightmap is area
+ * filtered to it [see resample.h].
+ * Heights are written with the fewest digits that read back to the same
+ * float. Rows are formatted into chunk buffers in parallel and written in
+ * order with one write per chunk. A file that could not be written 
+ * completely is removed.
  * 
  * @param heightmap   the heightmap to export
  * @param map_size    the heightmap size
@@ -40,12 +55,30 @@
 void export_obj( float* heightmap, int map_size, int export_size, char* filename );
 
 
+/**
+ * @brief Export heightmap as an adaptive .obj mesh within an error bound
+ * 
+ * Triangulates the @param heightmap with @param map_size as a right
+ * triangulated irregular network [see rtin.h], using large triangles on
+ * flat areas and full resolution on ridges and channels, so that no
+ * height is off by more than @param max_error. The exported mesh has
+ * dimension [1, 1, 1] and faces are counter clockwise seen from above.
+ * A file that could not be written completely is removed.
+ * 
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param max_error the largest vertical error allowed
+ * @param filename  the filename [include extension]
+ */
+void export_obj_adaptive( float* heightmap, int map_size, float max_error, char* filename );
+
+
 /**
  * @brief Export heightmap as an .png file with filename
  * 
  * Exports the @param heightmap with @param map_size with filename
  * @param filename. The exported file in the Virtual file system is 
- * in the .png image format [RGB format]
+ * in the .png image format [RGB format], compressed at the default level.
  * 
  * @param heightmap the heightmap to export
  * @param map_size  the heightmap size
@@ -54,6 +87,39 @@ void export_obj( float* heightmap, int map_size, int export_size, char* filename
 void export_png( float* heightmap, int map_size, char* filename );
 
 
+/**
+ * @brief Export heightmap as an .png file with a compression level
+ * 
+ * Same as export_png with deflate @param level in [0, 9], 0 stores the
+ * image uncompressed and 9 is the smallest and slowest. Rows are
+ * filtered and compressed in parallel chunks as they are encoded. A
+ * file that could not be written completely is removed.
+ * 
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param level     the compression level
+ * @param filename  the filename [include extension]
+ */
+void export_png_level( float* heightmap, int map_size, int level, char* filename );
+
+
+/**
+ * @brief Export heightmap as a 16 bit grayscale .png file
+ * 
+ * Exports the @param heightmap with @param map_size as a single channel
+ * png with 65536 height levels, which avoids the terracing of the 8 bit
+ * RGB export. Heights are clamped to [0, 1]. Rows are converted and
+ * streamed to the encoder one at a time, a file that could not be
+ * written completely is removed.
+ * 
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param level     the compression level in [0, 9]
+ * @param filename  the filename [include extension]
+ */
+void export_png16( float* heightmap, int map_size, int level, char* filename );
+
+
 /**
  * @brief Export heightmap as an .stl file with filename
  * 
@@ -69,8 +135,100 @@ void export_png( float* heightmap, int map_size, char* filename );
 void export_stl( float* heightmap, int map_size, char* filename );
 
 
+/**
+ * @brief Optional vertex attributes of export_glb
+ */
+enum glb_attribute {
+  GLB_NORMALS = 1,    /* per vertex normals from central differences */
+  GLB_UVS     = 2     /* texture coordinates spanning [0, 1] */
+};
+
+/**
+ * @brief Export heightmap as an indexed binary glTF .glb file
+ * 
+ * Exports the @param heightmap with @param map_size as a single mesh
+ * with one vertex per height sample and 32 bit triangle indices, which
+ * is many times smaller than the .stl export. The exported mesh has
+ * dimension [1, 1, 1]. The binary buffer is generated in parallel into
+ * memory and written at once. Nothing is written when the file would
+ * exceed the 4GB limit of the format, and a file that could not be
+ * written completely is removed.
+ * note: see https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html
+ * 
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param flags     bitwise or of glb_attribute to include
+ * @param filename  the filename [include extension]
+ */
+void export_glb( float* heightmap, int map_size, int flags, char* filename );
+
+
+/**
+ * @brief Export heightmap as a binary little endian .ply file
+ * 
+ * Exports the @param heightmap with @param map_size as indexed vertices
+ * and triangle faces, with per vertex normals when @param normals is
+ * non zero. The exported mesh has dimension [1, 1, 1]. The body is
+ * generated in parallel into one buffer and written at once, a file
+ * that could not be written completely is removed.
+ * note: see http://paulbourke.net/dataformats/ply/
+ * 
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param normals   include vertex normals
+ * @param filename  the filename [include extension]
+ */
+void export_ply( float* heightmap, int map_size, int normals, char* filename );
+
+
+/**
+ * @brief Formats of export_multi, combined as flags
+ */
+enum export_format {
+  EXPORT_PNG   = 1,   /* basename.png as export_png_level */
+  EXPORT_PNG16 = 2,   /* basename_16.png as export_png16 */
+  EXPORT_STL   = 4,   /* basename.stl as export_stl */
+  EXPORT_OBJ   = 8    /* basename.obj as export_obj at full size */
+};
+
+/**
+ * @brief Exports several formats in one traversal of the heightmap
+ *
+ * Walks the @param heightmap in bands of rows small enough to stay in
+ * cache, and every format encodes and writes the band on its own thread
+ * before the next band is read. Threads done with their format help
+ * compressing the png chunks of the band. The files are the same as the ones of
+ * the single format exporters, a file that could not be written 
+ * completely is removed.
+ *
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param formats   export_format flags
+ * @param level     the deflate level of the pngs
+ * @param basename  the filename without extension, see export_format
+ */
+void export_multi( float* heightmap, int map_size, int formats, int level, char* basename );
+
+
 // DEBUGGING FUNCTIONS
-float* read_map( char* filename, int size );
+
+/**
+ * @brief Reads a heightmap saved by write_map or numpy.save
+ *
+ * The file must hold a square 2d little endian float32 array in C order.
+ *
+ * @param filename  the .npy filename
+ * @param size      set to the heightmap size
+ * @return          the heightmap [free with free], NULL on failure
+ */
+float* read_map( char* filename, int* size );
+
+/**
+ * @brief Saves the heightmap as a .npy file with one bulk write
+ *
+ * numpy.load returns a (size, size) float32 array indexed [y, x], the
+ * same row major layout as the heightmap.
+ */
 void   write_map( float* height_map, int size, char* filename );
 
 #endif
\ No newline at end of file
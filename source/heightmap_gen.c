@@ -7,13 +7,28 @@
 *
 * PUBLIC FUNCTIONS :
 *       void gen_heightmap(float* height_map, int map_size, setting_t setting);
+*       void gen_heightmap_cached(float* height_map, int map_size, 
+*                                 setting_t setting, struct octave_cache* cache);
+*       void octave_cache_init(struct octave_cache* cache, size_t budget);
+*       void octave_cache_free(struct octave_cache* cache);
 * 
 *
 * PRIVATE FUNCTIONS :
+*       void init_octave(struct octave* oct, int map_size, float scale, float weight);
+*       void sample_row(struct row_buffers* buf, int y, int map_size, 
+*                       struct octave* oct, setting_t setting, int deriv, int warp);
+*       void write_row(float* row, struct row_buffers* buf, int y, int map_size,
+*                      struct octave* octaves, struct octave* warp_octaves, 
+*                      setting_t setting);
+*       void normalize_map(float* height_map, int count, float height);
+*       struct octave* init_octaves(int map_size, setting_t setting);
+*       int  fill_cache(struct octave_cache* cache, int map_size, setting_t setting);
+*       void blend_cache(struct octave_cache* cache, setting_t setting);
 *
 * NOTES :
 *       Generates heightmap based on seed and number of octaves and 
 *       persistence with modifier scale and height
+*       All octaves of a row are computed before moving to the next row
 *
 * AUTHOR :    Henry Jiang         DATE :    Feb 11, 2021
 */
@@ -23,45 +38,274 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
 
-// add noise to heightmap based on scale and weight
+/* number of samples sharing one rebased lattice origin */
+#define NOISE_TILE 64
+
+/* layers the octave cache blends at most, more add nothing visible */
+#define CACHE_MAX_OCTAVES 32
+
+/* how strongly a ridge gates the detail of the next layer */
+#define RIDGE_GAIN 2.0f
+
+/* sampling parameters of a single noise layer */
+struct octave {
+  double x_offset;
+  double y_offset;
+  float  scale;
+  float  weight;
+  int    period;    /* lattice cells per map in tileable mode */
+};
+
+/* scratch buffers for sampling one row of every octave */
+struct row_buffers {
+  double* xd;        /* double precision sample coordinates */
+  double* yd;
+  double* noise_d;   /* double precision noise and gradient */
+  double* dx_d;
+  double* dy_d;
+  float*  noise;     /* noise and gradient of the current octave */
+  float*  dx;
+  float*  dy;
+  float*  slope_x;   /* gradient accumulated over the octaves */
+  float*  slope_y;
+  float*  ridge_weight;  /* ridge feedback from the previous octave */
+  float*  warp_x;    /* domain warp displacement in map units */
+  float*  warp_y;
+};
+
+
+int alloc_row_buffers(struct row_buffers* buf, int map_size) {
+  buf->xd      = malloc(map_size * sizeof(double));
+  buf->yd      = malloc(map_size * sizeof(double));
+  buf->noise_d = malloc(map_size * sizeof(double));
+  buf->dx_d    = malloc(map_size * sizeof(double));
+  buf->dy_d    = malloc(map_size * sizeof(double));
+  buf->noise   = malloc(map_size * sizeof(float));
+  buf->dx      = malloc(map_size * sizeof(float));
+  buf->dy      = malloc(map_size * sizeof(float));
+  buf->slope_x = malloc(map_size * sizeof(float));
+  buf->slope_y = malloc(map_size * sizeof(float));
+  buf->ridge_weight = malloc(map_size * sizeof(float));
+  buf->warp_x  = malloc(map_size * sizeof(float));
+  buf->warp_y  = malloc(map_size * sizeof(float));
+
+  return buf->xd && buf->yd && buf->noise_d && buf->dx_d && buf->dy_d &&
+         buf->noise && buf->dx && buf->dy && buf->slope_x && buf->slope_y &&
+         buf->ridge_weight && buf->warp_x && buf->warp_y;
+}
+
+// draws the random offsets of a layer, called in layer order
+void init_octave(struct octave* oct, int map_size, float scale, float weight) {
+  oct->x_offset = (double) (defined_random() % map_size) / map_size;
+  oct->y_offset = (double) (defined_random() % map_size) / map_size;
+  oct->scale = scale;
+  oct->weight = weight;
+  // closest even number of cells per map, so the map wraps around
+  oct->period = 2 * (int) (1 / scale / 2 + 0.5f);
+  if (oct->period < 2)
+    oct->period = 2;
+}
+
+void free_row_buffers(struct row_buffers* buf) {
+  free(buf->xd);
+  free(buf->yd);
+  free(buf->noise_d);
+  free(buf->dx_d);
+  free(buf->dy_d);
+  free(buf->noise);
+  free(buf->dx);
+  free(buf->dy);
+  free(buf->slope_x);
+  free(buf->slope_y);
+  free(buf->ridge_weight);
+  free(buf->warp_x);
+  free(buf->warp_y);
+}
+
+
+// samples one row of a noise layer into buf->noise
+// the gradient is written to buf->dx and buf->dy if deriv is set and the 
+// samples are displaced by buf->warp_x and buf->warp_y if warp is set
 // the noise freq is inversly prop to scale
-void write_single(float* height_map, int map_size, float scale, float weight) {
-  // introduce offsets
-  double x_offset = (double) (defined_random() % map_size) / map_size;
-  double y_offset = (double) (defined_random() % map_size) / map_size;
-  
-  for (int y = 0; y < map_size; y++) {
+void sample_row(struct row_buffers* buf, int y, int map_size, 
+                struct octave* oct, setting_t setting, int deriv, int warp) {
+  double sample_y = ((double) y / map_size) / oct->scale + oct->y_offset;
+
+  if (setting->tileable) {
+    // the map spans exactly oct->period lattice cells in both directions
+    double cell = (double) oct->period / map_size;
+    for (int x = 0; x < map_size; x++) {
+      buf->xd[x] = x * cell + oct->x_offset;
+      buf->yd[x] = y * cell + oct->y_offset;
+      if (warp) {
+        buf->xd[x] += buf->warp_x[x] * oct->period;
+        buf->yd[x] += buf->warp_y[x] * oct->period;
+      }
+    }
+
+    noise_periodic_batch(buf->noise_d, deriv ? buf->dx_d : NULL, deriv ? buf->dy_d : NULL,
+                         buf->xd, buf->yd, map_size, oct->period, oct->period);
+    for (int x = 0; x < map_size; x++) {
+      buf->noise[x] = buf->noise_d[x];
+      if (deriv) {
+        buf->dx[x] = buf->dx_d[x];
+        buf->dy[x] = buf->dy_d[x];
+      }
+    }
+    return;
+  }
+
+  if (setting->precision == PRECISION_FLOAT) {
+    // rebase each tile onto the lattice cell of its first sample so 
+    // that the float kernel only sees small offsets
+    float xs[NOISE_TILE];
+    float ys[NOISE_TILE];
+    float step = (float) (1.0 / map_size / oct->scale);
+    float inv_scale = 1 / oct->scale;
+
+    for (int tile = 0; tile < map_size; tile += NOISE_TILE) {
+      int count = map_size - tile < NOISE_TILE ? map_size - tile : NOISE_TILE;
+
+      int cell_i, cell_j;
+      double origin_x, origin_y;
+      noise_rebase(((double) tile / map_size) / oct->scale + oct->x_offset, sample_y,
+                   &cell_i, &cell_j, &origin_x, &origin_y);
+
+      // offsets inside a tile are small enough to step in float
+      float x_start = (float) (((double) tile / map_size) / oct->scale 
+                               + oct->x_offset - origin_x);
+      float y_local = (float) (sample_y - origin_y);
+      for (int k = 0; k < count; k++) {
+        xs[k] = x_start + k * step;
+        ys[k] = y_local;
+      }
+      if (warp) {
+        for (int k = 0; k < count; k++) {
+          xs[k] += buf->warp_x[tile + k] * inv_scale;
+          ys[k] += buf->warp_y[tile + k] * inv_scale;
+        }
+      }
+
+      if (deriv)
+        noisef_deriv_batch(buf->noise + tile, buf->dx + tile, buf->dy + tile,
+                           xs, ys, count, cell_i, cell_j);
+      else
+        noisef_batch(buf->noise + tile, xs, ys, count, cell_i, cell_j);
+    }
+    return;
+  }
+
+  for (int x = 0; x < map_size; x++) {
+    buf->xd[x] = ((double) x / map_size) / oct->scale + oct->x_offset;
+    buf->yd[x] = sample_y;
+  }
+  if (warp) {
+    for (int x = 0; x < map_size; x++) {
+      buf->xd[x] += buf->warp_x[x] / oct->scale;
+      buf->yd[x] += buf->warp_y[x] / oct->scale;
+    }
+  }
+
+  if (deriv) {
+    noise_deriv_batch(buf->noise_d, buf->dx_d, buf->dy_d, buf->xd, buf->yd, map_size);
     for (int x = 0; x < map_size; x++) {
-      double sample_x = ((double) x / map_size) / scale + x_offset;
-      double sample_y = ((double) y / map_size) / scale + y_offset;
-      
-      double sample = (noise(sample_x, sample_y) + 1) / 2; // between [0, 1] 
-      height_map[y * map_size + x] += sample * weight;
+      buf->noise[x] = buf->noise_d[x];
+      buf->dx[x] = buf->dx_d[x];
+      buf->dy[x] = buf->dy_d[x];
+    }
+  }
+  else {
+    noise_batch(buf->noise_d, buf->xd, buf->yd, map_size);
+    for (int x = 0; x < map_size; x++) {
+      buf->noise[x] = buf->noise_d[x];
     }
   }
 }
 
-void gen_heightmap(float* height_map, int map_size, setting_t setting) {
-  // set seed and init permutation array
-  init_perm();
-  memset(height_map, 0, map_size * map_size * sizeof(float));
-  set_random_seed(setting->seed);
 
-  float weight = 1.0f; // inital weight value
-  float scale = setting->scale;
-  
+// computes one row of the heightmap with all octaves fused
+void write_row(float* row, struct row_buffers* buf, int y, int map_size,
+               struct octave* octaves, struct octave* warp_octaves, 
+               setting_t setting) {
+  int mode = setting->mode;
+  int warp = mode == MODE_WARP;
+
+  memset(row, 0, map_size * sizeof(float));
+  if (mode == MODE_SLOPE) {
+    memset(buf->slope_x, 0, map_size * sizeof(float));
+    memset(buf->slope_y, 0, map_size * sizeof(float));
+  }
+  else if (mode == MODE_RIDGED) {
+    for (int x = 0; x < map_size; x++) {
+      buf->ridge_weight[x] = 1;
+    }
+  }
+  else if (warp) {
+    // displacement in map units from two decorrelated base layers
+    sample_row(buf, y, map_size, &warp_octaves[0], setting, 0, 0);
+    for (int x = 0; x < map_size; x++) {
+      buf->warp_x[x] = buf->noise[x] * setting->warp;
+    }
+    sample_row(buf, y, map_size, &warp_octaves[1], setting, 0, 0);
+    for (int x = 0; x < map_size; x++) {
+      buf->warp_y[x] = buf->noise[x] * setting->warp;
+    }
+  }
+
   for (int oct = 0; oct < setting->octaves; oct++) {
-    // layer noise with decreasing scale and weight
-    write_single(height_map, map_size, scale, weight);
-    weight *= setting->persistence; /* each noise layer contributes less */
-    scale /= 2; 
+    float weight = octaves[oct].weight;
+    sample_row(buf, y, map_size, &octaves[oct], setting, mode == MODE_SLOPE, warp);
+
+    switch (mode) {
+      case MODE_SLOPE:
+        // damp the layer by the slope accumulated over the previous 
+        // layers, so that steep areas get less detail
+        for (int x = 0; x < map_size; x++) {
+          buf->slope_x[x] += buf->dx[x] / 2 * weight;
+          buf->slope_y[x] += buf->dy[x] / 2 * weight;
+          float damping = 1 + buf->slope_x[x] * buf->slope_x[x] 
+                            + buf->slope_y[x] * buf->slope_y[x];
+          row[x] += (buf->noise[x] + 1) / 2 * weight / damping;
+        }
+        break;
+
+      case MODE_RIDGED:
+        // sharp crests where the noise crosses zero, each layer is 
+        // weighted by the previous one so detail gathers on the ridges
+        for (int x = 0; x < map_size; x++) {
+          float signal = 1 - fabsf(buf->noise[x]);
+          signal *= signal * buf->ridge_weight[x];
+          row[x] += signal * weight;
+          float next = signal * RIDGE_GAIN;
+          buf->ridge_weight[x] = next < 0 ? 0 : (next > 1 ? 1 : next);
+        }
+        break;
+
+      case MODE_BILLOW:
+        // rounded hills with creases where the noise crosses zero
+        for (int x = 0; x < map_size; x++) {
+          row[x] += fabsf(buf->noise[x]) * weight;
+        }
+        break;
+
+      default:
+        for (int x = 0; x < map_size; x++) {
+          row[x] += (buf->noise[x] + 1) / 2 * weight; // between [0, 1]
+        }
+        break;
+    }
   }
+}
 
-  // normalize heightmap
-  float min = 1; 
-  float max = 0;
-  for (int index = 0; index < map_size * map_size; index++) {
+
+// normalizes the map to [0, height]
+void normalize_map(float* height_map, int count, float height) {
+  float min = height_map[0]; 
+  float max = height_map[0];
+  for (int index = 0; index < count; index++) {
     if (height_map[index] > max) {
         max = height_map[index];
     }
@@ -71,9 +315,263 @@ void gen_heightmap(float* height_map, int map_size, setting_t setting) {
   }
 
   // normalize and scale with height 
-  for (int index = 0; index < map_size * map_size; index++) {
+  for (int index = 0; index < count; index++) {
     float norm = (height_map[index] - min) / (max - min);
-    height_map[index] = norm * setting->height;
+    height_map[index] = norm * height;
     // TODO: Maybe passing a mapping function f: R -> R
   }
 }
+
+
+// seeds the generator and draws the offsets of every octave
+// returns NULL if out of memory
+struct octave* init_octaves(int map_size, setting_t setting) {
+  // set seed and init permutation array
+  init_perm();
+  set_random_seed(setting->seed);
+
+  struct octave* octaves = malloc((setting->octaves + 1) * sizeof(struct octave));
+  if (octaves == NULL)
+    return NULL;
+
+  float weight = 1.0f; // inital weight value
+  float scale = setting->scale;
+
+  for (int oct = 0; oct < setting->octaves; oct++) {
+    // layer noise with decreasing scale and weight and random offsets
+    init_octave(&octaves[oct], map_size, scale, weight);
+    weight *= setting->persistence; /* each noise layer contributes less */
+    scale /= 2; 
+  }
+  return octaves;
+}
+
+
+void gen_heightmap(float* height_map, int map_size, setting_t setting) {
+  memset(height_map, 0, map_size * map_size * sizeof(float));
+
+  struct octave* octaves = init_octaves(map_size, setting);
+  struct row_buffers buf;
+  if (!alloc_row_buffers(&buf, map_size) || octaves == NULL) {
+    free_row_buffers(&buf);
+    free(octaves);
+    return;
+  }
+
+  // the warp layers are drawn after the octaves so that the octaves
+  // match the other modes for the same seed
+  struct octave warp_octaves[2];
+  init_octave(&warp_octaves[0], map_size, setting->scale, 1);
+  init_octave(&warp_octaves[1], map_size, setting->scale, 1);
+
+  // fused octave loop, each row is finished while it is in cache
+  for (int y = 0; y < map_size; y++) {
+    write_row(height_map + y * map_size, &buf, y, map_size, 
+              octaves, warp_octaves, setting);
+  }
+
+  free_row_buffers(&buf);
+  free(octaves);
+
+  normalize_map(height_map, map_size * map_size, setting->height);
+}
+
+
+/* ====================== octave layer cache ====================== */
+
+void octave_cache_init(struct octave_cache* cache, size_t budget) {
+  memset(cache, 0, sizeof(struct octave_cache));
+  cache->budget = budget;
+}
+
+void octave_cache_free(struct octave_cache* cache) {
+  free(cache->layers);
+  free(cache->row_low);
+  free(cache->row_step);
+  free(cache->base);
+  octave_cache_init(cache, cache->budget);
+}
+
+
+// checks if the cached layers were generated with the same noise 
+int cache_matches(struct octave_cache* cache, int map_size, setting_t setting) {
+  return cache->octaves >= setting->octaves &&
+         cache->map_size == map_size &&
+         cache->key.seed == setting->seed &&
+         cache->key.scale == setting->scale &&
+         cache->key.mode == setting->mode &&
+         cache->key.precision == setting->precision &&
+         cache->key.tileable == setting->tileable;
+}
+
+
+// generates every layer of setting into the cache 
+// returns 0 if the layers do not fit into the budget
+int fill_cache(struct octave_cache* cache, int map_size, setting_t setting) {
+  size_t cells = (size_t) map_size * map_size;
+  size_t base_bytes = cells * sizeof(float);
+  size_t rows = (size_t) setting->octaves * map_size;
+
+  // full precision layers if they fit, quantized ones otherwise
+  int quantized;
+  if (setting->octaves > CACHE_MAX_OCTAVES)
+    return 0;
+  else if (base_bytes + setting->octaves * cells * sizeof(float) <= cache->budget)
+    quantized = 0;
+  else if (base_bytes + setting->octaves * cells * sizeof(uint16_t) 
+           + 2 * rows * sizeof(float) <= cache->budget)
+    quantized = 1;
+  else
+    return 0;
+
+  octave_cache_free(cache);
+  cache->layers = malloc(setting->octaves * cells * (quantized ? sizeof(uint16_t) : sizeof(float)));
+  cache->base = malloc(base_bytes);
+  if (quantized) {
+    cache->row_low = malloc(rows * sizeof(float));
+    cache->row_step = malloc(rows * sizeof(float));
+  }
+
+  struct octave* octaves = init_octaves(map_size, setting);
+  struct row_buffers buf;
+  if (!alloc_row_buffers(&buf, map_size) || octaves == NULL || 
+      cache->layers == NULL || cache->base == NULL ||
+      (quantized && (cache->row_low == NULL || cache->row_step == NULL))) {
+    free_row_buffers(&buf);
+    free(octaves);
+    octave_cache_free(cache);
+    return 0;
+  }
+
+  for (int y = 0; y < map_size; y++) {
+    for (int oct = 0; oct < setting->octaves; oct++) {
+      sample_row(&buf, y, map_size, &octaves[oct], setting, 0, 0);
+      size_t offset = oct * cells + (size_t) y * map_size;
+
+      // same layer values as write_row, all in [0, 1]
+      float* value = buf.noise;
+      for (int x = 0; x < map_size; x++) {
+        value[x] = setting->mode == MODE_BILLOW ? fabsf(value[x]) : (value[x] + 1) / 2;
+      }
+      if (!quantized) {
+        memcpy((float*) cache->layers + offset, value, map_size * sizeof(float));
+        continue;
+      }
+
+      // 16 bits over the range of the row, the low frequency layers of 
+      // large scales span little of [0, 1] and would keep few steps
+      float low = value[0], high = value[0];
+      for (int x = 1; x < map_size; x++) {
+        low = value[x] < low ? value[x] : low;
+        high = value[x] > high ? value[x] : high;
+      }
+      float step = (high - low) / 65535;
+      float inv_step = step > 0 ? 1 / step : 0;
+      uint16_t* q = (uint16_t*) cache->layers + offset;
+      for (int x = 0; x < map_size; x++) {
+        q[x] = (uint16_t) ((value[x] - low) * inv_step + 0.5f);
+      }
+      cache->row_low[(size_t) oct * map_size + y] = low;
+      cache->row_step[(size_t) oct * map_size + y] = step;
+    }
+  }
+
+  free_row_buffers(&buf);
+  free(octaves);
+
+  cache->map_size = map_size;
+  cache->octaves = setting->octaves;
+  cache->quantized = quantized;
+  cache->key = *setting;
+  cache->base_octaves = 0; /* base has not been blended yet */
+  return 1;
+}
+
+
+// blends the cached layers with the weights of setting into cache->base
+// in one pass, every cell sums its octaves, and keeps the range of the 
+// blend for scaling it to height
+void blend_cache(struct octave_cache* cache, setting_t setting) {
+  int map_size = cache->map_size;
+  size_t cells = (size_t) map_size * map_size;
+  int octaves = setting->octaves;
+  float* base = cache->base;
+  float weights[CACHE_MAX_OCTAVES];   /* of a quantized step or a float value */
+  float low = INFINITY, high = -INFINITY;
+
+  for (int y = 0; y < map_size; y++) {
+    // a quantized row starts at the weighted sum of its row_low
+    float offset = 0;
+    float weight = 1.0f;
+    for (int oct = 0; oct < octaves; oct++) {
+      if (cache->quantized) {
+        size_t row = (size_t) oct * map_size + y;
+        offset += cache->row_low[row] * weight;
+        weights[oct] = cache->row_step[row] * weight;
+      }
+      else {
+        weights[oct] = weight;
+      }
+      weight *= setting->persistence;
+    }
+
+    size_t start = (size_t) y * map_size;
+    for (size_t i = start; i < start + map_size; i++) {
+      float h = offset;
+      if (cache->quantized) {
+        const uint16_t* layer = (const uint16_t*) cache->layers + i;
+        for (int oct = 0; oct < octaves; oct++) {
+          h += layer[oct * cells] * weights[oct];
+        }
+      }
+      else {
+        const float* layer = (const float*) cache->layers + i;
+        for (int oct = 0; oct < octaves; oct++) {
+          h += layer[oct * cells] * weights[oct];
+        }
+      }
+      base[i] = h;
+      low = h < low ? h : low;
+      high = h > high ? h : high;
+    }
+  }
+
+  cache->base_low = low;
+  cache->base_range = high - low;
+  cache->base_octaves = setting->octaves;
+  cache->key.persistence = setting->persistence;
+}
+
+
+void gen_heightmap_cached(float* height_map, int map_size, setting_t setting,
+                          struct octave_cache* cache) {
+  // only the linear modes can be reblended from their layers
+  int cacheable = setting->mode == MODE_FBM || setting->mode == MODE_BILLOW;
+
+  if (!cacheable || cache->budget == 0) {
+    gen_heightmap(height_map, map_size, setting);
+    return;
+  }
+
+  if (!cache_matches(cache, map_size, setting) && 
+      !fill_cache(cache, map_size, setting)) {
+    // over budget, generate without the cache
+    gen_heightmap(height_map, map_size, setting);
+    return;
+  }
+
+  // a persistence or octave change reblends the layers, a height change
+  // only rescales the normalized blend
+  if (cache->base_octaves != setting->octaves || 
+      cache->key.persistence != setting->persistence) {
+    blend_cache(cache, setting);
+  }
+
+  // normalizes like normalize_map and scales to height in one pass
+  size_t cells = (size_t) map_size * map_size;
+  float low = cache->base_low;
+  float range = cache->base_range;
+  for (size_t i = 0; i < cells; i++) {
+    height_map[i] = (cache->base[i] - low) / range * setting->height;
+  }
+}
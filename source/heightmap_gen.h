@@ -7,6 +7,10 @@
 *
 * PUBLIC FUNCTIONS :
 *       void gen_heightmap(float* height_map, int map_size, setting_t setting);
+*       void gen_heightmap_cached(float* height_map, int map_size, 
+*                                 setting_t setting, struct octave_cache* cache);
+*       void octave_cache_init(struct octave_cache* cache, size_t budget);
+*       void octave_cache_free(struct octave_cache* cache);
 *       
 *
 * PRIVATE FUNCTIONS :
@@ -22,12 +26,54 @@
 #ifndef HEIGHTMAP_GEN_H_
 #define HEIGHTMAP_GEN_H_
 
+#include <stddef.h>
+
+/**
+ * @brief Precision of the noise evaluation used by the generator
+ * 
+ * PRECISION_FLOAT evaluates the noise in single precision with the 
+ * coordinates rebased per tile, see noisef_batch in noise.h
+ */
+enum noise_precision {
+    PRECISION_DOUBLE = 0,
+    PRECISION_FLOAT  = 1
+};
+
+/**
+ * @brief How the generator combines the noise layers
+ * 
+ * MODE_FBM    plain additive fBm
+ * MODE_SLOPE  derivative weighted fBm, each layer is damped by the slope 
+ *             accumulated over the previous layers using the analytic 
+ *             gradient from noise_deriv, so steep areas stay smooth 
+ *             and flat areas get detail similar to eroded terrain
+ * MODE_RIDGED ridged multifractal, sharp crests where the noise crosses
+ *             zero with the detail of each layer gated by the previous one
+ * MODE_BILLOW sum of absolute noise, rounded hills with creases
+ * MODE_WARP   fBm sampled at coordinates displaced by two base frequency 
+ *             noise layers, scaled by setting->warp
+ */
+enum generator_mode {
+    MODE_FBM    = 0,
+    MODE_SLOPE  = 1,
+    MODE_RIDGED = 2,
+    MODE_BILLOW = 3,
+    MODE_WARP   = 4
+};
+
+/* setting->warp of the api until set_warp_strength changes it */
+#define WARP_DEFAULT 0.1f
+
 struct setting {
     unsigned int seed;
     int octaves;
     float persistence;
     float scale;
     float height;
+    int precision;
+    int mode;
+    int tileable;
+    float warp;     /* MODE_WARP displacement as a fraction of the map */
 }; 
 /**
  * @brief The settings for the height map generator
@@ -40,7 +86,11 @@ struct setting example = {
     .octaves = 6,
     .persistence = 0.65f,
     .height = 1,
-    .scale = 1
+    .scale = 1,
+    .precision = PRECISION_DOUBLE,
+    .mode = MODE_FBM,
+    .tileable = 0,
+    .warp = 0.1f
 };
 */
 
@@ -49,6 +99,14 @@ typedef struct setting* setting_t;
 /**
  * @brief Generates height map with simplex noise 
  * 
+ * If setting->tileable is set the height map repeats with period 
+ * map_size, so copies of it can be placed next to each other without 
+ * seams. The noise frequency of every octave is rounded to an even number
+ * of lattice cells per map for this, and the double precision periodic 
+ * kernel is used regardless of setting->precision. 
+ * Erode tileable maps with erosion_param.WRAP_EDGES set to keep them 
+ * seamless.
+ * 
  * @param height_map    the height map to be filled
  * @param map_size      the map size
  * @param setting       settings struct with settings for the 
@@ -56,4 +114,68 @@ typedef struct setting* setting_t;
  */
 void gen_heightmap( float* height_map, int map_size, setting_t setting );
 
-#endif
\ No newline at end of file
+
+/**
+ * @brief Noise layers of the last generated map, see gen_heightmap_cached
+ * 
+ * layers holds octaves layers of map_size^2 values in [0, 1], as floats 
+ * or as uint16_t when quantized. A quantized row of a layer spans its own
+ * range, value = row_low + q * row_step with both indexed by 
+ * oct * map_size + y. base is the blend of the first base_octaves layers 
+ * with key.persistence before normalizing, it spans 
+ * [base_low, base_low + base_range].
+ */
+struct octave_cache {
+    size_t budget;          /* max bytes for layers and base, 0 disables */
+    int    map_size;
+    int    octaves;         /* number of cached layers */
+    int    quantized;       /* layers are stored as uint16_t */
+    int    base_octaves;    /* layers blended into base, 0 if not blended */
+    struct setting key;     /* settings the layers were generated with */
+    void*  layers;
+    float* row_low;         /* quantized layers only */
+    float* row_step;
+    float* base;
+    float  base_low;
+    float  base_range;
+};
+
+/**
+ * @brief Initializes an empty cache that may use up to @param budget bytes
+ */
+void octave_cache_init( struct octave_cache* cache, size_t budget );
+
+/**
+ * @brief Frees the cached layers, keeps the budget
+ */
+void octave_cache_free( struct octave_cache* cache );
+
+/**
+ * @brief Generates height map like gen_heightmap, reusing cached layers
+ * 
+ * The first call with a seed, scale, mode, precision and tileable setting 
+ * stores every noise layer in @param cache. Later calls that only change
+ * persistence or lower the number of octaves reblend the cached layers in
+ * one pass and scale the blend to height in a second, and calls that only
+ * change height just do the second. The layers are stored as floats if 
+ * they fit into cache->budget, quantized to 16 bits over the range of 
+ * each row if only those fit, otherwise, or with more than 32 octaves, 
+ * the map is generated without the cache. Quantizing adds up to half a step of every layer, relative to 
+ * the range of the blend, which normalizing scales to height: measured 
+ * up to 2e-5 of height for scales up to 200. Past that the map covers 
+ * less than a lattice cell, the blend spans so little that the float 
+ * rounding of gen_heightmap itself reaches 1e-4 of height and the 
+ * quantized blend is no closer than that. Only MODE_FBM and MODE_BILLOW are 
+ * linear in their layers and can be cached, other modes always call 
+ * gen_heightmap.
+ * 
+ * @param height_map    the height map to be filled
+ * @param map_size      the map size
+ * @param setting       settings struct with settings for the 
+ *                      simplex noise generator
+ * @param cache         cache initialized with octave_cache_init
+ */
+void gen_heightmap_cached( float* height_map, int map_size, setting_t setting,
+                           struct octave_cache* cache );
+
+#endif
@@ -2,93 +2,133 @@
 * FILENAME :        import.h   import.c
 *
 * DESCRIPTION :
-*       Utility Functions for import PNG heightmaps using libpng
+*       Utility Functions for import PNG heightmaps with the png decoder
 *
 * PUBLIC FUNCTIONS :
 *       float* import_heightmap( const char* filename, int* dimension )
 *
+* PRIVATE FUNCTIONS :
+*       convert_row8, convert_row16, import_row
+*
+* NOTES :
+*       Rows are decoded one at a time by png.c and converted straight
+*       into the heightmap, only one decoded row is held. No external
+*       library is needed, so it builds for the web as well.
+*       Gray, gray alpha, RGB and RGBA at 8 or 16 bits are supported,
+*       palettes and 1, 2, 4 bit gray are expanded to 8 bits. A height
+*       is the mean of the color channels, alpha is ignored. Interlaced
+*       images are read pass by pass and scattered to their pixels.
+*
 * AUTHOR :    Henry Jiang         DATE :    Feb 13, 2021
 */
 
 #include "import.h"
 
-#include <png.h>
 #include <stdio.h>
-#include <errno.h>
-#include <string.h>
 #include <stdlib.h>
-#include <stdarg.h>
-
-/* produces fatal error messages and exits */
-static void fatal_error(const char * message, ...) {
-  va_list args;
-  va_start(args, message);
-  vfprintf(stderr, message, args);
-  va_end(args);
-  exit(EXIT_FAILURE);
-}
+#include <stdint.h>
 
-float* import_heightmap( const char* filename, int* dimension ) {
-  png_structp png_ptr;
-  png_infop info_ptr;
-  FILE * fp;
-  png_uint_32 width;
-  png_uint_32 height;
-  int bit_depth;
-  int color_type;
-  int interlace_method;
-  int compression_method;
-  int filter_method;
-
-  /* reading PNG header metadata */
-  fp = fopen(filename, "rb");
-  if (!fp) {
-    fatal_error("Cannot open '%s': %s\n", filename, strerror(errno));
-  }
-  png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if (!png_ptr) {
-    fatal_error("Cannot create PNG read structure");
-  }
-  info_ptr = png_create_info_struct(png_ptr);
-  if (!png_ptr) {
-    fatal_error("Cannot create PNG info structure");
+#include "png.h"
+
+struct import_target {
+  float* heightmap;
+  float* scattered;     /* one converted pass row of an interlaced image */
+  int width;
+  int channels, depth;
+};
+
+/* mean color of 8 bit pixels in [0, 1], one loop per layout so each
+   vectorizes with a constant stride */
+static void convert_row8(const uint8_t* restrict row, int width, int channels,
+                         float* restrict out) {
+  switch (channels) {
+    case 1:
+      for (int x = 0; x < width; x++) out[x] = row[x] * (1.0f / 255);
+      break;
+    case 2:
+      for (int x = 0; x < width; x++) out[x] = row[2 * x] * (1.0f / 255);
+      break;
+    case 3:
+      for (int x = 0; x < width; x++)
+        out[x] = (row[3 * x] + row[3 * x + 1] + row[3 * x + 2]) * (1.0f / 765);
+      break;
+    default:
+      for (int x = 0; x < width; x++)
+        out[x] = (row[4 * x] + row[4 * x + 1] + row[4 * x + 2]) * (1.0f / 765);
+      break;
   }
-  png_set_palette_to_rgb(png_ptr);
-  png_init_io(png_ptr, fp);
-  png_read_png(png_ptr, info_ptr, 0, 0);
-  png_get_IHDR(png_ptr, info_ptr, & width, & height, & bit_depth, &
-    color_type, & interlace_method, & compression_method, &
-    filter_method);
-
-  if (width != height) {
-    printf("Image is not the same dimension.\n");
-    exit(EXIT_FAILURE);
+}
+
+/* mean color of 16 bit pixels in host byte order in [0, 1] */
+static void convert_row16(const uint16_t* restrict row, int width, int channels,
+                          float* restrict out) {
+  switch (channels) {
+    case 1:
+      for (int x = 0; x < width; x++) out[x] = row[x] * (1.0f / 65535);
+      break;
+    case 2:
+      for (int x = 0; x < width; x++) out[x] = row[2 * x] * (1.0f / 65535);
+      break;
+    case 3:
+      for (int x = 0; x < width; x++)
+        out[x] = ((float) row[3 * x] + row[3 * x + 1] + row[3 * x + 2]) * (1.0f / 196605);
+      break;
+    default:
+      for (int x = 0; x < width; x++)
+        out[x] = ((float) row[4 * x] + row[4 * x + 1] + row[4 * x + 2]) * (1.0f / 196605);
+      break;
   }
+}
+
+/* converts a decoded row into its pixels of the heightmap */
+static void import_row(void* ctx, const void* pixels, int y, int x0, int dx, int count) {
+  struct import_target* target = ctx;
+  float* row = target->heightmap + (size_t) y * target->width;
+  float* out = dx == 1 ? row + x0 : target->scattered;
 
-  /* create heightmap */
-  float* heightmap = (float*) malloc(width * height * sizeof(float));
+  if (target->depth == 16)
+    convert_row16(pixels, count, target->channels, out);
+  else
+    convert_row8(pixels, count, target->channels, out);
 
-  if (heightmap == NULL) {
-    printf("Failed to create heightmap.\n");
-    exit(EXIT_FAILURE);
+  // adam7 pass rows are every dx-th pixel
+  if (dx > 1) {
+    for (int c = 0; c < count; c++) {
+      row[x0 + c * dx] = target->scattered[c];
+    }
   }
+}
+
+
+float* import_heightmap( const char* filename, int* dimension ) {
+  struct png_reader png;
+  FILE* fp = fopen(filename, "rb");
 
-  /* read image data */
-  png_bytepp rows = png_get_rows(png_ptr, info_ptr);
-  int i, j;
+  if (fp == NULL)
+    return NULL;
 
-  for (i = 0; i < height; i++) {
-    for (j = 0; j < width * 3; j += 3) {
-      int pixel_sum = rows[i][j] + rows[i][j + 1] + rows[i][j + 2];
-      float val = (float) pixel_sum / (255 * 3) ;
-      heightmap[i * width + j / 3] = val;
-    }   
+  if (!png_read_begin(&png, fp) || png.width != png.height) {
+    fclose(fp);
+    return NULL;
   }
 
-  png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+  struct import_target target;
+  target.width = png.width;
+  target.channels = png.channels;
+  target.depth = png.depth;
+  target.heightmap = malloc((size_t) png.width * png.height * sizeof(float));
+  target.scattered = png.interlace ? malloc(png.width * sizeof(float)) : NULL;
+
+  int ok = target.heightmap != NULL && (!png.interlace || target.scattered != NULL)
+           && png_read_image(&png, import_row, &target);
+
+  free(target.scattered);
   fclose(fp);
+  if (!ok) {
+    free(target.heightmap);
+    return NULL;
+  }
 
-  *dimension = width;
-  return heightmap;
+  *dimension = png.width;
+  return target.heightmap;
 }
-
@@ -2,12 +2,23 @@
 * FILENAME :        import.h   import.c
 *
 * DESCRIPTION :
-*       Utility Functions for import PNG heightmaps using libpng
+*       Utility Functions for import PNG heightmaps with the png decoder
 *
 * PUBLIC FUNCTIONS :
 *       float* import_heightmap( const char* filename, int* dimension )
 *
+* NOTES :
+*       Any png the specification allows is read, the height of a pixel
+*       is the mean of its color channels in [0, 1], alpha is ignored.
+*       Returns NULL when the file cannot be read, is not a valid png or
+*       is not square.
+*
 * AUTHOR :    Henry Jiang         DATE :    Feb 13, 2021
 *H*/
 
-float* import_heightmap( const char* filename, int* dimension );
\ No newline at end of file
+#ifndef IMPORT_H_
+#define IMPORT_H_
+
+float* import_heightmap( const char* filename, int* dimension );
+
+#endif
\ No newline at end of file
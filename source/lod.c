@@ -0,0 +1,302 @@
+/***********************************************************************
+* FILENAME :        lod.h   lod.c
+*
+* DESCRIPTION :
+*       Chunked quadtree level of detail mesh export [.lod] for streaming
+*       viewers, every level halves the chunk size of the previous one
+*
+* PUBLIC FUNCTIONS :
+*       void export_lod( float* heightmap, int map_size, int chunk_quads,
+*                        char* filename )
+*
+* PRIVATE FUNCTIONS :
+*       chunk_cell, sample_map, border_vertex, build_triangles,
+*       build_chunk, chunk_stats
+*
+* NOTES :
+*       Every chunk has the same topology, so the chunk size and the file
+*       offsets are known up front. Chunks are generated in batches, in
+*       parallel, into one buffer and written in order. A first pass
+*       measures the level errors the skirt depths are derived from.
+*H*/
+
+#include "lod.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define LOD_MAGIC       0x444F4C48  /* "HLOD" */
+#define LOD_VERSION     1
+#define LOD_HEADER_SIZE 32
+#define LOD_ENTRY_SIZE  24
+#define LOD_BATCH_BYTES (4 << 20)   /* chunk bytes generated per batch */
+
+struct lod_layout {
+  int map_size;
+  int quads;
+  int side;             /* quads + 1 */
+  int levels;
+  int chunks;
+  int vertices;         /* per chunk, skirts included */
+  int indices;
+  size_t chunk_bytes;
+};
+
+
+/* level and cell of breadth first chunk id */
+static void chunk_cell(int id, int* level, int* x, int* y) {
+  int l = 0;
+  while (id >= 1 << 2 * l) {
+    id -= 1 << 2 * l;
+    l++;
+  }
+  *level = l;
+  *x = id & ((1 << l) - 1);
+  *y = id >> l;
+}
+
+/* bilinear sample of the heightmap at map coordinates (u, v) */
+static float sample_map(const float* heightmap, int map_size, float u, float v) {
+  int x0 = (int) u < map_size - 1 ? (int) u : map_size - 2;
+  int y0 = (int) v < map_size - 1 ? (int) v : map_size - 2;
+  float tx = u - x0, ty = v - y0;
+  const float* row0 = heightmap + (size_t) y0 * map_size;
+  const float* row1 = row0 + map_size;
+  float top = row0[x0] + (row0[x0 + 1] - row0[x0]) * tx;
+  float bot = row1[x0] + (row1[x0 + 1] - row1[x0]) * tx;
+  return top + (bot - top) * ty;
+}
+
+/* grid index of the k-th vertex along border edge [top, right, bottom, left] */
+static int border_vertex(int side, int edge, int k) {
+  int q = side - 1;
+  switch (edge) {
+    case 0:  return k;                      /* top, +x */
+    case 1:  return k * side + q;           /* right, +z */
+    case 2:  return q * side + q - k;       /* bottom, -x */
+    default: return (q - k) * side;         /* left, -z */
+  }
+}
+
+/* grid triangles counter clockwise seen from above, then outward skirts */
+static void build_triangles(const struct lod_layout* lod, uint16_t* indices) {
+  int side = lod->side, q = lod->quads;
+  for (int z = 0; z < q; z++) {
+    for (int x = 0; x < q; x++) {
+      uint16_t top_left = z * side + x;
+      uint16_t bot_left = top_left + side;
+      *indices++ = top_left;
+      *indices++ = bot_left;
+      *indices++ = top_left + 1;
+      *indices++ = top_left + 1;
+      *indices++ = bot_left;
+      *indices++ = bot_left + 1;
+    }
+  }
+
+  for (int edge = 0; edge < 4; edge++) {
+    uint16_t skirt = side * side + edge * side;
+    for (int k = 0; k < q; k++) {
+      uint16_t a = border_vertex(side, edge, k);
+      uint16_t b = border_vertex(side, edge, k + 1);
+      *indices++ = a;
+      *indices++ = b;
+      *indices++ = skirt + k;
+      *indices++ = b;
+      *indices++ = skirt + k + 1;
+      *indices++ = skirt + k;
+    }
+  }
+}
+
+/* positions of chunk (x, y) on level, skirts hang depth below the border */
+static void build_chunk(const struct lod_layout* lod, const float* heightmap,
+                        int level, int cx, int cy, float depth, float* out) {
+  int side = lod->side, q = lod->quads;
+  int cells = q << level;
+  float step = (float) (lod->map_size - 1) / cells;
+
+  for (int j = 0; j < side; j++) {
+    int gz = cy * q + j;
+    for (int i = 0; i < side; i++) {
+      int gx = cx * q + i;
+      float* p = out + 3 * (j * side + i);
+      p[0] = (float) gx / cells;
+      p[1] = sample_map(heightmap, lod->map_size, gx * step, gz * step);
+      p[2] = (float) gz / cells;
+    }
+  }
+
+  float* skirt = out + 3 * side * side;
+  for (int edge = 0; edge < 4; edge++) {
+    for (int k = 0; k < side; k++, skirt += 3) {
+      const float* p = out + 3 * border_vertex(side, edge, k);
+      skirt[0] = p[0];
+      skirt[1] = p[1] - depth;
+      skirt[2] = p[2];
+    }
+  }
+}
+
+/* height range of a built chunk and the largest distance between its
+   triangles and the heightmap samples they cover */
+static float chunk_stats(const struct lod_layout* lod, const float* heightmap,
+                         int level, int cx, int cy, const float* chunk,
+                         float* min_height, float* max_height) {
+  int side = lod->side, q = lod->quads;
+  float step = (float) (lod->map_size - 1) / (q << level);
+
+  float lo = chunk[1], hi = chunk[1];
+  for (int v = 0; v < side * side; v++) {
+    lo = fminf(lo, chunk[3 * v + 1]);
+    hi = fmaxf(hi, chunk[3 * v + 1]);
+  }
+  *min_height = lo;
+  *max_height = hi;
+
+  // map samples covered by the chunk
+  int x0 = (int) ceilf(cx * q * step), x1 = (int) floorf((cx + 1) * q * step);
+  int z0 = (int) ceilf(cy * q * step), z1 = (int) floorf((cy + 1) * q * step);
+  x1 = x1 < lod->map_size - 1 ? x1 : lod->map_size - 1;
+  z1 = z1 < lod->map_size - 1 ? z1 : lod->map_size - 1;
+
+  float error = 0;
+  for (int z = z0; z <= z1; z++) {
+    float v = z / step - cy * q;
+    int j = (int) v < q ? (int) v : q - 1;
+    float fz = v - j;
+    for (int x = x0; x <= x1; x++) {
+      float u = x / step - cx * q;
+      int i = (int) u < q ? (int) u : q - 1;
+      float fx = u - i;
+
+      const float* tl = chunk + 3 * (j * side + i);
+      float h_tl = tl[1], h_tr = tl[4];
+      float h_bl = tl[3 * side + 1], h_br = tl[3 * side + 4];
+      // quads split along the top right to bottom left diagonal
+      float h = fx + fz <= 1 ? h_tl + (h_tr - h_tl) * fx + (h_bl - h_tl) * fz
+                             : h_br + (h_bl - h_br) * (1 - fx) + (h_tr - h_br) * (1 - fz);
+      error = fmaxf(error, fabsf(heightmap[(size_t) z * lod->map_size + x] - h));
+    }
+  }
+  return error;
+}
+
+
+void export_lod(float* heightmap, int map_size, int chunk_quads, char* filename) {
+  if (map_size < 2 || chunk_quads < 1 || chunk_quads > LOD_MAX_QUADS)
+    return;
+
+  struct lod_layout lod;
+  lod.map_size = map_size;
+  lod.quads = chunk_quads;
+  lod.side = chunk_quads + 1;
+  lod.levels = 1;
+  while (lod.levels < LOD_MAX_LEVELS && (chunk_quads << (lod.levels - 1)) < map_size - 1) {
+    lod.levels++;
+  }
+  lod.chunks = ((1 << 2 * lod.levels) - 1) / 3;
+  lod.vertices = lod.side * lod.side + 4 * lod.side;
+  lod.indices = 6 * chunk_quads * chunk_quads + 4 * 6 * chunk_quads;
+  lod.chunk_bytes = (size_t) lod.vertices * 3 * sizeof(float);
+
+  size_t triangle_bytes = ((size_t) lod.indices * sizeof(uint16_t) + 3) & ~(size_t) 3;
+  size_t table_bytes = (size_t) lod.levels * 2 * sizeof(float);
+  size_t index_bytes = (size_t) lod.chunks * LOD_ENTRY_SIZE;
+  size_t data_offset = LOD_HEADER_SIZE + table_bytes + index_bytes + triangle_bytes;
+
+#ifdef _OPENMP
+  int threads = omp_get_max_threads();
+#else
+  int threads = 1;
+#endif
+  int batch = (int) (LOD_BATCH_BYTES / lod.chunk_bytes);
+  batch = batch < threads ? threads : batch;
+  batch = batch < lod.chunks ? batch : lod.chunks;
+
+  uint8_t* head = calloc(1, data_offset);
+  float* chunk_errors = malloc(lod.chunks * sizeof(float));
+  float* buffer = malloc(batch * lod.chunk_bytes);
+  float level_errors[LOD_MAX_LEVELS] = { 0 };
+  FILE* fp = NULL;
+  if (head != NULL && chunk_errors != NULL && buffer != NULL)
+    fp = fopen(filename, "wb");
+
+  if (fp == NULL) {
+    free(head);
+    free(chunk_errors);
+    free(buffer);
+    return;
+  }
+
+  uint32_t header[8] = { LOD_MAGIC, LOD_VERSION, map_size, chunk_quads, lod.levels,
+                         lod.chunks, lod.vertices, lod.indices };
+  memcpy(head, header, sizeof(header));
+  float* table = (float*) (head + LOD_HEADER_SIZE);
+  uint8_t* index = head + LOD_HEADER_SIZE + table_bytes;
+  build_triangles(&lod, (uint16_t*) (index + index_bytes));
+
+  // first pass, level errors and the chunk bounds of the index
+  for (int first = 0; first < lod.chunks; first += batch) {
+    int count = lod.chunks - first < batch ? lod.chunks - first : batch;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < count; c++) {
+      int level, x, y;
+      float* chunk = buffer + c * lod.chunk_bytes / sizeof(float);
+      float bounds[2];
+      uint64_t offset = data_offset + (first + c) * lod.chunk_bytes;
+      uint32_t bytes = (uint32_t) lod.chunk_bytes;
+      uint8_t* entry = index + (size_t) (first + c) * LOD_ENTRY_SIZE;
+
+      chunk_cell(first + c, &level, &x, &y);
+      build_chunk(&lod, heightmap, level, x, y, 0, chunk);
+      chunk_errors[first + c] = chunk_stats(&lod, heightmap, level, x, y, chunk,
+                                            &bounds[0], &bounds[1]);
+      memcpy(entry, &offset, 8);
+      memcpy(entry + 8, &bytes, 4);
+      memcpy(entry + 12, bounds, 8);
+    }
+  }
+
+  for (int c = 0; c < lod.chunks; c++) {
+    int level, x, y;
+    chunk_cell(c, &level, &x, &y);
+    level_errors[level] = fmaxf(level_errors[level], chunk_errors[c]);
+  }
+
+  // a crack against a neighbour one level away is at most both errors
+  for (int l = 0; l < lod.levels; l++) {
+    table[2 * l] = level_errors[l];
+    table[2 * l + 1] = level_errors[l] + level_errors[l > 0 ? l - 1 : 0];
+  }
+  int written = fwrite(head, 1, data_offset, fp) == data_offset;
+
+  // second pass, chunks with skirts in file order
+  for (int first = 0; written && first < lod.chunks; first += batch) {
+    int count = lod.chunks - first < batch ? lod.chunks - first : batch;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < count; c++) {
+      int level, x, y;
+      chunk_cell(first + c, &level, &x, &y);
+      build_chunk(&lod, heightmap, level, x, y, table[2 * level + 1],
+                  buffer + c * lod.chunk_bytes / sizeof(float));
+    }
+    written = fwrite(buffer, lod.chunk_bytes, count, fp) == (size_t) count;
+  }
+
+  free(head);
+  free(chunk_errors);
+  free(buffer);
+
+  // a truncated file would pass for a complete one until a chunk is read
+  written = written && !ferror(fp);
+  if (fclose(fp) != 0 || !written)
+    remove(filename);
+}
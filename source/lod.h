@@ -0,0 +1,57 @@
+/***********************************************************************
+* FILENAME :        lod.h   lod.c
+*
+* DESCRIPTION :
+*       Chunked quadtree level of detail mesh export [.lod] for streaming
+*       viewers, every level halves the chunk size of the previous one
+*
+* PUBLIC FUNCTIONS :
+*       void export_lod( float* heightmap, int map_size, int chunk_quads,
+*                        char* filename )
+*
+* NOTES :
+*       File layout, little endian:
+*
+*         header    8 uint32: magic "HLOD", version, map_size, chunk_quads,
+*                   levels, chunk_count, vertices and indices per chunk
+*         levels    per level float geometric error, float skirt depth
+*         index     per chunk uint64 offset, uint32 bytes, float min height,
+*                   float max height, uint32 reserved [24 bytes]
+*         triangles uint16 indices shared by every chunk, padded to 4 bytes
+*         chunks    per chunk x, y, z float positions
+*
+*       Chunks are numbered breadth first, chunk (x, y) of level l has id
+*       (4^l - 1) / 3 + y * 2^l + x, so a viewer reads the header, level
+*       table, index and triangles once and fetches chunks by range.
+*       Positions are in the [1, 1, 1] mesh of the other exports. Each
+*       chunk is a (chunk_quads + 1)^2 grid followed by 4 border skirts
+*       hanging skirt depth below the edges [top, right, bottom, left,
+*       walked clockwise seen from above], deep enough to cover cracks
+*       against neighbours one level coarser or finer.
+*H*/
+
+#ifndef LOD_H_
+#define LOD_H_
+
+#define LOD_MAX_QUADS  128    /* keeps chunk indices in uint16 */
+#define LOD_MAX_LEVELS 10
+
+/**
+ * @brief Export heightmap as a quadtree of mesh chunks
+ *
+ * Exports the @param heightmap with @param map_size as chunks of
+ * @param chunk_quads quads per side. Level 0 is one chunk covering the
+ * map, levels are added until the finest level reaches the heightmap
+ * resolution [at most LOD_MAX_LEVELS]. The geometric error of a level is
+ * the largest vertical distance between a heightmap sample and the
+ * level's mesh. Chunks are generated in parallel. A file that could not
+ * be written completely is removed.
+ *
+ * @param heightmap   the heightmap to export
+ * @param map_size    the heightmap size
+ * @param chunk_quads quads per chunk side, 1 to LOD_MAX_QUADS
+ * @param filename    the filename [include extension]
+ */
+void export_lod( float* heightmap, int map_size, int chunk_quads, char* filename );
+
+#endif
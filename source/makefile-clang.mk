@@ -3,16 +3,31 @@
 # For building to WASM use make web
 
 CC=clang
-CFLAGS=-Wall -O3
-CLIB=-lpng
+# exporters use OpenMP to use every core, build with OMPFLAGS= to disable
+OMPFLAGS=-fopenmp
+# nothing reads errno after math calls, lets sqrtf vectorize
+CFLAGS=-Wall -O3 -fno-math-errno $(OMPFLAGS) -pthread
+# without OpenMP the omp pragmas are ignored, they are not typos
+ifeq ($(OMPFLAGS),)
+CFLAGS+=-Wno-unknown-pragmas
+endif
+# async exports write snapshots on their own threads
+CLIB=-lm -pthread
 
 OBJDIR=build
 
-output: test.o erosion.o noise.o heightmap_gen.o utils.o api.o
+output: test.o erosion.o noise.o heightmap_gen.o utils.o deflate.o png.o raw.o rtin.o lod.o texture.o import.o tiff.o async.o checkpoint.o timelapse.o resample.o api.o
 	$(CC) $(CFLAGS) test.o \
 		erosion.o noise.o heightmap_gen.o \
-		utils.o api.o \
-		-o output.exe
+		utils.o deflate.o png.o raw.o rtin.o lod.o texture.o import.o tiff.o async.o checkpoint.o timelapse.o resample.o api.o \
+		-o output.exe $(CLIB)
+
+# benchmark driver for the noise generator and exporters
+bench: bench.o erosion.o noise.o heightmap_gen.o utils.o deflate.o png.o raw.o rtin.o lod.o texture.o import.o tiff.o async.o checkpoint.o timelapse.o resample.o api.o
+	$(CC) $(CFLAGS) bench.o \
+		erosion.o noise.o heightmap_gen.o \
+		utils.o deflate.o png.o raw.o rtin.o lod.o texture.o import.o tiff.o async.o checkpoint.o timelapse.o resample.o api.o \
+		-o bench.exe $(CLIB)
 
 erosion.o: erosion.c erosion.h
 	$(CC) $(CFLAGS) -c erosion.c -o erosion.o
@@ -26,10 +41,41 @@ heightmap_gen.o: heightmap_gen.c heightmap_gen.h
 utils.o: export.c export.h
 	$(CC) $(CFLAGS) -c export.c -o utils.o
 
-# requires libpng to be installed 
-#    linkes with libpng library
-#import.o: import.c import.h
-#	$(CC) $(CFLAGS) -c import.c -o import.o
+deflate.o: deflate.c deflate.h
+	$(CC) $(CFLAGS) -c deflate.c -o deflate.o
+
+png.o: png.c png.h
+	$(CC) $(CFLAGS) -c png.c -o png.o
+
+raw.o: raw.c raw.h
+	$(CC) $(CFLAGS) -c raw.c -o raw.o
+
+rtin.o: rtin.c rtin.h
+	$(CC) $(CFLAGS) -c rtin.c -o rtin.o
+
+lod.o: lod.c lod.h
+	$(CC) $(CFLAGS) -c lod.c -o lod.o
+
+texture.o: texture.c texture.h
+	$(CC) $(CFLAGS) -c texture.c -o texture.o
+
+import.o: import.c import.h
+	$(CC) $(CFLAGS) -c import.c -o import.o
+
+tiff.o: tiff.c tiff.h
+	$(CC) $(CFLAGS) -c tiff.c -o tiff.o
+
+async.o: async.c async.h
+	$(CC) $(CFLAGS) -c async.c -o async.o
+
+checkpoint.o: checkpoint.c checkpoint.h
+	$(CC) $(CFLAGS) -c checkpoint.c -o checkpoint.o
+
+timelapse.o: timelapse.c timelapse.h
+	$(CC) $(CFLAGS) -c timelapse.c -o timelapse.o
+
+resample.o: resample.c resample.h
+	$(CC) $(CFLAGS) -c resample.c -o resample.o
 
 api.o: api.c api.h
 	$(CC) $(CFLAGS) -c api.c -o api.o
@@ -37,11 +83,15 @@ api.o: api.c api.h
 test.o: test.c
 	$(CC) $(CFLAGS) -c test.c -o test.o
 
+bench.o: bench.c
+	$(CC) $(CFLAGS) -c bench.c -o bench.o
+
 
-.PHONY: clean clean-win
+.PHONY: clean clean-win bench
 clean:
 	-rm *.o
 	-rm output
+	-rm *.exe
 	-rm *.png
 	-rm *.obj
 
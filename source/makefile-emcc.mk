@@ -1,10 +1,11 @@
 # Makefile for compiling the wasm files
 
 CC=emcc
-CFLAGS=-Wall -O3
+# no OpenMP in the wasm build, the omp pragmas are ignored
+CFLAGS=-Wall -O3 -fno-math-errno -Wno-unknown-pragmas
 
-output.js: api.o erosion.o noise.o heightmap_gen.o utils.o
-	$(CC) $(CFLAGS) -g1 api.o erosion.o noise.o heightmap_gen.o utils.o -o output.js \
+output.js: api.o erosion.o noise.o heightmap_gen.o utils.o deflate.o png.o raw.o rtin.o lod.o texture.o import.o tiff.o async.o checkpoint.o timelapse.o resample.o
+	$(CC) $(CFLAGS) -g1 api.o erosion.o noise.o heightmap_gen.o utils.o deflate.o png.o raw.o rtin.o lod.o texture.o import.o tiff.o async.o checkpoint.o timelapse.o resample.o -o output.js \
 		-s EXPORTED_FUNCTIONS='["_calloc", "_malloc", "_free"]' \
 		-s WASM=1 \
 		-s MALLOC=emmalloc \
@@ -34,6 +35,42 @@ heightmap_gen.o: heightmap_gen.c heightmap_gen.h
 utils.o: export.c export.h
 	$(CC) $(CFLAGS) -c export.c -o utils.o
 
+deflate.o: deflate.c deflate.h
+	$(CC) $(CFLAGS) -c deflate.c -o deflate.o
+
+png.o: png.c png.h
+	$(CC) $(CFLAGS) -c png.c -o png.o
+
+raw.o: raw.c raw.h
+	$(CC) $(CFLAGS) -c raw.c -o raw.o
+
+rtin.o: rtin.c rtin.h
+	$(CC) $(CFLAGS) -c rtin.c -o rtin.o
+
+lod.o: lod.c lod.h
+	$(CC) $(CFLAGS) -c lod.c -o lod.o
+
+texture.o: texture.c texture.h
+	$(CC) $(CFLAGS) -c texture.c -o texture.o
+
+import.o: import.c import.h
+	$(CC) $(CFLAGS) -c import.c -o import.o
+
+tiff.o: tiff.c tiff.h
+	$(CC) $(CFLAGS) -c tiff.c -o tiff.o
+
+async.o: async.c async.h
+	$(CC) $(CFLAGS) -c async.c -o async.o
+
+checkpoint.o: checkpoint.c checkpoint.h
+	$(CC) $(CFLAGS) -c checkpoint.c -o checkpoint.o
+
+timelapse.o: timelapse.c timelapse.h
+	$(CC) $(CFLAGS) -c timelapse.c -o timelapse.o
+
+resample.o: resample.c resample.h
+	$(CC) $(CFLAGS) -c resample.c -o resample.o
+
 
 .PHONY: clean clean-win
 clean:
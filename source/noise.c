@@ -1,6 +1,10 @@
 
 #include "noise.h"
 #include <math.h>
+#include <stddef.h>
+
+// scales noise_periodic to [-1, 1], measured max of the sum is 0.1083
+#define NOISE_PERIODIC_SCALE 9.2
 
 int grad3[][3] = {{1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0}, 
                   {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1}, 
@@ -28,10 +32,16 @@ int p[] = {151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194,
 
 int perm[512];
 
+// gradient of perm[i] % 12 as floats for the batch kernels
+float perm_grad_x[512];
+float perm_grad_y[512];
+
 // initialize the perm
 void init_perm() {
   for (int i = 0; i < 512; i++) {
     perm[i] = p[i & 255];
+    perm_grad_x[i] = grad3[perm[i] % 12][0];
+    perm_grad_y[i] = grad3[perm[i] % 12][1];
   }
 }
 
@@ -132,3 +142,291 @@ double noise(double xin, double yin) {
   // The result is scaled to return values in the interval [-1,1].
   return 70.0 * (n0 + n1 + n2);
 }
+
+
+void noise_batch(double* out, const double* xs, const double* ys, int count) {
+  for (int k = 0; k < count; k++) {
+    out[k] = noise(xs[k], ys[k]);
+  }
+}
+
+
+void noise_rebase(double xin, double yin, int* cell_i, int* cell_j,
+                  double* origin_x, double* origin_y) {
+  double F2 = 0.5 * (sqrt(3.0) - 1.0);
+  double G2 = (3.0 - sqrt(3.0)) / 6.0;
+  double s = (xin + yin) * F2;
+  int i = (int) floor(xin + s);
+  int j = (int) floor(yin + s);
+  double t = (i + j) * G2;
+  *cell_i = i;
+  *cell_j = j;
+  *origin_x = i - t;
+  *origin_y = j - t;
+}
+
+
+// floor for float that is also correct on negative integers
+int fastfloorf(float x) {
+  int xi = (int) x;
+  return xi - (x < xi);
+}
+
+
+// 2D simplex noise in single precision relative to lattice cell (cell_i, cell_j)
+void noisef_batch(float* restrict out, const float* restrict xs, 
+                  const float* restrict ys, int count, int cell_i, int cell_j) {
+  const float F2 = 0.36602540378443865f; // 0.5 * (sqrt(3) - 1)
+  const float G2 = 0.21132486540518713f; // (3 - sqrt(3)) / 6
+
+  for (int k = 0; k < count; k++) {
+    float xin = xs[k];
+    float yin = ys[k];
+
+    // Skew the local offset, the origin is already a lattice point
+    float s = (xin + yin) * F2;
+    int i = fastfloorf(xin + s);
+    int j = fastfloorf(yin + s);
+    float t = (i + j) * G2;
+    float x0 = xin - (i - t);
+    float y0 = yin - (j - t);
+
+    // Offsets for the middle corner without branching
+    int i1 = x0 > y0;
+    int j1 = 1 - i1;
+
+    float x1 = x0 - i1 + G2;
+    float y1 = y0 - j1 + G2;
+    float x2 = x0 - 1.0f + 2.0f * G2;
+    float y2 = y0 - 1.0f + 2.0f * G2;
+
+    // Hash with the absolute lattice coordinates
+    int ii = (i + cell_i) & 255;
+    int jj = (j + cell_j) & 255;
+    int h0 = ii + perm[jj];
+    int h1 = ii + i1 + perm[jj + j1];
+    int h2 = ii + 1 + perm[jj + 1];
+
+    // Clamp the falloff to max(t, 0) with (t + |t|) / 2, which unlike 
+    // a branch or fmaxf lets the compiler vectorize the loop
+    float t0 = 0.5f - x0 * x0 - y0 * y0;
+    float t1 = 0.5f - x1 * x1 - y1 * y1;
+    float t2 = 0.5f - x2 * x2 - y2 * y2;
+    t0 = (t0 + fabsf(t0)) * 0.5f;
+    t1 = (t1 + fabsf(t1)) * 0.5f;
+    t2 = (t2 + fabsf(t2)) * 0.5f;
+    t0 *= t0;
+    t1 *= t1;
+    t2 *= t2;
+
+    float n0 = t0 * t0 * (perm_grad_x[h0] * x0 + perm_grad_y[h0] * y0);
+    float n1 = t1 * t1 * (perm_grad_x[h1] * x1 + perm_grad_y[h1] * y1);
+    float n2 = t2 * t2 * (perm_grad_x[h2] * x2 + perm_grad_y[h2] * y2);
+
+    out[k] = 70.0f * (n0 + n1 + n2);
+  }
+}
+
+
+// 2D simplex noise with its analytic gradient
+double noise_deriv(double xin, double yin, double* dx, double* dy) {
+  double F2 = 0.5 * (sqrt(3.0) - 1.0);
+  double G2 = (3.0 - sqrt(3.0)) / 6.0;
+  double s = (xin + yin) * F2;
+  int i = fastfloor(xin + s);
+  int j = fastfloor(yin + s);
+  double t = (i + j) * G2;
+  double x0 = xin - (i - t);
+  double y0 = yin - (j - t);
+
+  int i1 = x0 > y0;
+  int j1 = 1 - i1;
+
+  double x1 = x0 - i1 + G2;
+  double y1 = y0 - j1 + G2;
+  double x2 = x0 - 1.0 + 2.0 * G2;
+  double y2 = y0 - 1.0 + 2.0 * G2;
+
+  int ii = i & 255;
+  int jj = j & 255;
+  int* g0 = grad3[perm[ii + perm[jj]] % 12];
+  int* g1 = grad3[perm[ii + i1 + perm[jj + j1]] % 12];
+  int* g2 = grad3[perm[ii + 1 + perm[jj + 1]] % 12];
+
+  // each corner contributes t^4 * (g . x), with t = 0.5 - |x|^2
+  // so its gradient is t^4 * g - 8 * t^3 * (g . x) * x
+  double value = 0, grad_x = 0, grad_y = 0;
+
+  double t0 = 0.5 - x0 * x0 - y0 * y0;
+  if (t0 > 0) {
+    double gdot = dot_2(g0, x0, y0);
+    double t2 = t0 * t0;
+    value += t2 * t2 * gdot;
+    grad_x += t2 * t2 * g0[0] - 8 * t2 * t0 * gdot * x0;
+    grad_y += t2 * t2 * g0[1] - 8 * t2 * t0 * gdot * y0;
+  }
+
+  double t1 = 0.5 - x1 * x1 - y1 * y1;
+  if (t1 > 0) {
+    double gdot = dot_2(g1, x1, y1);
+    double t2 = t1 * t1;
+    value += t2 * t2 * gdot;
+    grad_x += t2 * t2 * g1[0] - 8 * t2 * t1 * gdot * x1;
+    grad_y += t2 * t2 * g1[1] - 8 * t2 * t1 * gdot * y1;
+  }
+
+  double t2 = 0.5 - x2 * x2 - y2 * y2;
+  if (t2 > 0) {
+    double gdot = dot_2(g2, x2, y2);
+    double tt = t2 * t2;
+    value += tt * tt * gdot;
+    grad_x += tt * tt * g2[0] - 8 * tt * t2 * gdot * x2;
+    grad_y += tt * tt * g2[1] - 8 * tt * t2 * gdot * y2;
+  }
+
+  *dx = 70.0 * grad_x;
+  *dy = 70.0 * grad_y;
+  return 70.0 * value;
+}
+
+
+void noise_deriv_batch(double* out, double* dx, double* dy,
+                       const double* xs, const double* ys, int count) {
+  for (int k = 0; k < count; k++) {
+    out[k] = noise_deriv(xs[k], ys[k], &dx[k], &dy[k]);
+  }
+}
+
+
+// single precision simplex noise with analytic gradient, see noisef_batch
+void noisef_deriv_batch(float* restrict out, float* restrict dx, float* restrict dy,
+                        const float* restrict xs, const float* restrict ys, int count,
+                        int cell_i, int cell_j) {
+  const float F2 = 0.36602540378443865f;
+  const float G2 = 0.21132486540518713f;
+
+  for (int k = 0; k < count; k++) {
+    float xin = xs[k];
+    float yin = ys[k];
+
+    float s = (xin + yin) * F2;
+    int i = fastfloorf(xin + s);
+    int j = fastfloorf(yin + s);
+    float t = (i + j) * G2;
+    float x0 = xin - (i - t);
+    float y0 = yin - (j - t);
+
+    int i1 = x0 > y0;
+    int j1 = 1 - i1;
+
+    float x1 = x0 - i1 + G2;
+    float y1 = y0 - j1 + G2;
+    float x2 = x0 - 1.0f + 2.0f * G2;
+    float y2 = y0 - 1.0f + 2.0f * G2;
+
+    int ii = (i + cell_i) & 255;
+    int jj = (j + cell_j) & 255;
+    int h0 = ii + perm[jj];
+    int h1 = ii + i1 + perm[jj + j1];
+    int h2 = ii + 1 + perm[jj + 1];
+    float g0x = perm_grad_x[h0], g0y = perm_grad_y[h0];
+    float g1x = perm_grad_x[h1], g1y = perm_grad_y[h1];
+    float g2x = perm_grad_x[h2], g2y = perm_grad_y[h2];
+
+    float t0 = 0.5f - x0 * x0 - y0 * y0;
+    float t1 = 0.5f - x1 * x1 - y1 * y1;
+    float t2 = 0.5f - x2 * x2 - y2 * y2;
+    t0 = (t0 + fabsf(t0)) * 0.5f;
+    t1 = (t1 + fabsf(t1)) * 0.5f;
+    t2 = (t2 + fabsf(t2)) * 0.5f;
+
+    float d0 = g0x * x0 + g0y * y0;
+    float d1 = g1x * x1 + g1y * y1;
+    float d2 = g2x * x2 + g2y * y2;
+
+    float t0_3 = t0 * t0 * t0;
+    float t1_3 = t1 * t1 * t1;
+    float t2_3 = t2 * t2 * t2;
+    float t0_4 = t0_3 * t0;
+    float t1_4 = t1_3 * t1;
+    float t2_4 = t2_3 * t2;
+
+    out[k] = 70.0f * (t0_4 * d0 + t1_4 * d1 + t2_4 * d2);
+    dx[k] = 70.0f * (t0_4 * g0x - 8 * t0_3 * d0 * x0
+                   + t1_4 * g1x - 8 * t1_3 * d1 * x1
+                   + t2_4 * g2x - 8 * t2_3 * d2 * x2);
+    dy[k] = 70.0f * (t0_4 * g0y - 8 * t0_3 * d0 * y0
+                   + t1_4 * g1y - 8 * t1_3 * d1 * y1
+                   + t2_4 * g2y - 8 * t2_3 * d2 * y2);
+  }
+}
+
+
+// wraps lattice point (i, j) of the sheared lattice into the period
+// and returns its gradient index
+int periodic_hash(int i, int j, int period_x, int period_y) {
+  if (period_y > 0) {
+    // moving j by the (even) period moves the point by period_y / 2 
+    // lattice steps in x, undo that so the point stays in place
+    int jw = ((j % period_y) + period_y) % period_y;
+    i -= (j - jw) / 2;
+    j = jw;
+  }
+  if (period_x > 0) {
+    i = ((i % period_x) + period_x) % period_x;
+  }
+  return perm[(i & 255) + perm[j & 255]] % 12;
+}
+
+
+// 2D simplex noise on a sheared lattice that can repeat with integer periods
+double noise_periodic(double xin, double yin, int period_x, int period_y,
+                      double* dx, double* dy) {
+  // Lattice points are at (i - j / 2, j), shear so the lattice is axis aligned
+  double u = xin + yin * 0.5;
+  double v = yin;
+  int i0 = (int) floor(u);
+  int j0 = (int) floor(v);
+
+  // Offsets for the middle corner in lattice coords
+  int i1 = (u - i0) > (v - j0);
+  int j1 = 1 - i1;
+
+  int ci[3] = { i0, i0 + i1, i0 + 1 };
+  int cj[3] = { j0, j0 + j1, j0 + 1 };
+
+  double value = 0, grad_x = 0, grad_y = 0;
+  for (int c = 0; c < 3; c++) {
+    // distance to the corner in input space
+    double x = xin - (ci[c] - cj[c] * 0.5);
+    double y = yin - cj[c];
+
+    // the falloff radius reaches exactly to the far edges of the 
+    // triangles around the corner
+    double t = 0.8 - x * x - y * y;
+    if (t > 0) {
+      int* g = grad3[periodic_hash(ci[c], cj[c], period_x, period_y)];
+      double gdot = dot_2(g, x, y);
+      double t2 = t * t;
+      value += t2 * t2 * gdot;
+      grad_x += t2 * t2 * g[0] - 8 * t2 * t * gdot * x;
+      grad_y += t2 * t2 * g[1] - 8 * t2 * t * gdot * y;
+    }
+  }
+
+  if (dx && dy) {
+    *dx = NOISE_PERIODIC_SCALE * grad_x;
+    *dy = NOISE_PERIODIC_SCALE * grad_y;
+  }
+  return NOISE_PERIODIC_SCALE * value;
+}
+
+
+void noise_periodic_batch(double* out, double* dx, double* dy,
+                          const double* xs, const double* ys, int count,
+                          int period_x, int period_y) {
+  for (int k = 0; k < count; k++) {
+    out[k] = noise_periodic(xs[k], ys[k], period_x, period_y,
+                            dx ? &dx[k] : NULL, dy ? &dy[k] : NULL);
+  }
+}
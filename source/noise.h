@@ -6,16 +6,44 @@
 *
 * PUBLIC FUNCTIONS :
 *       double    noise( double xin, double yin ) 
+*       void      noise_batch( double* out, const double* xs, 
+*                              const double* ys, int count )
+*       void      noise_rebase( double xin, double yin, int* cell_i, 
+*                               int* cell_j, double* origin_x, 
+*                               double* origin_y )
+*       void      noisef_batch( float* out, const float* xs, 
+*                               const float* ys, int count, 
+*                               int cell_i, int cell_j )
+*       double    noise_deriv( double xin, double yin, 
+*                              double* dx, double* dy )
+*       void      noise_deriv_batch( double* out, double* dx, double* dy,
+*                                    const double* xs, const double* ys, 
+*                                    int count )
+*       void      noisef_deriv_batch( float* out, float* dx, float* dy,
+*                                     const float* xs, const float* ys, 
+*                                     int count, int cell_i, int cell_j )
+*       double    noise_periodic( double xin, double yin, 
+*                                 int period_x, int period_y,
+*                                 double* dx, double* dy )
+*       void      noise_periodic_batch( double* out, double* dx, double* dy,
+*                                       const double* xs, const double* ys, 
+*                                       int count, int period_x, 
+*                                       int period_y )
 *       void      init_perm( void )
 *       int       random( void )
 *       void      set_seed( unsigned int seed )
 * PRIVATE FUNCTIONS :
 *       int       fastfloor( double x )
+*       int       fastfloorf( float x )
 *       double    dot_2( int g[], double x, double y )
+*       int       periodic_hash( int i, int j, int period_x, int period_y )
 *
 * NOTES :
 *       Implements basic simplex noise algorithm from 
 *       http://webstaff.itn.liu.se/~stegu/simplexnoise/simplexnoise.pdf
+*       The single precision kernel evaluates coordinates relative to a 
+*       lattice origin computed in double, so the error stays bounded 
+*       regardless of the distance from the world origin.
 *
 * AUTHOR :    Henry Jiang         DATE :    Feb 11, 2021
 */
@@ -42,6 +70,106 @@ void init_perm( void );
 double noise( double xin, double yin );
 
 
+/**
+ * @brief Evaluates noise( xs[k], ys[k] ) for @param count samples into 
+ *        @param out
+ */
+void noise_batch( double* out, const double* xs, const double* ys, int count );
+
+
+/**
+ * @brief Rebases a coordinate onto the simplex lattice
+ * 
+ * Finds the lattice cell ( @param cell_i, @param cell_j ) that contains 
+ * ( @param xin, @param yin ) and its unskewed origin ( @param origin_x, 
+ * @param origin_y ). Coordinates near xin, yin minus the origin are small
+ * and can be passed to noisef_batch without losing precision.
+ */
+void noise_rebase( double xin, double yin, int* cell_i, int* cell_j, 
+                   double* origin_x, double* origin_y );
+
+
+/**
+ * @brief Single precision simplex noise over a batch of rebased samples
+ * 
+ * Evaluates the same noise field as noise( double, double ) at the 
+ * coordinates origin + ( xs[k], ys[k] ) where origin is the lattice origin
+ * of cell ( @param cell_i, @param cell_j ) from noise_rebase. The loop is 
+ * branch free so the compiler can vectorize it. 
+ * 
+ * Measured with bench.c: max absolute error against noise() is below 
+ * 5e-5 for offsets up to 64 lattice cells at any distance from the world
+ * origin, and below 1e-6 on a generated heightmap.
+ * 
+ * @param out    output buffer of @param count values in [-1, 1]
+ * @param xs     x offsets relative to the lattice origin
+ * @param ys     y offsets relative to the lattice origin
+ * @param cell_i skewed lattice x coordinate of the origin
+ * @param cell_j skewed lattice y coordinate of the origin
+ */
+void noisef_batch( float* out, const float* xs, const float* ys, int count, 
+                   int cell_i, int cell_j );
+
+
+/**
+ * @brief Simplex noise with its analytic gradient in one evaluation
+ * 
+ * Returns the same value as noise( @param xin, @param yin ) and stores 
+ * the partial derivatives with respect to xin and yin in @param dx and 
+ * @param dy. Costs about the same as a single noise() call, compared to
+ * three calls for a finite difference gradient.
+ */
+double noise_deriv( double xin, double yin, double* dx, double* dy );
+
+
+/**
+ * @brief Evaluates noise_deriv( xs[k], ys[k] ) for @param count samples
+ */
+void noise_deriv_batch( double* out, double* dx, double* dy, 
+                        const double* xs, const double* ys, int count );
+
+
+/**
+ * @brief Single precision noise_deriv over a batch of rebased samples
+ * 
+ * Same conventions as noisef_batch, with the gradient stored in 
+ * @param dx and @param dy
+ */
+void noisef_deriv_batch( float* out, float* dx, float* dy, 
+                         const float* xs, const float* ys, int count, 
+                         int cell_i, int cell_j );
+
+
+/**
+ * @brief Tileable simplex noise with values ranging from [-1, 1]
+ * 
+ * Uses a sheared lattice with points at ( i - j / 2, j ) instead of the 
+ * skewed equilateral lattice of noise(), so that the field can repeat 
+ * along the axes: noise_periodic( x + period_x, y ) and 
+ * noise_periodic( x, y + period_y ) equal noise_periodic( x, y ).
+ * A period of 0 disables wrapping along that axis.
+ * 
+ * @param xin      input x coordinate
+ * @param yin      input y coordinate
+ * @param period_x period along x in lattice units, any integer
+ * @param period_y period along y in lattice units, must be even
+ * @param dx       [out] optional partial derivative along x, may be NULL
+ * @param dy       [out] optional partial derivative along y, may be NULL
+ */
+double noise_periodic( double xin, double yin, int period_x, int period_y,
+                       double* dx, double* dy );
+
+
+/**
+ * @brief Evaluates noise_periodic for @param count samples
+ * 
+ * @param dx and @param dy may be NULL when the gradient is not needed
+ */
+void noise_periodic_batch( double* out, double* dx, double* dy, 
+                           const double* xs, const double* ys, int count, 
+                           int period_x, int period_y );
+
+
 /**
  * @brief Pseudo random function based on the undefined behavior of long overflow
  */
@@ -0,0 +1,666 @@
+/***********************************************************************
+* FILENAME :        png.h   png.c
+*
+* DESCRIPTION :
+*       Streaming compressed png encoder and decoder built on deflate.c
+*
+* PUBLIC FUNCTIONS :
+*       int  png_write_begin( struct png_writer* png, FILE* fp,
+*                             int width, int height, int channels,
+*                             int depth, int level )
+*       void png_write_rows( struct png_writer* png, const uint8_t* rows,
+*                            int count )
+*       int  png_write_end( struct png_writer* png )
+*       int  png_read_begin( struct png_reader* png, FILE* fp )
+*       int  png_read_image( struct png_reader* png,
+*                            png_row_reader row_reader, void* ctx )
+*
+* PRIVATE FUNCTIONS :
+*       put_u32, write_chunk, paeth, apply_filter, filter_row,
+*       compress_chunk, chunk_rows, flush_rows, free_writer, get_u32,
+*       read_chunk_head, check_chunk_crc, unfilter_pixels, unfilter_row,
+*       expand_row, start_pass, finish_row, idat_output, idat_input
+*
+* NOTES :
+*       Every row picks the filter with the smallest sum of absolute
+*       signed bytes, the heuristic recommended by the png specification.
+*       Chunks of rows are independent deflate pieces ending in a sync
+*       flush, their adler32 checksums are combined in order.
+*       Decoding inflates the IDAT chunks straight into one row at a time.
+*       Up reconstruction vectorizes, sub, average and paeth depend on the
+*       pixel to the left, so they are specialized per pixel size and only
+*       the bytes of a pixel are processed together. Chunk crcs are
+*       checked, the zlib adler32 is not.
+*       note: see https://www.w3.org/TR/png/
+*H*/
+
+#include "png.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "deflate.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define PNG_CHUNK_BYTES (256 << 10)    /* unfiltered bytes per deflate piece */
+
+enum png_filter { FILTER_NONE, FILTER_SUB, FILTER_UP, FILTER_AVERAGE, FILTER_PAETH };
+
+
+static void put_u32(uint8_t* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+/* writes a chunk with type and data, appending the length and crc */
+static void write_chunk(FILE* fp, const char* type, const uint8_t* data, uint32_t length) {
+  uint8_t head[8], tail[4];
+  put_u32(head, length);
+  memcpy(head + 4, type, 4);
+  put_u32(tail, deflate_crc32(deflate_crc32(0, head + 4, 4), data, length));
+  fwrite(head, 1, 8, fp);
+  fwrite(data, 1, length, fp);
+  fwrite(tail, 1, 4, fp);
+}
+
+/* branch free paeth predictor */
+static inline uint8_t paeth(int a, int b, int c) {
+  int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+  int pred_bc = pb <= pc ? b : c;
+  return pa <= pb && pa <= pc ? a : pred_bc;
+}
+
+/* filters row into out [filter byte then the row], returns the score */
+static uint32_t apply_filter(int filter, const uint8_t* restrict row, 
+                             const uint8_t* restrict prev, size_t stride, int bpp, 
+                             uint8_t* restrict out) {
+  out[0] = filter;
+  out++;
+
+  // the first pixel has no left neighbour, a and c are 0
+  size_t i;
+  switch (filter) {
+    case FILTER_NONE:
+      memcpy(out, row, stride);
+      break;
+    case FILTER_SUB:
+      for (i = 0; i < (size_t) bpp; i++) out[i] = row[i];
+      for (; i < stride; i++) out[i] = row[i] - row[i - bpp];
+      break;
+    case FILTER_UP:
+      for (i = 0; i < stride; i++) out[i] = row[i] - prev[i];
+      break;
+    case FILTER_AVERAGE:
+      for (i = 0; i < (size_t) bpp; i++) out[i] = row[i] - (prev[i] >> 1);
+      for (; i < stride; i++) out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+      break;
+    case FILTER_PAETH:
+      for (i = 0; i < (size_t) bpp; i++) out[i] = row[i] - prev[i];
+      for (; i < stride; i++) out[i] = row[i] - paeth(row[i - bpp], prev[i], prev[i - bpp]);
+      break;
+  }
+
+  uint32_t score = 0;
+  for (i = 0; i < stride; i++) {
+    score += abs((int8_t) out[i]);
+  }
+  return score;
+}
+
+/* filters row with the best scoring filter, scratch holds one filtered row */
+static void filter_row(struct png_writer* png, const uint8_t* row, const uint8_t* prev,
+                       uint8_t* out, uint8_t* scratch) {
+  if (png->level == 0) {
+    apply_filter(FILTER_NONE, row, prev, png->stride, png->bpp, out);
+    return;
+  }
+
+  uint32_t best = apply_filter(FILTER_NONE, row, prev, png->stride, png->bpp, out);
+  for (int filter = FILTER_SUB; filter <= FILTER_PAETH; filter++) {
+    uint32_t score = apply_filter(filter, row, prev, png->stride, png->bpp, scratch);
+    if (score < best) {
+      best = score;
+      memcpy(out, scratch, png->stride + 1);
+    }
+  }
+}
+
+/* filters and deflates pending chunk c into an IDAT chunk, returns its size */
+static size_t compress_chunk(struct png_writer* png, int c, int rows, uint32_t* adler) {
+  size_t line = png->stride + 1;
+  const uint8_t* zero_row = png->last_row + png->stride;
+  uint8_t* filtered = png->filtered[c];
+  uint8_t* scratch = filtered + rows * line;
+
+  for (int r = 0; r < rows; r++) {
+    int index = c * png->chunk_rows + r;
+    const uint8_t* row = png->raw + index * png->stride;
+    const uint8_t* prev = index > 0 ? row - png->stride
+                        : png->written > 0 ? png->last_row : zero_row;
+    filter_row(png, row, prev, filtered + r * line, scratch);
+  }
+
+  size_t bytes = rows * line;
+  int final = png->written + c * png->chunk_rows + rows == png->height;
+  uint8_t* out = png->packed[c];
+  size_t length = deflate_raw(filtered, bytes, png->level, final, out + 8);
+
+  put_u32(out, (uint32_t) length);
+  memcpy(out + 4, "IDAT", 4);
+  put_u32(out + 8 + length, deflate_crc32(0, out + 4, length + 4));
+  *adler = deflate_adler32(1, filtered, bytes);
+  return length + 12;
+}
+
+/* the buffered rows of chunk c, the last chunk may be short */
+static int chunk_rows(const struct png_writer* png, int c) {
+  int rows = png->buffered - c * png->chunk_rows;
+  return rows < png->chunk_rows ? rows : png->chunk_rows;
+}
+
+/* compresses the buffered rows in parallel and writes them in order */
+static void flush_rows(struct png_writer* png) {
+  int chunks = (png->buffered + png->chunk_rows - 1) / png->chunk_rows;
+  size_t sizes[chunks];
+  uint32_t adlers[chunks];
+
+#ifdef _OPENMP
+  // inside a team, as in export_multi, a nested parallel for would run on
+  // this thread alone, tasks are picked up by the threads that are waiting
+  if (omp_in_parallel()) {
+    #pragma omp taskloop grainsize(1) shared(sizes, adlers)
+    for (int c = 0; c < chunks; c++) {
+      sizes[c] = compress_chunk(png, c, chunk_rows(png, c), &adlers[c]);
+    }
+  } else
+#endif
+  {
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < chunks; c++) {
+      sizes[c] = compress_chunk(png, c, chunk_rows(png, c), &adlers[c]);
+    }
+  }
+
+  for (int c = 0; c < chunks; c++) {
+    int rows = chunk_rows(png, c);
+    if (fwrite(png->packed[c], 1, sizes[c], png->fp) != sizes[c])
+      png->error = 1;
+    png->adler = deflate_adler32_combine(png->adler, adlers[c], rows * (png->stride + 1));
+  }
+
+  memcpy(png->last_row, png->raw + (png->buffered - 1) * png->stride, png->stride);
+  png->written += png->buffered;
+  png->buffered = 0;
+}
+
+static void free_writer(struct png_writer* png) {
+  for (int c = 0; c < png->chunks; c++) {
+    if (png->filtered)
+      free(png->filtered[c]);
+    if (png->packed)
+      free(png->packed[c]);
+  }
+  free(png->filtered);
+  free(png->packed);
+  free(png->raw);
+  free(png->last_row);
+  png->filtered = NULL;
+  png->packed = NULL;
+  png->raw = NULL;
+  png->last_row = NULL;
+}
+
+
+int png_write_begin(struct png_writer* png, FILE* fp, int width, int height,
+                    int channels, int depth, int level) {
+  static const uint8_t color_type[5] = { 0, 0, 4, 2, 6 };
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+  memset(png, 0, sizeof(struct png_writer));
+  if (fp == NULL || width <= 0 || height <= 0 || channels < 1 || channels > 4
+      || (depth != 8 && depth != 16))
+    return 0;
+
+  png->fp = fp;
+  png->width = width;
+  png->height = height;
+  png->channels = channels;
+  png->depth = depth;
+  png->level = level < 0 ? 0 : level > 9 ? 9 : level;
+  png->bpp = channels * depth / 8;
+  png->stride = (size_t) width * png->bpp;
+  png->adler = 1;
+
+  png->chunk_rows = PNG_CHUNK_BYTES / png->stride;
+  if (png->chunk_rows < 1)
+    png->chunk_rows = 1;
+#ifdef _OPENMP
+  png->chunks = omp_get_max_threads();
+#else
+  png->chunks = 1;
+#endif
+
+  // pending rows, last row followed by a zero row for the first filter
+  size_t line = png->stride + 1;
+  png->packed_size = deflate_bound(png->chunk_rows * line) + 12;
+  png->raw = malloc(png->chunks * png->chunk_rows * png->stride);
+  png->last_row = calloc(2, png->stride);
+  png->filtered = calloc(png->chunks, sizeof(uint8_t*));
+  png->packed = calloc(png->chunks, sizeof(uint8_t*));
+  int ok = png->raw && png->last_row && png->filtered && png->packed;
+  for (int c = 0; ok && c < png->chunks; c++) {
+    png->filtered[c] = malloc((png->chunk_rows + 1) * line);
+    png->packed[c] = malloc(png->packed_size);
+    ok = png->filtered[c] && png->packed[c];
+  }
+  if (!ok) {
+    free_writer(png);
+    return 0;
+  }
+
+  uint8_t header[13];
+  put_u32(header, width);
+  put_u32(header + 4, height);
+  header[8] = depth;
+  header[9] = color_type[channels];
+  header[10] = 0;   /* deflate */
+  header[11] = 0;   /* adaptive filtering */
+  header[12] = 0;   /* no interlace */
+
+  // zlib header, 32K window with the level hint and check bits
+  int hint = png->level < 2 ? 0 : png->level < 6 ? 1 : png->level == 6 ? 2 : 3;
+  uint8_t zlib_header[2] = { 0x78, hint << 6 };
+  zlib_header[1] += 31 - (zlib_header[0] * 256 + zlib_header[1]) % 31;
+
+  fwrite(signature, 1, 8, fp);
+  write_chunk(fp, "IHDR", header, 13);
+  write_chunk(fp, "IDAT", zlib_header, 2);
+  return 1;
+}
+
+void png_write_rows(struct png_writer* png, const uint8_t* rows, int count) {
+  while (count > 0 && png->raw != NULL && png->written + png->buffered < png->height) {
+    int space = png->chunks * png->chunk_rows - png->buffered;
+    int n = count < space ? count : space;
+    if (png->written + png->buffered + n > png->height)
+      n = png->height - png->written - png->buffered;
+
+    memcpy(png->raw + png->buffered * png->stride, rows, n * png->stride);
+    png->buffered += n;
+    rows += n * png->stride;
+    count -= n;
+
+    if (png->buffered == png->chunks * png->chunk_rows
+        || png->written + png->buffered == png->height)
+      flush_rows(png);
+  }
+}
+
+int png_write_end(struct png_writer* png) {
+  if (png->raw == NULL)
+    return 0;
+
+  int complete = png->written == png->height && !png->error;
+  if (complete) {
+    uint8_t adler[4];
+    put_u32(adler, png->adler);
+    write_chunk(png->fp, "IDAT", adler, 4);
+    write_chunk(png->fp, "IEND", NULL, 0);
+  }
+
+  free_writer(png);
+  return complete && !ferror(png->fp);
+}
+
+
+#define PNG_INPUT_BYTES (64 << 10)    /* IDAT bytes read at a time */
+
+/* adam7 pass origins and steps, pass 7 is every odd row */
+static const uint8_t adam7_x0[7] = { 0, 4, 0, 2, 0, 1, 0 };
+static const uint8_t adam7_y0[7] = { 0, 0, 4, 0, 2, 0, 1 };
+static const uint8_t adam7_dx[7] = { 8, 8, 4, 4, 2, 2, 1 };
+static const uint8_t adam7_dy[7] = { 8, 8, 8, 4, 4, 2, 2 };
+
+/* samples per pixel in the file by color type */
+static const uint8_t file_channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+
+struct png_decoder {
+  struct png_reader* png;
+  png_row_reader row_reader;
+  void* ctx;
+
+  uint8_t* input;       /* IDAT bytes handed to inflate */
+  int zlib_header;      /* zlib header bytes skipped so far */
+  uint8_t cmf;
+
+  uint8_t* row;         /* filter byte and the filtered row */
+  uint8_t* prev;        /* the reconstructed row above, zero for the first */
+  uint8_t* pixels;      /* the expanded row */
+  size_t filled;        /* bytes of row received */
+  size_t line;          /* filter byte and row bytes of this pass */
+  int bpp;              /* bytes per pixel for the filters, at least 1 */
+
+  int pass, y, rows, cols;
+  int done;             /* every row was reconstructed */
+  int ended;            /* the chunk after the last IDAT was reached */
+};
+
+
+static uint32_t get_u32(const uint8_t* p) {
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+/* reads the length and type of the next chunk, starting its crc */
+static int read_chunk_head(struct png_reader* png, uint32_t* length, char* type) {
+  uint8_t head[8];
+  if (fread(head, 1, 8, png->fp) != 8)
+    return 0;
+  *length = get_u32(head);
+  memcpy(type, head + 4, 4);
+  png->crc = deflate_crc32(0, head + 4, 4);
+  return *length <= 0x7FFFFFFF;
+}
+
+/* reads the crc that ends the chunk and compares it */
+static int check_chunk_crc(struct png_reader* png) {
+  uint8_t tail[4];
+  return fread(tail, 1, 4, png->fp) == 4 && get_u32(tail) == png->crc;
+}
+
+/* undoes the filter of row in place, vectorizes with a constant bpp */
+static inline void unfilter_pixels(int filter, uint8_t* restrict row,
+                                   const uint8_t* restrict prev, size_t stride, int bpp) {
+  size_t i;
+  switch (filter) {
+    case FILTER_SUB:
+      for (i = bpp; i < stride; i += bpp)
+        for (int k = 0; k < bpp; k++) row[i + k] += row[i + k - bpp];
+      break;
+    case FILTER_UP:
+      for (i = 0; i < stride; i++) row[i] += prev[i];
+      break;
+    case FILTER_AVERAGE:
+      for (i = 0; i < (size_t) bpp; i++) row[i] += prev[i] >> 1;
+      for (; i < stride; i += bpp)
+        for (int k = 0; k < bpp; k++) row[i + k] += (row[i + k - bpp] + prev[i + k]) >> 1;
+      break;
+    case FILTER_PAETH:
+      for (i = 0; i < (size_t) bpp; i++) row[i] += prev[i];
+      for (; i < stride; i += bpp)
+        for (int k = 0; k < bpp; k++)
+          row[i + k] += paeth(row[i + k - bpp], prev[i + k], prev[i + k - bpp]);
+      break;
+  }
+}
+
+/* a row is whole pixels of bpp bytes unless samples are under 8 bits,
+   then bpp is 1 */
+static int unfilter_row(int filter, uint8_t* row, const uint8_t* prev, size_t stride,
+                        int bpp) {
+  if (filter > FILTER_PAETH)
+    return 0;
+  switch (bpp) {
+    case 1:  unfilter_pixels(filter, row, prev, stride, 1); break;
+    case 2:  unfilter_pixels(filter, row, prev, stride, 2); break;
+    case 3:  unfilter_pixels(filter, row, prev, stride, 3); break;
+    case 4:  unfilter_pixels(filter, row, prev, stride, 4); break;
+    case 6:  unfilter_pixels(filter, row, prev, stride, 6); break;
+    default: unfilter_pixels(filter, row, prev, stride, 8); break;
+  }
+  return 1;
+}
+
+/* converts a reconstructed row of cols pixels to the decoded format */
+static const void* expand_row(const struct png_reader* png, const uint8_t* restrict in,
+                              int cols, void* out) {
+  int samples = cols * file_channels[png->color_type];
+
+  if (png->bit_depth == 16) {
+    uint16_t* restrict out16 = out;
+    for (int i = 0; i < samples; i++) {
+      out16[i] = (uint16_t) (in[2 * i] << 8 | in[2 * i + 1]);
+    }
+    return out;
+  }
+  if (png->bit_depth == 8 && png->color_type != 3)
+    return in;
+
+  // packed samples, msb first, then gray scaled to 8 bits or palette colors
+  uint8_t* restrict out8 = out;
+  int bits = png->bit_depth;
+  int mask = (1 << bits) - 1;
+  for (int i = 0; i < samples; i++) {
+    int shift = 8 - bits - (i * bits & 7);
+    int value = (in[i * bits >> 3] >> shift) & mask;
+    if (png->color_type == 3) {
+      memcpy(out8 + 3 * i, png->palette + 3 * value, 3);
+    } else {
+      out8[i] = (uint8_t) (value * (255 / mask));
+    }
+  }
+  return out;
+}
+
+/* moves to the next non empty pass, the first row of a pass has no row
+   above it */
+static void start_pass(struct png_decoder* d, int pass) {
+  struct png_reader* png = d->png;
+  int passes = png->interlace ? 7 : 1;
+
+  for (d->pass = pass; d->pass < passes; d->pass++) {
+    int x0 = png->interlace ? adam7_x0[d->pass] : 0;
+    int y0 = png->interlace ? adam7_y0[d->pass] : 0;
+    int dx = png->interlace ? adam7_dx[d->pass] : 1;
+    int dy = png->interlace ? adam7_dy[d->pass] : 1;
+    d->cols = png->width > x0 ? (png->width - x0 + dx - 1) / dx : 0;
+    d->rows = png->height > y0 ? (png->height - y0 + dy - 1) / dy : 0;
+    if (d->cols > 0 && d->rows > 0)
+      break;
+  }
+
+  d->done = d->pass == passes;
+  d->y = 0;
+  d->filled = 0;
+  if (!d->done) {
+    d->line = ((size_t) d->cols * file_channels[png->color_type] * png->bit_depth + 7) / 8 + 1;
+    memset(d->prev, 0, d->line);
+  }
+}
+
+/* reconstructs the complete row and hands it to the row reader */
+static int finish_row(struct png_decoder* d) {
+  struct png_reader* png = d->png;
+  size_t stride = d->line - 1;
+  uint8_t* row = d->row + 1;
+
+  if (!unfilter_row(d->row[0], row, d->prev + 1, stride, d->bpp))
+    return 0;
+
+  int x0 = 0, y = d->y, dx = 1;
+  if (png->interlace) {
+    x0 = adam7_x0[d->pass];
+    dx = adam7_dx[d->pass];
+    y = adam7_y0[d->pass] + d->y * adam7_dy[d->pass];
+  }
+  d->row_reader(d->ctx, expand_row(png, row, d->cols, d->pixels), y, x0, dx, d->cols);
+
+  uint8_t* swap = d->prev;
+  d->prev = d->row;
+  d->row = swap;
+  d->filled = 0;
+  if (++d->y == d->rows)
+    start_pass(d, d->pass + 1);
+  return 1;
+}
+
+/* inflate output, splits the stream into filtered rows */
+static int idat_output(void* ctx, const uint8_t* data, size_t length) {
+  struct png_decoder* d = ctx;
+  while (length > 0 && !d->done) {
+    size_t n = d->line - d->filled;
+    n = n < length ? n : length;
+    memcpy(d->row + d->filled, data, n);
+    d->filled += n;
+    data += n;
+    length -= n;
+    if (d->filled == d->line && !finish_row(d)) {
+      d->png->error = 1;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* inflate input, the data of consecutive IDAT chunks after the zlib
+   header, checking every chunk crc */
+static size_t idat_input(void* ctx, const uint8_t** data) {
+  struct png_decoder* d = ctx;
+  struct png_reader* png = d->png;
+
+  while (!png->error) {
+    if (png->idat_left == 0) {
+      uint32_t length;
+      char type[4];
+      if (!check_chunk_crc(png)) {
+        png->error = 1;
+        return 0;
+      }
+      if (!read_chunk_head(png, &length, type) || memcmp(type, "IDAT", 4) != 0) {
+        d->ended = 1;
+        return 0;
+      }
+      png->idat_left = length;
+      continue;
+    }
+
+    size_t n = png->idat_left < PNG_INPUT_BYTES ? png->idat_left : PNG_INPUT_BYTES;
+    if (fread(d->input, 1, n, png->fp) != n) {
+      png->error = 1;
+      return 0;
+    }
+    png->idat_left -= n;
+    png->crc = deflate_crc32(png->crc, d->input, n);
+    *data = d->input;
+
+    // deflate with a 32K window at most, no preset dictionary
+    for (; d->zlib_header < 2 && n > 0; d->zlib_header++, n--) {
+      if (d->zlib_header == 0) {
+        d->cmf = *(*data)++;
+      } else if ((d->cmf & 15) != 8 || d->cmf >> 4 > 7
+                 || (d->cmf * 256 + **data) % 31 != 0 || (**data & 0x20)) {
+        png->error = 1;
+        return 0;
+      } else {
+        (*data)++;
+      }
+    }
+    if (n > 0)
+      return n;
+  }
+  return 0;
+}
+
+
+int png_read_begin(struct png_reader* png, FILE* fp) {
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  // bit depths allowed for each color type
+  static const uint8_t depths[7] = { 1 | 2 | 4 | 8 | 16, 0, 8 | 16, 1 | 2 | 4 | 8, 8 | 16, 0, 8 | 16 };
+
+  uint8_t head[13];
+  uint32_t length;
+  char type[4];
+
+  memset(png, 0, sizeof(struct png_reader));
+  png->fp = fp;
+  if (fp == NULL || fread(head, 1, 8, fp) != 8 || memcmp(head, signature, 8) != 0
+      || !read_chunk_head(png, &length, type) || memcmp(type, "IHDR", 4) != 0
+      || length != 13 || fread(head, 1, 13, fp) != 13)
+    return 0;
+  png->crc = deflate_crc32(png->crc, head, 13);
+  if (!check_chunk_crc(png))
+    return 0;
+
+  uint32_t width = get_u32(head), height = get_u32(head + 4);
+  png->bit_depth = head[8];
+  png->color_type = head[9];
+  png->interlace = head[12];
+  if (width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF
+      || png->color_type > 6 || (png->bit_depth & (png->bit_depth - 1)) != 0
+      || !(depths[png->color_type] & png->bit_depth)
+      || head[10] != 0 || head[11] != 0 || png->interlace > 1)
+    return 0;
+
+  png->width = width;
+  png->height = height;
+  png->channels = png->color_type == 3 ? 3 : file_channels[png->color_type];
+  png->depth = png->bit_depth == 16 ? 16 : 8;
+
+  // ancillary chunks are skipped, the palette is kept
+  for (;;) {
+    if (!read_chunk_head(png, &length, type))
+      return 0;
+    if (memcmp(type, "IDAT", 4) == 0)
+      break;
+    if (memcmp(type, "IEND", 4) == 0)
+      return 0;
+    if (memcmp(type, "PLTE", 4) == 0) {
+      if (length % 3 != 0 || length > sizeof(png->palette)
+          || fread(png->palette, 1, length, fp) != length)
+        return 0;
+      png->palette_size = length / 3;
+      png->crc = deflate_crc32(png->crc, png->palette, length);
+      if (!check_chunk_crc(png))
+        return 0;
+    } else if (fseek(fp, (long) length + 4, SEEK_CUR) != 0) {
+      return 0;
+    }
+  }
+
+  if (png->color_type == 3 && png->palette_size == 0)
+    return 0;
+  png->idat_left = length;
+  return 1;
+}
+
+int png_read_image(struct png_reader* png, png_row_reader row_reader, void* ctx) {
+  struct png_decoder d;
+  int samples = file_channels[png->color_type];
+  size_t line = ((size_t) png->width * samples * png->bit_depth + 7) / 8 + 1;
+
+  memset(&d, 0, sizeof(struct png_decoder));
+  d.png = png;
+  d.row_reader = row_reader;
+  d.ctx = ctx;
+  d.bpp = samples * png->bit_depth < 8 ? 1 : samples * png->bit_depth / 8;
+  d.input = malloc(PNG_INPUT_BYTES);
+  d.row = malloc(line);
+  d.prev = malloc(line);
+  d.pixels = malloc((size_t) png->width * png->channels * png->depth / 8);
+
+  int ok = d.input && d.row && d.prev && d.pixels && !png->error;
+  if (ok) {
+    start_pass(&d, 0);
+    ok = inflate_raw(idat_input, idat_output, &d) && d.done && !png->error;
+  }
+
+  // the stream usually ends inside the last IDAT, its crc is still checked
+  while (ok && !d.ended && png->idat_left > 0) {
+    size_t n = png->idat_left < PNG_INPUT_BYTES ? png->idat_left : PNG_INPUT_BYTES;
+    ok = fread(d.input, 1, n, png->fp) == n;
+    png->crc = deflate_crc32(png->crc, d.input, n);
+    png->idat_left -= n;
+  }
+  if (ok && !d.ended)
+    ok = check_chunk_crc(png);
+
+  free(d.input);
+  free(d.row);
+  free(d.prev);
+  free(d.pixels);
+  return ok;
+}
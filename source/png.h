@@ -0,0 +1,127 @@
+/***********************************************************************
+* FILENAME :        png.h   png.c
+*
+* DESCRIPTION :
+*       Streaming compressed png encoder and decoder built on deflate.c
+*
+* PUBLIC FUNCTIONS :
+*       int  png_write_begin( struct png_writer* png, FILE* fp,
+*                             int width, int height, int channels,
+*                             int depth, int level )
+*       void png_write_rows( struct png_writer* png, const uint8_t* rows,
+*                            int count )
+*       int  png_write_end( struct png_writer* png )
+*       int  png_read_begin( struct png_reader* png, FILE* fp )
+*       int  png_read_image( struct png_reader* png,
+*                            png_row_reader row_reader, void* ctx )
+*
+* NOTES :
+*       Rows are pushed in order and buffered until there is one chunk of
+*       rows for every thread. Each chunk is filtered and deflated on its
+*       own thread [pigz style] and written as its own IDAT chunk, so only
+*       a few chunks of the image are ever held in memory.
+*       The decoder reads every color type, bit depth and interlace of
+*       the specification and passes one decoded row at a time on.
+*H*/
+
+#ifndef PNG_H_
+#define PNG_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define PNG_DEFAULT_LEVEL 6
+
+struct png_writer {
+  FILE* fp;
+  int width, height;
+  int channels, depth, level;
+  int bpp;              /* bytes per pixel for the filters, at least 1 */
+  size_t stride;        /* bytes in one unfiltered row */
+
+  int chunk_rows;       /* rows deflated together */
+  int chunks;           /* chunks compressed in parallel */
+  uint8_t* raw;         /* unfiltered rows of the pending chunks */
+  uint8_t* last_row;    /* last row before the pending chunks */
+  uint8_t** filtered;   /* per chunk filtered rows */
+  uint8_t** packed;     /* per chunk IDAT chunk */
+  size_t packed_size;
+
+  int buffered;         /* rows in raw */
+  int written;          /* rows already compressed */
+  uint32_t adler;
+  int error;
+};
+
+/**
+ * @brief Starts a png of @param width by @param height pixels
+ *
+ * Writes the signature, the header and the start of the zlib stream
+ * to @param fp. @param channels is 1 [gray], 2 [gray, alpha], 3 [RGB]
+ * or 4 [RGBA] with @param depth 8 or 16 bits per sample. @param level
+ * is the deflate level in [0, 9].
+ *
+ * @return 1 on success, 0 for unsupported formats or no memory
+ */
+int png_write_begin( struct png_writer* png, FILE* fp, int width, int height,
+                     int channels, int depth, int level );
+
+/**
+ * @brief Appends @param count rows of unfiltered pixels
+ *
+ * 16 bit samples are big endian as in the file.
+ */
+void png_write_rows( struct png_writer* png, const uint8_t* rows, int count );
+
+/**
+ * @brief Finishes the image and frees the writer
+ *
+ * @return 1 when every row was written, does not close the file
+ */
+int png_write_end( struct png_writer* png );
+
+/**
+ * @brief Receives the decoded pixels of one row of the image
+ *
+ * @param pixels are @param count pixels at x = @param x0 + i * @param dx
+ * of row @param y, dx is 1 unless the image is interlaced.
+ */
+typedef void (*png_row_reader)( void* ctx, const void* pixels, int y, int x0, int dx,
+                                int count );
+
+struct png_reader {
+  FILE* fp;
+  int width, height;
+  int channels;         /* decoded samples per pixel, palettes become RGB */
+  int depth;            /* decoded bits per sample, 8 or 16 */
+  int color_type, bit_depth, interlace;    /* as stored */
+  int palette_size;
+  uint8_t palette[768];
+  uint32_t idat_left;   /* bytes left in the current IDAT chunk */
+  uint32_t crc;         /* of the current chunk */
+  int error;
+};
+
+/**
+ * @brief Reads the png header of @param fp up to the image data
+ *
+ * Fills in the image size and the decoded format: gray, gray alpha, RGB
+ * or RGBA with 8 or 16 bit samples. Palettes are expanded to RGB and 1,
+ * 2 and 4 bit gray is scaled to 8 bits.
+ *
+ * @return 1 on success, 0 when the file is not a valid png
+ */
+int png_read_begin( struct png_reader* png, FILE* fp );
+
+/**
+ * @brief Decodes the image and passes every row to @param row_reader
+ *
+ * Rows come in file order, interlaced images pass by pass. 16 bit
+ * samples are in host byte order. Does not close the file.
+ *
+ * @return 1 when the whole image was decoded, 0 on corrupt data
+ */
+int png_read_image( struct png_reader* png, png_row_reader row_reader, void* ctx );
+
+#endif
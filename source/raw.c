@@ -0,0 +1,313 @@
+/***********************************************************************
+* FILENAME :        raw.h   raw.c
+*
+* DESCRIPTION :
+*       Raw little endian heightfield export and import [.r16 / .raw]
+*       with a small text sidecar describing the size and scale
+*
+* PUBLIC FUNCTIONS :
+*       void   export_raw( float* heightmap, int map_size, int format,
+*                          float scale, char* filename )
+*       float* import_raw( char* filename, int* map_size )
+*       int    map_raw( struct raw_map* map, char* filename, int mode )
+*       void   sync_raw( struct raw_map* map )
+*       void   unmap_raw( struct raw_map* map )
+*
+* PRIVATE FUNCTIONS :
+*       meta_name, write_meta, read_meta, map_file, unmap_file
+*
+* NOTES :
+*       Samples are converted in parallel and moved with one fwrite, or
+*       one mmap on import, so a round trip costs about the disk
+*       bandwidth. Windows and the Webassembly VFS read the file with
+*       fread instead of mmap. Assumes a little endian host [x86, ARM,
+*       Webassembly]. map_raw hands out the mapping of an unscaled f32
+*       file itself as the heightmap, any other file is imported into a
+*       copy.
+*H*/
+
+#include "raw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define RAW_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define META_EXT ".meta"
+
+static const char* format_names[] = { "r16", "f32" };
+static const size_t format_bytes[] = { sizeof(uint16_t), sizeof(float) };
+
+
+/* filename with the sidecar extension, free with free */
+static char* meta_name(const char* filename) {
+  char* name = malloc(strlen(filename) + sizeof(META_EXT));
+  if (name != NULL) {
+    strcpy(name, filename);
+    strcat(name, META_EXT);
+  }
+  return name;
+}
+
+static void write_meta(const char* filename, int format, int map_size, float scale) {
+  char* name = meta_name(filename);
+  FILE* fp = name ? fopen(name, "w") : NULL;
+  free(name);
+
+  if (fp == NULL)
+    return;
+
+  fprintf(fp, "# Exported from Hydraulic Erosion https://github.com/mustartt/hydraulic-erosion\n");
+  fprintf(fp, "format %s\n", format_names[format]);
+  fprintf(fp, "size %d\n", map_size);
+  fprintf(fp, "scale %.9g\n", scale);
+  fclose(fp);
+}
+
+/* reads the sidecar, returns 0 when it is missing or incomplete */
+static int read_meta(const char* filename, int* format, int* map_size, float* scale) {
+  char* name = meta_name(filename);
+  FILE* fp = name ? fopen(name, "r") : NULL;
+  free(name);
+
+  if (fp == NULL)
+    return 0;
+
+  char line[256], key[32], value[64];
+  *format = -1;
+  *map_size = 0;
+  *scale = 1;
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' || sscanf(line, "%31s %63s", key, value) != 2)
+      continue;
+    if (strcmp(key, "format") == 0)
+      *format = strcmp(value, "r16") == 0 ? RAW_R16 : strcmp(value, "f32") == 0 ? RAW_F32 : -1;
+    else if (strcmp(key, "size") == 0)
+      *map_size = atoi(value);
+    else if (strcmp(key, "scale") == 0)
+      *scale = (float) atof(value);
+  }
+  fclose(fp);
+  return *format >= 0 && *map_size > 0 && *scale != 0;
+}
+
+
+/* maps length bytes of the file read only, *handle is passed to unmap */
+static const void* map_file(const char* filename, size_t length, void** handle) {
+  *handle = NULL;
+#ifdef RAW_MMAP
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size != length) {
+    close(fd);
+    return NULL;
+  }
+  void* data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return NULL;
+  madvise(data, length, MADV_SEQUENTIAL);
+  *handle = data;
+  return data;
+#else
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL)
+    return NULL;
+  void* data = malloc(length + 1);
+  // one extra byte detects files longer than expected
+  if (data == NULL || fread(data, 1, length + 1, fp) != length) {
+    free(data);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+  *handle = data;
+  return data;
+#endif
+}
+
+static void unmap_file(void* handle, size_t length) {
+#ifdef RAW_MMAP
+  munmap(handle, length);
+#else
+  free(handle);
+#endif
+}
+
+
+void export_raw(float* heightmap, int map_size, int format, float scale, char* filename) {
+  if (format != RAW_R16 && format != RAW_F32)
+    return;
+
+  FILE* fp = fopen(filename, "wb");
+
+  if (fp == NULL)
+    return;
+
+  size_t count = (size_t) map_size * map_size;
+
+  if (format == RAW_F32 && scale == 1) {
+    // already in the file layout
+    fwrite(heightmap, sizeof(float), count, fp);
+  } else {
+    void* buffer = malloc(count * format_bytes[format]);
+    if (buffer == NULL) {
+      fclose(fp);
+      return;
+    }
+
+    if (format == RAW_R16) {
+      uint16_t* samples = buffer;
+      float inv_scale = 1.0f / scale;
+      #pragma omp parallel for schedule(static)
+      for (size_t i = 0; i < count; i++) {
+        float val = heightmap[i] * inv_scale;
+        val = val < 0 ? 0 : val > 1 ? 1 : val;
+        samples[i] = (uint16_t) (val * 65535 + 0.5f);
+      }
+    } else {
+      float* samples = buffer;
+      #pragma omp parallel for schedule(static)
+      for (size_t i = 0; i < count; i++) {
+        samples[i] = heightmap[i] / scale;
+      }
+    }
+
+    fwrite(buffer, format_bytes[format], count, fp);
+    free(buffer);
+  }
+
+  fclose(fp);
+  write_meta(filename, format, map_size, scale);
+}
+
+float* import_raw(char* filename, int* map_size) {
+  int format, size;
+  float scale;
+
+  if (!read_meta(filename, &format, &size, &scale))
+    return NULL;
+
+  size_t count = (size_t) size * size;
+  void* handle;
+  const void* data = map_file(filename, count * format_bytes[format], &handle);
+  float* heightmap = malloc(count * sizeof(float));
+
+  if (data == NULL || heightmap == NULL) {
+    if (data != NULL)
+      unmap_file(handle, count * format_bytes[format]);
+    free(heightmap);
+    return NULL;
+  }
+
+  if (format == RAW_R16) {
+    const uint16_t* samples = data;
+    float step = scale / 65535;
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; i++) {
+      heightmap[i] = samples[i] * step;
+    }
+  } else {
+    const float* samples = data;
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; i++) {
+      heightmap[i] = samples[i] * scale;
+    }
+  }
+
+  unmap_file(handle, count * format_bytes[format]);
+  *map_size = size;
+  return heightmap;
+}
+
+int map_raw(struct raw_map* map, char* filename, int mode) {
+  int format, size;
+  float scale;
+
+  memset(map, 0, sizeof(struct raw_map));
+  if (!read_meta(filename, &format, &size, &scale))
+    return 0;
+
+  map->map_size = size;
+  map->mode = mode;
+  map->length = (size_t) size * size * sizeof(float);
+
+#ifdef RAW_MMAP
+  // only unscaled floats are already heights, the rest is converted
+  if (format == RAW_F32 && scale == 1) {
+    int fd = open(filename, mode == RAW_MAP_SHARED ? O_RDWR : O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+      return 0;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != map->length) {
+      close(fd);
+      return 0;
+    }
+    void* data = mmap(NULL, map->length, PROT_READ | PROT_WRITE,
+                      mode == RAW_MAP_SHARED ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+      return 0;
+    map->heightmap = data;
+    map->mapped = 1;
+    return 1;
+  }
+#endif
+
+  int imported;
+  map->heightmap = import_raw(filename, &imported);
+  if (map->heightmap == NULL)
+    return 0;
+
+  // a shared copy is written back in its own format on sync
+  if (mode == RAW_MAP_SHARED) {
+    map->filename = malloc(strlen(filename) + 1);
+    if (map->filename == NULL) {
+      free(map->heightmap);
+      map->heightmap = NULL;
+      return 0;
+    }
+    strcpy(map->filename, filename);
+    map->format = format;
+    map->scale = scale;
+  }
+  return 1;
+}
+
+void sync_raw(struct raw_map* map) {
+  if (map->heightmap == NULL || map->mode != RAW_MAP_SHARED)
+    return;
+#ifdef RAW_MMAP
+  if (map->mapped) {
+    msync(map->heightmap, map->length, MS_SYNC);
+    return;
+  }
+#endif
+  export_raw(map->heightmap, map->map_size, map->format, map->scale, map->filename);
+}
+
+void unmap_raw(struct raw_map* map) {
+  if (map->heightmap == NULL)
+    return;
+  sync_raw(map);
+#ifdef RAW_MMAP
+  if (map->mapped)
+    munmap(map->heightmap, map->length);
+  else
+    free(map->heightmap);
+#else
+  free(map->heightmap);
+#endif
+  free(map->filename);
+  memset(map, 0, sizeof(struct raw_map));
+}
@@ -0,0 +1,112 @@
+/***********************************************************************
+* FILENAME :        raw.h   raw.c
+*
+* DESCRIPTION :
+*       Raw little endian heightfield export and import [.r16 / .raw]
+*       with a small text sidecar describing the size and scale
+*
+* PUBLIC FUNCTIONS :
+*       void   export_raw( float* heightmap, int map_size, int format,
+*                          float scale, char* filename )
+*       float* import_raw( char* filename, int* map_size )
+*       int    map_raw( struct raw_map* map, char* filename, int mode )
+*       void   sync_raw( struct raw_map* map )
+*       void   unmap_raw( struct raw_map* map )
+*
+* NOTES :
+*       The sidecar is written next to the heightfield as filename.meta,
+*       one "key value" pair per line [format, size, scale]. Stored values
+*       are height / scale, r16 samples are additionally clamped to [0, 1]
+*       and mapped to [0, 65535] the way game engines expect.
+*       A f32 file with scale 1 is exactly the heightmap in memory, so
+*       map_raw uses its mapping directly without reading it: pages load
+*       on first touch and startup costs the same for any map size.
+*H*/
+
+#ifndef RAW_H_
+#define RAW_H_
+
+#include <stddef.h>
+
+/**
+ * @brief Sample formats of the raw heightfield
+ */
+enum raw_format {
+  RAW_R16 = 0,    /* unsigned 16 bit integers */
+  RAW_F32 = 1     /* 32 bit floats */
+};
+
+/**
+ * @brief How map_raw shares the heightmap with the file
+ */
+enum raw_map_mode {
+  RAW_MAP_PRIVATE = 0,    /* copy on write, the file is never changed */
+  RAW_MAP_SHARED  = 1     /* changes are written to the file */
+};
+
+struct raw_map {
+  float* heightmap;
+  int map_size;
+  int mode;
+  size_t length;          /* bytes of the heightmap */
+  int mapped;             /* heightmap is the file mapping, else a copy */
+  int format;             /* what a shared copy is written back as */
+  float scale;
+  char* filename;
+};
+
+/**
+ * @brief Export heightmap as a raw heightfield with a sidecar
+ *
+ * Exports the @param heightmap with @param map_size as row major little
+ * endian samples of @param format with one bulk write, and writes the
+ * size and @param scale to filename.meta.
+ *
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param format    RAW_R16 or RAW_F32
+ * @param scale     the height of a stored 1 [r16: 65535]
+ * @param filename  the filename [include extension]
+ */
+void export_raw( float* heightmap, int map_size, int format, float scale, char* filename );
+
+/**
+ * @brief Imports a raw heightfield written by export_raw
+ *
+ * Reads filename.meta, maps the heightfield into memory [read into a
+ * buffer where mmap is not available] and converts it back to heights.
+ *
+ * @param filename  the filename [include extension]
+ * @param map_size  set to the heightmap size
+ * @return          the heightmap [free with free], NULL on failure
+ */
+float* import_raw( char* filename, int* map_size );
+
+/**
+ * @brief Uses a raw heightfield as the heightmap without copying it
+ *
+ * A f32 file with scale 1 is memory mapped and its mapping is the
+ * heightmap, read and written in place. RAW_MAP_PRIVATE maps it copy on
+ * write so the file stays as it was, RAW_MAP_SHARED writes the changes
+ * back to the file. Other formats, and hosts without mmap [Windows and
+ * the Webassembly VFS], import the file into a copy instead, which a
+ * shared map writes back on sync.
+ *
+ * @param map       filled in with the heightmap and its size
+ * @param filename  the filename [include extension]
+ * @param mode      a raw_map_mode
+ * @return          1 on success, 0 when the file could not be mapped
+ */
+int map_raw( struct raw_map* map, char* filename, int mode );
+
+/**
+ * @brief Writes the changes of a shared map to its file
+ */
+void sync_raw( struct raw_map* map );
+
+/**
+ * @brief Syncs a shared map and releases the heightmap
+ */
+void unmap_raw( struct raw_map* map );
+
+#endif
@@ -0,0 +1,159 @@
+/***********************************************************************
+* FILENAME :        resample.h   resample.c
+*
+* DESCRIPTION :
+*       Resamples heightmaps to any resolution with an area [box] or a
+*       Lanczos filter, for reduced resolution exports and previews
+*
+* PUBLIC FUNCTIONS :
+*       float* resample( const float* heightmap, int map_size, int size,
+*                        int filter )
+*
+* PRIVATE FUNCTIONS :
+*       lanczos, build_taps, free_taps, sum_rows
+*
+* NOTES :
+*       The taps of an output pixel are the source pixels under its filter
+*       with normalized weights, the same for rows and columns since the
+*       maps are square. Taps past the edge are clamped to the edge pixel.
+*H*/
+
+#include "resample.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define LANCZOS_LOBES 3
+#define RESAMPLE_PI   3.14159265358979323846
+
+/* taps of every output pixel, index and weight [pixel * taps + tap] */
+struct filter_taps {
+  int taps;
+  int* index;
+  float* weight;
+};
+
+
+static double lanczos(double x) {
+  if (x == 0)
+    return 1;
+  if (fabs(x) >= LANCZOS_LOBES)
+    return 0;
+  double px = RESAMPLE_PI * x;
+  return LANCZOS_LOBES * sin(px) * sin(px / LANCZOS_LOBES) / (px * px);
+}
+
+static int build_taps(struct filter_taps* f, int map_size, int size, int filter) {
+  double scale = (double) map_size / size;
+  // the filter widens when downsampling so it covers every source pixel
+  double support = filter == RESAMPLE_LANCZOS ? LANCZOS_LOBES * (scale > 1 ? scale : 1)
+                                              : scale / 2;
+  f->taps = (int) ceil(2 * support) + 2;
+  f->index = malloc((size_t) size * f->taps * sizeof(int));
+  f->weight = malloc((size_t) size * f->taps * sizeof(float));
+  if (f->index == NULL || f->weight == NULL)
+    return 0;
+
+  for (int j = 0; j < size; j++) {
+    int* index = f->index + (size_t) j * f->taps;
+    float* weight = f->weight + (size_t) j * f->taps;
+    double center = (j + 0.5) * scale;   /* in source pixel edges */
+    int first = (int) floor(center - support - 0.5);
+    double sum = 0;
+
+    for (int k = 0; k < f->taps; k++) {
+      int i = first + k;
+      double w;
+      if (filter == RESAMPLE_LANCZOS) {
+        w = lanczos((i + 0.5 - center) / (scale > 1 ? scale : 1));
+      } else {
+        // overlap of source pixel [i, i + 1) with the output pixel
+        double lo = fmax(i, center - support);
+        double hi = fmin(i + 1, center + support);
+        w = hi > lo ? hi - lo : 0;
+      }
+      index[k] = i < 0 ? 0 : i >= map_size ? map_size - 1 : i;
+      weight[k] = (float) w;
+      sum += w;
+    }
+    for (int k = 0; k < f->taps; k++) {
+      weight[k] = (float) (weight[k] / sum);
+    }
+  }
+  return 1;
+}
+
+static void free_taps(struct filter_taps* f) {
+  free(f->index);
+  free(f->weight);
+}
+
+/* acc = sum of the source rows under the taps, vectorizes over the row */
+static void sum_rows(const float* heightmap, int map_size, const int* index,
+                     const float* weight, int taps, float* restrict acc) {
+  const float* restrict row = heightmap + (size_t) index[0] * map_size;
+  float w = weight[0];
+  for (int x = 0; x < map_size; x++) {
+    acc[x] = w * row[x];
+  }
+  for (int k = 1; k < taps; k++) {
+    if (weight[k] == 0)
+      continue;
+    row = heightmap + (size_t) index[k] * map_size;
+    w = weight[k];
+    for (int x = 0; x < map_size; x++) {
+      acc[x] += w * row[x];
+    }
+  }
+}
+
+
+float* resample(const float* heightmap, int map_size, int size, int filter) {
+  if (size < 1 || map_size < 1)
+    return NULL;
+
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  struct filter_taps f;
+  float* out = malloc((size_t) size * size * sizeof(float));
+  float* rows = malloc((size_t) threads * map_size * sizeof(float));
+  if (!build_taps(&f, map_size, size, filter) || out == NULL || rows == NULL) {
+    free_taps(&f);
+    free(out);
+    free(rows);
+    return NULL;
+  }
+
+  #pragma omp parallel for schedule(static)
+  for (int y = 0; y < size; y++) {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    float* acc = rows + (size_t) thread * map_size;
+    sum_rows(heightmap, map_size, f.index + (size_t) y * f.taps,
+             f.weight + (size_t) y * f.taps, f.taps, acc);
+
+    // then across the summed row
+    float* line = out + (size_t) y * size;
+    for (int x = 0; x < size; x++) {
+      const int* index = f.index + (size_t) x * f.taps;
+      const float* weight = f.weight + (size_t) x * f.taps;
+      float h = 0;
+      for (int k = 0; k < f.taps; k++) {
+        h += weight[k] * acc[index[k]];
+      }
+      line[x] = h;
+    }
+  }
+
+  free_taps(&f);
+  free(rows);
+  return out;
+}
@@ -0,0 +1,49 @@
+/***********************************************************************
+* FILENAME :        resample.h   resample.c
+*
+* DESCRIPTION :
+*       Resamples heightmaps to any resolution with an area [box] or a
+*       Lanczos filter, for reduced resolution exports and previews
+*
+* PUBLIC FUNCTIONS :
+*       float* resample( const float* heightmap, int map_size, int size,
+*                        int filter )
+*
+* NOTES :
+*       Both filters are separable. Every output row first sums the
+*       source rows under the filter into a row buffer, then filters
+*       that row across, so the whole map is resampled in one parallel
+*       pass over the output rows without an intermediate map. The row
+*       sums run over contiguous rows and vectorize.
+*       Pixels are areas, output pixel j covers source columns
+*       [j * map_size / size, (j + 1) * map_size / size), and the map edge
+*       is extended by its last pixel.
+*H*/
+
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+/**
+ * @brief Resampling filters
+ */
+enum resample_filter {
+  RESAMPLE_BOX = 0,       /* mean of the covered area, never overshoots */
+  RESAMPLE_LANCZOS = 1    /* Lanczos 3, sharper, may overshoot at steps */
+};
+
+/**
+ * @brief Resamples the heightmap to @param size per side
+ *
+ * Downsampling averages every source pixel under an output pixel
+ * instead of picking one, so thin eroded channels do not alias.
+ *
+ * @param heightmap the heightmap to resample
+ * @param map_size  the heightmap size
+ * @param size      the output size, larger or smaller than map_size
+ * @param filter    RESAMPLE_BOX or RESAMPLE_LANCZOS
+ * @return          the resampled heightmap [free with free], NULL on
+ *                  failure
+ */
+float* resample( const float* heightmap, int map_size, int size, int filter );
+
+#endif
@@ -0,0 +1,289 @@
+/***********************************************************************
+* FILENAME :        rtin.h   rtin.c
+*
+* DESCRIPTION :
+*       Right triangulated irregular network [RTIN] mesher, builds an
+*       error hierarchy over the heightmap once and extracts meshes for
+*       any maximum vertical error
+*
+* PUBLIC FUNCTIONS :
+*       int  rtin_init( struct rtin* rtin, float* heightmap, int map_size )
+*       void rtin_free( struct rtin* rtin )
+*       int  rtin_mesh( struct rtin* rtin, float max_error,
+*                       struct rtin_mesh* mesh )
+*       void rtin_mesh_free( struct rtin_mesh* mesh )
+*
+* PRIVATE FUNCTIONS :
+*       resample_grid, triangle_coords, triangle_error, mesh_vertex,
+*       extract_triangles
+*
+* NOTES :
+*       Triangles are numbered as in a binary tree, the two roots split
+*       the square along its diagonal and every triangle splits at the
+*       midpoint of its hypotenuse. The error stored at a midpoint is the
+*       largest distance between the grid and the plane of the triangles
+*       split there, measured over every grid point they cover, so meshes
+*       honour the error bound exactly. Errors are accumulated from the
+*       finest level up, so a vertex error is never smaller than the errors
+*       of the vertices it depends on and extracted meshes have no cracks.
+*H*/
+
+#include "rtin.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/* bilinear resample of the heightmap onto a grid_size grid */
+static float* resample_grid(float* heightmap, int map_size, int grid_size) {
+  float* grid = malloc((size_t) grid_size * grid_size * sizeof(float));
+  if (grid == NULL)
+    return NULL;
+
+  float step = (float) (map_size - 1) / (grid_size - 1);
+  #pragma omp parallel for schedule(static)
+  for (int y = 0; y < grid_size; y++) {
+    float v = y * step;
+    int y0 = (int) v < map_size - 1 ? (int) v : map_size - 2;
+    float ty = v - y0;
+    for (int x = 0; x < grid_size; x++) {
+      float u = x * step;
+      int x0 = (int) u < map_size - 1 ? (int) u : map_size - 2;
+      float tx = u - x0;
+      const float* row0 = heightmap + (size_t) y0 * map_size;
+      const float* row1 = row0 + map_size;
+      float top = row0[x0] + (row0[x0 + 1] - row0[x0]) * tx;
+      float bot = row1[x0] + (row1[x0 + 1] - row1[x0]) * tx;
+      grid[(size_t) y * grid_size + x] = top + (bot - top) * ty;
+    }
+  }
+  return grid;
+}
+
+/* hypotenuse end points a and b of triangle id [the tree index + 2] */
+static void triangle_coords(uint32_t id, int tile, int* ax, int* ay, int* bx, int* by) {
+  int x0 = 0, y0 = 0, x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+  if (id & 1) {
+    x1 = y1 = x2 = tile;          /* bottom left triangle */
+  } else {
+    x0 = y0 = y2 = tile;          /* top right triangle */
+  }
+  while ((id >>= 1) > 1) {
+    int mx = (x0 + x1) >> 1;
+    int my = (y0 + y1) >> 1;
+    if (id & 1) {                 /* left half */
+      x1 = x0; y1 = y0;
+      x0 = x2; y0 = y2;
+    } else {                      /* right half */
+      x0 = x1; y0 = y1;
+      x1 = x2; y1 = y2;
+    }
+    x2 = mx; y2 = my;
+  }
+  *ax = x0; *ay = y0;
+  *bx = x1; *by = y1;
+}
+
+/* narrows [*x0, *x1] of row y to the side of edge p -> q where the edge
+   function times sign is non negative, rtin edges are horizontal,
+   vertical or diagonal so the unit direction keeps it integral */
+static inline void clip_span(int px, int py, int qx, int qy, int y, int sign, int* x0, int* x1) {
+  int ux = (qx > px) - (qx < px);
+  int uy = (qy > py) - (qy < py);
+  int m = -uy * sign;
+  int k = (ux * (y - py) + uy * px) * sign;
+  if (m > 0) {
+    *x0 = -k > *x0 ? -k : *x0;
+  } else if (m < 0) {
+    *x1 = k < *x1 ? k : *x1;
+  } else if (k < 0) {
+    *x1 = *x0 - 1;
+  }
+}
+
+/* largest vertical distance between the grid inside triangle (a, b, c)
+   and the plane through its corners */
+static float triangle_error(const float* h, int size, int ax, int ay,
+                            int bx, int by, int cx, int cy) {
+  int area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+  int sign = area > 0 ? 1 : -1;
+  float ha = h[(size_t) ay * size + ax];
+  float hb = h[(size_t) by * size + bx];
+  float hc = h[(size_t) cy * size + cx];
+  float gx = ((hb - ha) * (cy - ay) - (hc - ha) * (by - ay)) / area;
+  float gy = ((hc - ha) * (bx - ax) - (hb - ha) * (cx - ax)) / area;
+
+  int x0 = ax < bx ? ax : bx, x1 = ax < bx ? bx : ax;
+  int y0 = ay < by ? ay : by, y1 = ay < by ? by : ay;
+  x0 = cx < x0 ? cx : x0; x1 = cx > x1 ? cx : x1;
+  y0 = cy < y0 ? cy : y0; y1 = cy > y1 ? cy : y1;
+
+  float error = 0;
+  for (int y = y0; y <= y1; y++) {
+    // inside [or on an edge] where the edge functions agree with the area
+    int lo = x0, hi = x1;
+    clip_span(ax, ay, bx, by, y, sign, &lo, &hi);
+    clip_span(bx, by, cx, cy, y, sign, &lo, &hi);
+    clip_span(cx, cy, ax, ay, y, sign, &lo, &hi);
+
+    const float* row = h + (size_t) y * size;
+    float base = ha + gy * (y - ay) - gx * ax;
+    for (int x = lo; x <= hi; x++) {
+      error = fmaxf(error, fabsf(row[x] - (base + gx * x)));
+    }
+  }
+  return error;
+}
+
+
+int rtin_init(struct rtin* rtin, float* heightmap, int map_size) {
+  memset(rtin, 0, sizeof(struct rtin));
+  if (map_size < 2)
+    return 0;
+
+  int tile = 1;
+  while (tile < map_size - 1) {
+    tile <<= 1;
+  }
+  int size = tile + 1;
+
+  rtin->grid_size = size;
+  rtin->owns_heights = size != map_size;
+  rtin->heights = rtin->owns_heights ? resample_grid(heightmap, map_size, size) : heightmap;
+  rtin->errors = calloc((size_t) size * size, sizeof(float));
+  float* level_errors = malloc((size_t) tile * tile * sizeof(float));
+  uint32_t* level_middles = malloc((size_t) tile * tile * sizeof(uint32_t));
+  if (rtin->heights == NULL || rtin->errors == NULL
+      || level_errors == NULL || level_middles == NULL) {
+    free(level_errors);
+    free(level_middles);
+    rtin_free(rtin);
+    return 0;
+  }
+
+  const float* h = rtin->heights;
+  float* errors = rtin->errors;
+  int finest = tile * tile;
+
+  // triangle ids [first, 2 * first) form one level, finest level first so
+  // every child is done before its parent. Both triangles of a diamond
+  // share a midpoint, so a level is measured in parallel and merged after
+  for (int first = finest; first >= 2; first >>= 1) {
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < first; i++) {
+      int ax, ay, bx, by;
+      triangle_coords(first + i, tile, &ax, &ay, &bx, &by);
+      int mx = (ax + bx) >> 1, my = (ay + by) >> 1;
+      int cx = mx + my - ay, cy = my + ax - mx;
+
+      float error = triangle_error(h, size, ax, ay, bx, by, cx, cy);
+      if (first < finest) {
+        size_t left  = (size_t) ((ay + cy) >> 1) * size + ((ax + cx) >> 1);
+        size_t right = (size_t) ((by + cy) >> 1) * size + ((bx + cx) >> 1);
+        error = fmaxf(error, fmaxf(errors[left], errors[right]));
+      }
+      level_errors[i] = error;
+      level_middles[i] = (uint32_t) my * size + mx;
+    }
+
+    for (int i = 0; i < first; i++) {
+      errors[level_middles[i]] = fmaxf(errors[level_middles[i]], level_errors[i]);
+    }
+  }
+
+  free(level_errors);
+  free(level_middles);
+  return 1;
+}
+
+void rtin_free(struct rtin* rtin) {
+  if (rtin->owns_heights)
+    free(rtin->heights);
+  free(rtin->errors);
+  memset(rtin, 0, sizeof(struct rtin));
+}
+
+
+struct extract {
+  const struct rtin* rtin;
+  float max_error;
+  uint32_t* index;        /* 1 + vertex index per grid vertex, 0 if unused */
+  struct rtin_mesh* mesh;
+};
+
+/* vertex index of grid vertex (x, y), added on first use */
+static uint32_t mesh_vertex(struct extract* e, int x, int y) {
+  uint32_t* slot = e->index + (size_t) y * e->rtin->grid_size + x;
+  if (*slot == 0) {
+    struct rtin_mesh* mesh = e->mesh;
+    if (mesh->vertices != NULL) {
+      mesh->vertices[2 * mesh->vertex_count]     = x;
+      mesh->vertices[2 * mesh->vertex_count + 1] = y;
+    }
+    *slot = ++mesh->vertex_count;
+  }
+  return *slot - 1;
+}
+
+/* splits triangle (a, b, c) while its error is too large */
+static void extract_triangles(struct extract* e, int ax, int ay, int bx, int by, int cx, int cy) {
+  int mx = (ax + bx) >> 1, my = (ay + by) >> 1;
+  int size = e->rtin->grid_size;
+
+  if (abs(ax - cx) + abs(ay - cy) > 1 && e->rtin->errors[(size_t) my * size + mx] > e->max_error) {
+    extract_triangles(e, cx, cy, ax, ay, mx, my);
+    extract_triangles(e, bx, by, cx, cy, mx, my);
+    return;
+  }
+
+  struct rtin_mesh* mesh = e->mesh;
+  uint32_t a = mesh_vertex(e, ax, ay);
+  uint32_t b = mesh_vertex(e, bx, by);
+  uint32_t c = mesh_vertex(e, cx, cy);
+  if (mesh->triangles != NULL) {
+    uint32_t* t = mesh->triangles + 3 * (size_t) mesh->triangle_count;
+    t[0] = a;
+    t[1] = b;
+    t[2] = c;
+  }
+  mesh->triangle_count++;
+}
+
+int rtin_mesh(struct rtin* rtin, float max_error, struct rtin_mesh* mesh) {
+  int size = rtin->grid_size, tile = size - 1;
+  struct extract e = { rtin, max_error, NULL, mesh };
+
+  memset(mesh, 0, sizeof(struct rtin_mesh));
+  mesh->grid_size = size;
+  e.index = calloc((size_t) size * size, sizeof(uint32_t));
+  if (e.index == NULL)
+    return 0;
+
+  // count, then allocate and fill with the same traversal
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      mesh->vertices = malloc(2 * (size_t) mesh->vertex_count * sizeof(uint32_t));
+      mesh->triangles = malloc(3 * (size_t) mesh->triangle_count * sizeof(uint32_t));
+      if (mesh->vertices == NULL || mesh->triangles == NULL) {
+        free(e.index);
+        rtin_mesh_free(mesh);
+        return 0;
+      }
+      memset(e.index, 0, (size_t) size * size * sizeof(uint32_t));
+      mesh->vertex_count = 0;
+      mesh->triangle_count = 0;
+    }
+    extract_triangles(&e, 0, 0, tile, tile, tile, 0);
+    extract_triangles(&e, tile, tile, 0, 0, 0, tile);
+  }
+
+  free(e.index);
+  return 1;
+}
+
+void rtin_mesh_free(struct rtin_mesh* mesh) {
+  free(mesh->vertices);
+  free(mesh->triangles);
+  memset(mesh, 0, sizeof(struct rtin_mesh));
+}
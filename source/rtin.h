@@ -0,0 +1,76 @@
+/***********************************************************************
+* FILENAME :        rtin.h   rtin.c
+*
+* DESCRIPTION :
+*       Right triangulated irregular network [RTIN] mesher, builds an
+*       error hierarchy over the heightmap once and extracts meshes for
+*       any maximum vertical error
+*
+* PUBLIC FUNCTIONS :
+*       int  rtin_init( struct rtin* rtin, float* heightmap, int map_size )
+*       void rtin_free( struct rtin* rtin )
+*       int  rtin_mesh( struct rtin* rtin, float max_error,
+*                       struct rtin_mesh* mesh )
+*       void rtin_mesh_free( struct rtin_mesh* mesh )
+*
+* NOTES :
+*       The hierarchy needs a 2^k + 1 grid, other map sizes are bilinearly
+*       resampled onto the next such grid covering the same area. Every
+*       grid point is within max_error of the extracted surface.
+*       note: see Evans et al. Right-Triangulated Irregular Networks [2001]
+*       and https://github.com/mapbox/martini
+*H*/
+
+#ifndef RTIN_H_
+#define RTIN_H_
+
+#include <stdint.h>
+
+struct rtin {
+  int grid_size;        /* 2^k + 1 */
+  float* heights;       /* grid_size^2 heights */
+  float* errors;        /* error of splitting at each grid vertex */
+  int owns_heights;     /* heights were resampled */
+};
+
+struct rtin_mesh {
+  int grid_size;
+  int vertex_count;
+  int triangle_count;
+  uint32_t* vertices;   /* x, y grid coordinates per vertex */
+  uint32_t* triangles;  /* 3 vertex indices per triangle, counter clockwise
+                           seen from above when grid y is the mesh z axis */
+};
+
+/**
+ * @brief Builds the error hierarchy of @param heightmap
+ *
+ * @param rtin      the mesher to initialize
+ * @param heightmap the heightmap, must outlive @param rtin when it is
+ *                  already 2^k + 1 in size
+ * @param map_size  the heightmap size
+ * @return          1 on success, 0 when out of memory
+ */
+int rtin_init( struct rtin* rtin, float* heightmap, int map_size );
+
+/**
+ * @brief Frees the error hierarchy
+ */
+void rtin_free( struct rtin* rtin );
+
+/**
+ * @brief Extracts the coarsest mesh within @param max_error of the grid
+ *
+ * @param rtin      the initialized mesher
+ * @param max_error the largest vertical error allowed
+ * @param mesh      the extracted mesh, free with rtin_mesh_free
+ * @return          1 on success, 0 when out of memory
+ */
+int rtin_mesh( struct rtin* rtin, float max_error, struct rtin_mesh* mesh );
+
+/**
+ * @brief Frees an extracted mesh
+ */
+void rtin_mesh_free( struct rtin_mesh* mesh );
+
+#endif
@@ -1,12 +1,8 @@
+import numpy as np
 from PIL import Image
 
-img = Image.new('RGB', (128, 128), color='red')
+# float32 heights indexed [y, x] saved by write_map
+heights = np.load('output.npy')
+pixels = (np.clip(heights, 0, 1) * 255).astype(np.uint8)
 
-with open('output.txt', 'r') as file:
-    for y in range(128):
-        lines = file.readline().split()
-        for x in range(128):
-            val = int(lines[x])
-            img.putpixel((x, y), (val, val, val))
-
-img.save("output.png", "PNG")
+Image.fromarray(pixels, 'L').convert('RGB').save("output.png", "PNG")
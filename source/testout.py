@@ -1,11 +1,9 @@
+import numpy as np
 from PIL import Image
 
 img = Image.open('Heightmap_2.png')
 grayimg = img.convert('L')
 
-with open('input.txt', 'w') as file:
-    for y in range(img.height):
-        for x in range(img.width):
-            val = grayimg.getpixel((x,y))
-            file.write(f'{val} ')
-        file.write('\n')
+# heights in [0, 1] as a float32 array indexed [y, x], read with read_map
+heights = np.asarray(grayimg, dtype=np.float32) / 255
+np.save('input.npy', heights)
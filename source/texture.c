@@ -0,0 +1,220 @@
+/***********************************************************************
+* FILENAME :        texture.h   texture.c
+*
+* DESCRIPTION :
+*       Material textures derived from the heightmap [normal, slope and
+*       curvature maps] exported as png next to the heightmap itself
+*
+* PUBLIC FUNCTIONS :
+*       void export_textures( float* heightmap, int map_size, int maps,
+*                             int depth, float height_scale, int level,
+*                             char* basename )
+*
+* PRIVATE FUNCTIONS :
+*       row_derivatives, laplacian_rms, encode_samples, texture_row
+*
+* NOTES :
+*       Every row is reduced to gradient and laplacian rows by a 3x3
+*       stencil in plain loops over restrict pointers the compiler
+*       vectorizes, then each texture is a vectorized conversion of
+*       those rows to samples [sqrtf needs -fno-math-errno to vectorize].
+*       Bands of rows are computed in parallel, each texture has its own
+*       streaming png encoder.
+*H*/
+
+#include "texture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "png.h"
+
+#define TEXTURE_COUNT     4
+#define TEXTURE_BAND_ROWS 64    /* rows computed in parallel per band */
+
+static const char* texture_suffix[TEXTURE_COUNT] = {
+  "_height.png", "_normal.png", "_slope.png", "_curvature.png"
+};
+static const int texture_channels[TEXTURE_COUNT] = { 1, 3, 1, 1 };
+
+struct texture_job {
+  const float* heightmap;
+  int map_size;
+  float height_scale;
+  float curvature_scale;    /* maps the laplacian to [-0.5, 0.5] */
+};
+
+
+/* gradients of row z in the [1, 1, 1] mesh by central differences, one
+   sided at the border, and the laplacian with clamped neighbours */
+static void row_derivatives(const struct texture_job* job, int z, float* restrict dhdx,
+                            float* restrict dhdz, float* restrict lap) {
+  int n = job->map_size;
+  int z0 = z > 0 ? z - 1 : z;
+  int z1 = z < n - 1 ? z + 1 : z;
+  const float* restrict row  = job->heightmap + (size_t) z * n;
+  const float* restrict up   = job->heightmap + (size_t) z0 * n;
+  const float* restrict down = job->heightmap + (size_t) z1 * n;
+  float sx = 0.5f * (n - 1) * job->height_scale;
+  float sz = (float) (n - 1) * job->height_scale / (z1 - z0);
+
+  for (int x = 1; x < n - 1; x++) {
+    dhdx[x] = (row[x + 1] - row[x - 1]) * sx;
+    dhdz[x] = (down[x] - up[x]) * sz;
+    lap[x]  = row[x - 1] + row[x + 1] + up[x] + down[x] - 4 * row[x];
+  }
+
+  dhdx[0]     = (row[1] - row[0]) * 2 * sx;
+  dhdx[n - 1] = (row[n - 1] - row[n - 2]) * 2 * sx;
+  dhdz[0]     = (down[0] - up[0]) * sz;
+  dhdz[n - 1] = (down[n - 1] - up[n - 1]) * sz;
+  lap[0]      = row[1] + up[0] + down[0] - 3 * row[0];
+  lap[n - 1]  = row[n - 2] + up[n - 1] + down[n - 1] - 3 * row[n - 1];
+}
+
+/* root mean square of the laplacian over the map */
+static double laplacian_rms(const float* heightmap, int map_size) {
+  double sum = 0;
+  #pragma omp parallel for reduction(+:sum) schedule(static)
+  for (int z = 0; z < map_size; z++) {
+    const float* row  = heightmap + (size_t) z * map_size;
+    const float* up   = z > 0 ? row - map_size : row;
+    const float* down = z < map_size - 1 ? row + map_size : row;
+    for (int x = 0; x < map_size; x++) {
+      float left  = row[x > 0 ? x - 1 : x];
+      float right = row[x < map_size - 1 ? x + 1 : x];
+      float lap = left + right + up[x] + down[x] - 4 * row[x];
+      sum += lap * lap;
+    }
+  }
+  return sqrt(sum / ((double) map_size * map_size));
+}
+
+/* values in [0, 1], clamped, to 8 bit or big endian 16 bit samples */
+static void encode_samples(const float* restrict values, int count, int depth,
+                           uint8_t* restrict out) {
+  // clamped as integers, which vectorizes unlike float compares
+  if (depth == 8) {
+    for (int i = 0; i < count; i++) {
+      int sample = (int) (values[i] * 255 + 0.5f);
+      sample = sample < 0 ? 0 : sample > 255 ? 255 : sample;
+      out[i] = (uint8_t) sample;
+    }
+  } else {
+    for (int i = 0; i < count; i++) {
+      int sample = (int) (values[i] * 65535 + 0.5f);
+      sample = sample < 0 ? 0 : sample > 65535 ? 65535 : sample;
+      out[2 * i]     = (uint8_t) (sample >> 8);
+      out[2 * i + 1] = (uint8_t) sample;
+    }
+  }
+}
+
+/* samples of row z for every texture with an output row, scratch holds
+   6 rows of floats */
+static void texture_row(const struct texture_job* job, int z, int depth,
+                        float* scratch, uint8_t** out) {
+  int n = job->map_size;
+  float* restrict dhdx   = scratch;
+  float* restrict dhdz   = scratch + n;
+  float* restrict lap    = scratch + 2 * n;
+  float* restrict values = scratch + 3 * n;
+
+  row_derivatives(job, z, dhdx, dhdz, lap);
+
+  if (out[0]) {
+    encode_samples(job->heightmap + (size_t) z * n, n, depth, out[0]);
+  }
+  if (out[1]) {
+    // up facing normal (-dhdx, 1, -dhdz), green points to -z
+    for (int x = 0; x < n; x++) {
+      float inv_len = 1.0f / sqrtf(dhdx[x] * dhdx[x] + dhdz[x] * dhdz[x] + 1.0f);
+      values[3 * x]     = 0.5f - 0.5f * dhdx[x] * inv_len;
+      values[3 * x + 1] = 0.5f + 0.5f * dhdz[x] * inv_len;
+      values[3 * x + 2] = 0.5f + 0.5f * inv_len;
+    }
+    encode_samples(values, 3 * n, depth, out[1]);
+  }
+  if (out[2]) {
+    for (int x = 0; x < n; x++) {
+      values[x] = 1.0f - 1.0f / sqrtf(dhdx[x] * dhdx[x] + dhdz[x] * dhdz[x] + 1.0f);
+    }
+    encode_samples(values, n, depth, out[2]);
+  }
+  if (out[3]) {
+    for (int x = 0; x < n; x++) {
+      values[x] = 0.5f + lap[x] * job->curvature_scale;
+    }
+    encode_samples(values, n, depth, out[3]);
+  }
+}
+
+
+void export_textures(float* heightmap, int map_size, int maps, int depth,
+                     float height_scale, int level, char* basename) {
+  if (map_size < 2 || (depth != 8 && depth != 16))
+    return;
+
+  struct png_writer png[TEXTURE_COUNT];
+  FILE* fp[TEXTURE_COUNT] = { NULL };
+  uint8_t* band[TEXTURE_COUNT] = { NULL };
+  size_t stride[TEXTURE_COUNT] = { 0 };
+
+  char* name = malloc(strlen(basename) + 16);
+  float* scratch = malloc((size_t) TEXTURE_BAND_ROWS * 6 * map_size * sizeof(float));
+  int ok = name != NULL && scratch != NULL;
+
+  memset(png, 0, sizeof(png));
+  for (int t = 0; ok && t < TEXTURE_COUNT; t++) {
+    if (!(maps & (1 << t)))
+      continue;
+    sprintf(name, "%s%s", basename, texture_suffix[t]);
+    stride[t] = (size_t) map_size * texture_channels[t] * depth / 8;
+    fp[t] = fopen(name, "wb");
+    band[t] = malloc(TEXTURE_BAND_ROWS * stride[t]);
+    ok = fp[t] != NULL && band[t] != NULL
+         && png_write_begin(&png[t], fp[t], map_size, map_size, texture_channels[t],
+                            depth, level);
+  }
+
+  struct texture_job job = { heightmap, map_size, height_scale, 0 };
+  if (ok && (maps & TEXTURE_CURVATURE)) {
+    double rms = laplacian_rms(heightmap, map_size);
+    job.curvature_scale = rms > 0 ? (float) (0.25 / rms) : 0;
+  }
+
+  // one pass over the heightmap, every band feeds all the encoders
+  for (int z0 = 0; ok && z0 < map_size; z0 += TEXTURE_BAND_ROWS) {
+    int rows = map_size - z0 < TEXTURE_BAND_ROWS ? map_size - z0 : TEXTURE_BAND_ROWS;
+
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < rows; r++) {
+      uint8_t* out[TEXTURE_COUNT];
+      for (int t = 0; t < TEXTURE_COUNT; t++) {
+        out[t] = band[t] ? band[t] + r * stride[t] : NULL;
+      }
+      texture_row(&job, z0 + r, depth, scratch + (size_t) r * 6 * map_size, out);
+    }
+
+    for (int t = 0; t < TEXTURE_COUNT; t++) {
+      if (band[t])
+        png_write_rows(&png[t], band[t], rows);
+    }
+  }
+
+  // a texture that could not be written completely is removed
+  for (int t = 0; t < TEXTURE_COUNT; t++) {
+    int written = png_write_end(&png[t]);
+    if (fp[t]) {
+      sprintf(name, "%s%s", basename, texture_suffix[t]);
+      if (fclose(fp[t]) != 0 || !written)
+        remove(name);
+    }
+    free(band[t]);
+  }
+  free(name);
+  free(scratch);
+}
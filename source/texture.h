@@ -0,0 +1,55 @@
+/***********************************************************************
+* FILENAME :        texture.h   texture.c
+*
+* DESCRIPTION :
+*       Material textures derived from the heightmap [normal, slope and
+*       curvature maps] exported as png next to the heightmap itself
+*
+* PUBLIC FUNCTIONS :
+*       void export_textures( float* heightmap, int map_size, int maps,
+*                             int depth, float height_scale, int level,
+*                             char* basename )
+*
+* NOTES :
+*       Normal maps are tangent space with red to +x [image right], green
+*       to the image top and blue up [OpenGL convention]. Slope is
+*       1 - cos of the slope angle, 0 on flat ground and 1 on a cliff.
+*       Curvature is the laplacian of the heights centered on 0.5 and
+*       scaled to +-2 standard deviations, concave channels are bright
+*       and convex ridges dark, so it doubles as a wetness mask.
+*H*/
+
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+/**
+ * @brief Textures selected in export_textures
+ */
+enum texture_map {
+  TEXTURE_HEIGHT    = 1,    /* basename_height.png, gray */
+  TEXTURE_NORMAL    = 2,    /* basename_normal.png, RGB */
+  TEXTURE_SLOPE     = 4,    /* basename_slope.png, gray */
+  TEXTURE_CURVATURE = 8     /* basename_curvature.png, gray */
+};
+
+/**
+ * @brief Export the heightmap and the textures derived from it
+ *
+ * Writes every texture selected by @param maps in one pass over the
+ * @param heightmap with @param map_size. Bands of rows are computed in
+ * parallel and streamed to one png encoder per texture. Gradients are
+ * central differences in the [1, 1, 1] mesh, one sided at the border.
+ * A texture that could not be written completely is removed.
+ *
+ * @param heightmap    the heightmap to export
+ * @param map_size     the heightmap size
+ * @param maps         texture_map flags
+ * @param depth        bits per sample, 8 or 16
+ * @param height_scale vertical exaggeration applied to normals and slope
+ * @param level        the png compression level in [0, 9]
+ * @param basename     the filename without the _map.png suffix
+ */
+void export_textures( float* heightmap, int map_size, int maps, int depth,
+                      float height_scale, int level, char* basename );
+
+#endif
@@ -0,0 +1,691 @@
+/***********************************************************************
+* FILENAME :        tiff.h   tiff.c
+*
+* DESCRIPTION :
+*       Baseline tiled or striped TIFF heightfield export and import
+*       [.tif] with float32 or uint16 samples for GIS tools
+*
+* PUBLIC FUNCTIONS :
+*       void   export_tiff( float* heightmap, int map_size, int format,
+*                           int tile_size, int level, char* filename )
+*       float* import_tiff( char* filename, int* map_size )
+*       float* import_tiff_window( char* filename, int x, int y,
+*                                  int size )
+*
+* PRIVATE FUNCTIONS :
+*       get_u16, get_u32, put_u16, put_u32, put_entry, read_array,
+*       read_tiff_info, memory_input, memory_output, inflate_block,
+*       undo_predictor, convert_block, encode_block
+*
+* NOTES :
+*       Strips are handled as tiles as wide as the image, so both layouts
+*       share one block path. A block is the unit of compression: blocks
+*       are encoded in batches in parallel on export, and on import the
+*       file reads are serialized while decompression and conversion run
+*       in parallel. Assumes a little endian host.
+*       note: see https://www.itu.int/itudoc/itu-t/com16/tiff-fx/docs/tiff6.pdf
+*       and Adobe Photoshop TIFF technical note 3 for the float predictor
+*H*/
+
+#include "tiff.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "deflate.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define TIFF_STRIP_BYTES (256 << 10)   /* uncompressed bytes per strip */
+#define TIFF_BATCH_BYTES (16 << 20)    /* uncompressed bytes encoded per batch */
+#define TIFF_MAX_BYTES   UINT32_MAX    /* offsets are 32 bit, no BigTIFF */
+
+enum tiff_tag {
+  TAG_WIDTH             = 256,
+  TAG_LENGTH            = 257,
+  TAG_BITS_PER_SAMPLE   = 258,
+  TAG_COMPRESSION       = 259,
+  TAG_PHOTOMETRIC       = 262,
+  TAG_STRIP_OFFSETS     = 273,
+  TAG_SAMPLES_PER_PIXEL = 277,
+  TAG_ROWS_PER_STRIP    = 278,
+  TAG_STRIP_BYTE_COUNTS = 279,
+  TAG_PLANAR_CONFIG     = 284,
+  TAG_PREDICTOR         = 317,
+  TAG_TILE_WIDTH        = 322,
+  TAG_TILE_LENGTH       = 323,
+  TAG_TILE_OFFSETS      = 324,
+  TAG_TILE_BYTE_COUNTS  = 325,
+  TAG_SAMPLE_FORMAT     = 339
+};
+
+enum tiff_type { TYPE_SHORT = 3, TYPE_LONG = 4 };
+
+enum tiff_compression { COMPRESSION_NONE = 1, COMPRESSION_DEFLATE = 8,
+                        COMPRESSION_DEFLATE_OLD = 32946 };
+
+enum tiff_predictor { PREDICTOR_NONE = 1, PREDICTOR_HORIZONTAL = 2, PREDICTOR_FLOAT = 3 };
+
+struct tiff_info {
+  int big_endian;
+  int width, height;
+  int bits, sample_format;      /* 1 unsigned, 3 float */
+  int compression, predictor;
+  int block_width, block_height;
+  int across, down;             /* blocks per row and column */
+  uint32_t* offsets;
+  uint32_t* byte_counts;
+};
+
+/* a compressed block and the buffer it inflates into */
+struct memory_stream {
+  const uint8_t* data;
+  size_t left;
+  uint8_t* out;
+  size_t out_left;
+};
+
+
+static uint32_t get_u16(const uint8_t* p, int big_endian) {
+  return big_endian ? (uint32_t) p[0] << 8 | p[1] : (uint32_t) p[1] << 8 | p[0];
+}
+
+static uint32_t get_u32(const uint8_t* p, int big_endian) {
+  return big_endian ? (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3]
+                    : (uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | p[0];
+}
+
+static void put_u16(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+/* one little endian directory entry, single values are stored inline */
+static uint8_t* put_entry(uint8_t* p, int tag, int type, uint32_t count, uint32_t value) {
+  put_u16(p, tag);
+  put_u16(p + 2, type);
+  put_u32(p + 4, count);
+  put_u32(p + 8, 0);
+  if (type == TYPE_SHORT && count == 1)
+    put_u16(p + 8, value);
+  else
+    put_u32(p + 8, value);
+  return p + 12;
+}
+
+/* reads the count values of a SHORT or LONG entry, inline or at its offset */
+static uint32_t* read_array(FILE* fp, const uint8_t* entry, int big_endian, uint32_t count) {
+  int type = get_u16(entry + 2, big_endian);
+  size_t size = type == TYPE_SHORT ? 2 : type == TYPE_LONG ? 4 : 0;
+  if (size == 0 || count == 0 || get_u32(entry + 4, big_endian) != count)
+    return NULL;
+
+  uint32_t* values = malloc(count * sizeof(uint32_t));
+  uint8_t* raw = malloc(count * size);
+  int ok = values != NULL && raw != NULL;
+  if (ok && count * size <= 4) {
+    memcpy(raw, entry + 8, count * size);
+  } else if (ok) {
+    ok = fseek(fp, get_u32(entry + 8, big_endian), SEEK_SET) == 0
+         && fread(raw, size, count, fp) == count;
+  }
+  for (uint32_t i = 0; ok && i < count; i++) {
+    values[i] = size == 2 ? get_u16(raw + 2 * i, big_endian) : get_u32(raw + 4 * i, big_endian);
+  }
+
+  free(raw);
+  if (!ok) {
+    free(values);
+    return NULL;
+  }
+  return values;
+}
+
+/* reads the first image directory, 0 for files this reader cannot decode */
+static int read_tiff_info(FILE* fp, struct tiff_info* info) {
+  uint8_t head[8];
+  memset(info, 0, sizeof(struct tiff_info));
+  if (fread(head, 1, 8, fp) != 8 || (memcmp(head, "II", 2) != 0 && memcmp(head, "MM", 2) != 0))
+    return 0;
+  info->big_endian = head[0] == 'M';
+  if (get_u16(head + 2, info->big_endian) != 42
+      || fseek(fp, get_u32(head + 4, info->big_endian), SEEK_SET) != 0
+      || fread(head, 1, 2, fp) != 2)
+    return 0;
+
+  int entries = get_u16(head, info->big_endian);
+  uint8_t* ifd = malloc(entries * 12);
+  if (ifd == NULL || fread(ifd, 12, entries, fp) != (size_t) entries) {
+    free(ifd);
+    return 0;
+  }
+
+  // single valued tags first, the block tables need the block counts
+  uint32_t rows_per_strip = 0xFFFFFFFF, samples = 1, planar = 1;
+  const uint8_t* offsets = NULL;
+  const uint8_t* byte_counts = NULL;
+  info->bits = 1;
+  info->sample_format = 1;
+  info->compression = COMPRESSION_NONE;
+  info->predictor = PREDICTOR_NONE;
+  for (int i = 0; i < entries; i++) {
+    const uint8_t* entry = ifd + 12 * i;
+    int tag = get_u16(entry, info->big_endian);
+    int type = get_u16(entry + 2, info->big_endian);
+    uint32_t value = type == TYPE_SHORT ? get_u16(entry + 8, info->big_endian)
+                                        : get_u32(entry + 8, info->big_endian);
+    switch (tag) {
+      case TAG_WIDTH:             info->width = value; break;
+      case TAG_LENGTH:            info->height = value; break;
+      case TAG_BITS_PER_SAMPLE:   info->bits = value; break;
+      case TAG_COMPRESSION:       info->compression = value; break;
+      case TAG_SAMPLES_PER_PIXEL: samples = value; break;
+      case TAG_ROWS_PER_STRIP:    rows_per_strip = value; break;
+      case TAG_PLANAR_CONFIG:     planar = value; break;
+      case TAG_PREDICTOR:         info->predictor = value; break;
+      case TAG_TILE_WIDTH:        info->block_width = value; break;
+      case TAG_TILE_LENGTH:       info->block_height = value; break;
+      case TAG_SAMPLE_FORMAT:     info->sample_format = value; break;
+      case TAG_STRIP_OFFSETS:
+      case TAG_TILE_OFFSETS:      offsets = entry; break;
+      case TAG_STRIP_BYTE_COUNTS:
+      case TAG_TILE_BYTE_COUNTS:  byte_counts = entry; break;
+    }
+  }
+
+  int tiled = info->block_width > 0;
+  if (!tiled) {
+    info->block_width = info->width;
+    info->block_height = rows_per_strip < (uint32_t) info->height ? (int) rows_per_strip
+                                                                   : info->height;
+  }
+
+  int sample_ok = (info->sample_format == 1 && (info->bits == 8 || info->bits == 16))
+                  || (info->sample_format == 3 && info->bits == 32);
+  int predictor_ok = info->predictor == PREDICTOR_NONE
+                     || (info->predictor == PREDICTOR_HORIZONTAL && info->sample_format == 1)
+                     || (info->predictor == PREDICTOR_FLOAT && info->sample_format == 3);
+  int compression_ok = info->compression == COMPRESSION_NONE
+                       || info->compression == COMPRESSION_DEFLATE
+                       || info->compression == COMPRESSION_DEFLATE_OLD;
+  int ok = info->width > 0 && info->height > 0 && info->block_width > 0
+           && info->block_height > 0 && samples == 1 && planar == 1
+           && sample_ok && predictor_ok && compression_ok
+           && offsets != NULL && byte_counts != NULL;
+
+  if (ok) {
+    info->across = (info->width + info->block_width - 1) / info->block_width;
+    info->down = (info->height + info->block_height - 1) / info->block_height;
+    uint32_t blocks = (uint32_t) info->across * info->down;
+    info->offsets = read_array(fp, offsets, info->big_endian, blocks);
+    info->byte_counts = read_array(fp, byte_counts, info->big_endian, blocks);
+    ok = info->offsets != NULL && info->byte_counts != NULL;
+  }
+
+  free(ifd);
+  if (!ok) {
+    free(info->offsets);
+    free(info->byte_counts);
+  }
+  return ok;
+}
+
+static size_t memory_input(void* ctx, const uint8_t** data) {
+  struct memory_stream* s = ctx;
+  size_t n = s->left;
+  *data = s->data;
+  s->data += n;
+  s->left = 0;
+  return n;
+}
+
+static int memory_output(void* ctx, const uint8_t* data, size_t length) {
+  struct memory_stream* s = ctx;
+  size_t n = length < s->out_left ? length : s->out_left;
+  memcpy(s->out, data, n);
+  s->out += n;
+  s->out_left -= n;
+  return 1;
+}
+
+/* inflates a zlib stream into out, returns the decoded bytes or 0 */
+static size_t inflate_block(const uint8_t* data, size_t length, uint8_t* out, size_t out_size) {
+  if (length < 2 || (data[0] & 15) != 8 || (data[0] * 256 + data[1]) % 31 != 0)
+    return 0;
+  struct memory_stream s = { data + 2, length - 2, out, out_size };
+  if (!inflate_raw(memory_input, memory_output, &s))
+    return 0;
+  return out_size - s.out_left;
+}
+
+/* reverses the predictor of rows of width samples, leaving host order
+   samples */
+static void undo_predictor(const struct tiff_info* info, uint8_t* block, int rows,
+                           uint8_t* scratch) {
+  int width = info->block_width;
+  int bytes = info->bits / 8;
+
+  for (int r = 0; r < rows; r++) {
+    uint8_t* row = block + (size_t) r * width * bytes;
+
+    if (info->predictor == PREDICTOR_FLOAT) {
+      // byte differences over the row, then planes of most significant
+      // bytes first, which gives little endian samples in either byte
+      // order of the file, as libtiff reads them
+      for (int i = 1; i < width * bytes; i++) {
+        row[i] += row[i - 1];
+      }
+      for (int x = 0; x < width; x++) {
+        for (int b = 0; b < bytes; b++) {
+          scratch[x * bytes + b] = row[(bytes - 1 - b) * width + x];
+        }
+      }
+      memcpy(row, scratch, (size_t) width * bytes);
+    }
+
+    // the float predictor has already put the bytes in order
+    int reorder = info->big_endian && info->predictor != PREDICTOR_FLOAT;
+    if (reorder && bytes == 2) {
+      for (int x = 0; x < width; x++) {
+        uint8_t swap = row[2 * x];
+        row[2 * x] = row[2 * x + 1];
+        row[2 * x + 1] = swap;
+      }
+    } else if (reorder && bytes == 4) {
+      for (int x = 0; x < width; x++) {
+        uint32_t v;
+        memcpy(&v, row + 4 * x, 4);
+        v = __builtin_bswap32(v);
+        memcpy(row + 4 * x, &v, 4);
+      }
+    }
+
+    if (info->predictor == PREDICTOR_HORIZONTAL && bytes == 1) {
+      for (int x = 1; x < width; x++) {
+        row[x] += row[x - 1];
+      }
+    } else if (info->predictor == PREDICTOR_HORIZONTAL) {
+      uint16_t* samples = (uint16_t*) row;
+      for (int x = 1; x < width; x++) {
+        samples[x] += samples[x - 1];
+      }
+    }
+  }
+}
+
+/* copies the part of block (bx, by) inside the window into heights */
+static void convert_block(const struct tiff_info* info, const uint8_t* block, int bx, int by,
+                          int x0, int y0, int size, float* heights) {
+  int left = bx * info->block_width, top = by * info->block_height;
+  int xa = left > x0 ? left : x0, ya = top > y0 ? top : y0;
+  int xb = left + info->block_width, yb = top + info->block_height;
+  xb = xb < x0 + size ? xb : x0 + size;
+  yb = yb < y0 + size ? yb : y0 + size;
+  int count = xb - xa;
+
+  for (int y = ya; y < yb; y++) {
+    size_t src = (size_t) (y - top) * info->block_width + (xa - left);
+    float* restrict out = heights + (size_t) (y - y0) * size + (xa - x0);
+    if (info->bits == 32) {
+      memcpy(out, (const float*) block + src, count * sizeof(float));
+    } else if (info->bits == 16) {
+      const uint16_t* restrict in = (const uint16_t*) block + src;
+      for (int x = 0; x < count; x++) out[x] = in[x] * (1.0f / 65535);
+    } else {
+      const uint8_t* restrict in = block + src;
+      for (int x = 0; x < count; x++) out[x] = in[x] * (1.0f / 255);
+    }
+  }
+}
+
+/* converts block (bx, by) to samples, applies the predictor and compresses
+   it into out, returns the bytes of the block in the file */
+static size_t encode_block(const float* heightmap, int map_size, int format, int level,
+                           int block_width, int block_height, int bx, int by,
+                           uint8_t* raw, uint8_t* out) {
+  int bytes = format == TIFF_F32 ? 4 : 2;
+  int left = bx * block_width, top = by * block_height;
+  // the last strip is cut to the image, tiles are padded with zeros
+  int rows = block_width == map_size && top + block_height > map_size ? map_size - top
+                                                                     : block_height;
+
+  for (int r = 0; r < rows; r++) {
+    int y = top + r;
+    int count = map_size - left < block_width ? map_size - left : block_width;
+    if (y >= map_size)
+      count = 0;
+    const float* restrict in = heightmap + (size_t) y * map_size + left;
+    uint8_t* row = raw + (size_t) r * block_width * bytes;
+
+    if (format == TIFF_F32) {
+      memcpy(row, in, count * sizeof(float));
+    } else {
+      uint16_t* restrict samples = (uint16_t*) row;
+      for (int x = 0; x < count; x++) {
+        int sample = (int) (in[x] * 65535 + 0.5f);
+        samples[x] = (uint16_t) (sample < 0 ? 0 : sample > 65535 ? 65535 : sample);
+      }
+    }
+    memset(row + (size_t) count * bytes, 0, (size_t) (block_width - count) * bytes);
+
+    if (level == 0)
+      continue;
+
+    // the predictors turn smooth heights into small differences
+    if (format == TIFF_F32) {
+      uint8_t* planes = out;    /* out is free until the block is compressed */
+      for (int x = 0; x < block_width; x++) {
+        for (int b = 0; b < 4; b++) {
+          planes[(3 - b) * block_width + x] = row[4 * x + b];
+        }
+      }
+      for (int i = 4 * block_width - 1; i > 0; i--) {
+        planes[i] -= planes[i - 1];
+      }
+      memcpy(row, planes, (size_t) 4 * block_width);
+    } else {
+      uint16_t* samples = (uint16_t*) row;
+      for (int x = block_width - 1; x > 0; x--) {
+        samples[x] -= samples[x - 1];
+      }
+    }
+  }
+
+  size_t length = (size_t) rows * block_width * bytes;
+  if (level == 0) {
+    memcpy(out, raw, length);
+    return length;
+  }
+
+  // zlib stream, deflate with a 32K window and a big endian adler32
+  int hint = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+  out[0] = 0x78;
+  out[1] = hint << 6;
+  out[1] += 31 - (out[0] * 256 + out[1]) % 31;
+  size_t packed = deflate_raw(raw, length, level, 1, out + 2);
+  uint32_t adler = deflate_adler32(1, raw, length);
+  uint8_t* tail = out + 2 + packed;
+  tail[0] = adler >> 24;
+  tail[1] = adler >> 16;
+  tail[2] = adler >> 8;
+  tail[3] = adler;
+  return packed + 6;
+}
+
+
+void export_tiff(float* heightmap, int map_size, int format, int tile_size, int level,
+                 char* filename) {
+  if ((format != TIFF_U16 && format != TIFF_F32) || tile_size < 0 || tile_size % 16 != 0)
+    return;
+
+  int bytes = format == TIFF_F32 ? 4 : 2;
+  int block_width = tile_size ? tile_size : map_size;
+  int block_height = tile_size;
+  if (tile_size == 0) {
+    block_height = TIFF_STRIP_BYTES / (map_size * bytes);
+    block_height = block_height < 1 ? 1 : block_height > map_size ? map_size : block_height;
+  }
+  level = level < 0 ? 0 : level > 9 ? 9 : level;
+
+  int across = (map_size + block_width - 1) / block_width;
+  int down = (map_size + block_height - 1) / block_height;
+  int blocks = across * down;
+  size_t raw_bytes = (size_t) block_width * block_height * bytes;
+  size_t packed_bytes = deflate_bound(raw_bytes) + 6;
+
+#ifdef _OPENMP
+  int threads = omp_get_max_threads();
+#else
+  int threads = 1;
+#endif
+  int batch = (int) (TIFF_BATCH_BYTES / raw_bytes);
+  batch = batch < threads ? threads : batch;
+  batch = batch < blocks ? batch : blocks;
+
+  int tiled = tile_size > 0;
+  int entries = 11 + tiled + (level > 0);
+  size_t ifd_size = 2 + entries * 12 + 4 + (blocks > 1 ? (size_t) blocks * 8 : 0);
+
+  // uncompressed blocks have a known size, a file that cannot fit is
+  // refused before anything is written
+  if (level == 0 && 8 + (uint64_t) blocks * raw_bytes + 1 + ifd_size > TIFF_MAX_BYTES)
+    return;
+
+  uint32_t* offsets = malloc(blocks * sizeof(uint32_t));
+  uint32_t* byte_counts = malloc(blocks * sizeof(uint32_t));
+  uint8_t* raw = malloc(batch * raw_bytes);
+  uint8_t* packed = malloc(batch * packed_bytes);
+  size_t* sizes = malloc(batch * sizeof(size_t));
+
+  FILE* fp = NULL;
+  if (offsets != NULL && byte_counts != NULL && raw != NULL && packed != NULL && sizes != NULL)
+    fp = fopen(filename, "wb");
+
+  if (fp == NULL) {
+    free(offsets);
+    free(byte_counts);
+    free(raw);
+    free(packed);
+    free(sizes);
+    return;
+  }
+
+  // header, the directory offset is patched in once the blocks are written
+  uint8_t header[8] = { 'I', 'I', 42, 0, 0, 0, 0, 0 };
+  int written = fwrite(header, 1, 8, fp) == 8;
+  uint64_t position = 8;
+  int fits = 1;
+
+  for (int first = 0; fits && written && first < blocks; first += batch) {
+    int count = blocks - first < batch ? blocks - first : batch;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int b = 0; b < count; b++) {
+      int block = first + b;
+      sizes[b] = encode_block(heightmap, map_size, format, level, block_width, block_height,
+                              block % across, block / across, raw + b * raw_bytes,
+                              packed + b * packed_bytes);
+    }
+    for (int b = 0; written && b < count; b++) {
+      // compressed sizes are only known now, stop before an offset wraps
+      if (position + sizes[b] + 1 + ifd_size > TIFF_MAX_BYTES) {
+        fits = 0;
+        break;
+      }
+      offsets[first + b] = (uint32_t) position;
+      byte_counts[first + b] = (uint32_t) sizes[b];
+      written = fwrite(packed + b * packed_bytes, 1, sizes[b], fp) == sizes[b];
+      position += sizes[b];
+    }
+  }
+  if (!fits || !written) {
+    free(offsets);
+    free(byte_counts);
+    free(raw);
+    free(packed);
+    free(sizes);
+    fclose(fp);
+    remove(filename);
+    return;
+  }
+
+  // directory on a word boundary, then the block tables it points to
+  if (position & 1) {
+    written = fputc(0, fp) != EOF;
+    position++;
+  }
+  uint32_t tables = (uint32_t) position + 2 + entries * 12 + 4;
+  uint32_t offsets_at = blocks > 1 ? tables : offsets[0];
+  uint32_t counts_at = blocks > 1 ? tables + blocks * 4 : byte_counts[0];
+  int compression = level ? COMPRESSION_DEFLATE : COMPRESSION_NONE;
+  int predictor = format == TIFF_F32 ? PREDICTOR_FLOAT : PREDICTOR_HORIZONTAL;
+
+  uint8_t* ifd = malloc(ifd_size);
+  written = written && ifd != NULL;
+  if (written) {
+    uint8_t* p = ifd + 2;
+    put_u16(ifd, entries);
+    p = put_entry(p, TAG_WIDTH, TYPE_LONG, 1, map_size);
+    p = put_entry(p, TAG_LENGTH, TYPE_LONG, 1, map_size);
+    p = put_entry(p, TAG_BITS_PER_SAMPLE, TYPE_SHORT, 1, bytes * 8);
+    p = put_entry(p, TAG_COMPRESSION, TYPE_SHORT, 1, compression);
+    p = put_entry(p, TAG_PHOTOMETRIC, TYPE_SHORT, 1, 1);    /* black is zero */
+    if (!tiled)
+      p = put_entry(p, TAG_STRIP_OFFSETS, TYPE_LONG, blocks, offsets_at);
+    p = put_entry(p, TAG_SAMPLES_PER_PIXEL, TYPE_SHORT, 1, 1);
+    if (!tiled) {
+      p = put_entry(p, TAG_ROWS_PER_STRIP, TYPE_LONG, 1, block_height);
+      p = put_entry(p, TAG_STRIP_BYTE_COUNTS, TYPE_LONG, blocks, counts_at);
+    }
+    p = put_entry(p, TAG_PLANAR_CONFIG, TYPE_SHORT, 1, 1);
+    if (level > 0)
+      p = put_entry(p, TAG_PREDICTOR, TYPE_SHORT, 1, predictor);
+    if (tiled) {
+      p = put_entry(p, TAG_TILE_WIDTH, TYPE_LONG, 1, block_width);
+      p = put_entry(p, TAG_TILE_LENGTH, TYPE_LONG, 1, block_height);
+      p = put_entry(p, TAG_TILE_OFFSETS, TYPE_LONG, blocks, offsets_at);
+      p = put_entry(p, TAG_TILE_BYTE_COUNTS, TYPE_LONG, blocks, counts_at);
+    }
+    p = put_entry(p, TAG_SAMPLE_FORMAT, TYPE_SHORT, 1, format == TIFF_F32 ? 3 : 1);
+    put_u32(p, 0);    /* no next directory */
+    p += 4;
+    for (int b = 0; blocks > 1 && b < blocks; b++) {
+      put_u32(p + 4 * b, offsets[b]);
+      put_u32(p + 4 * (blocks + b), byte_counts[b]);
+    }
+
+    put_u32(header + 4, (uint32_t) position);
+    written = fwrite(ifd, 1, ifd_size, fp) == ifd_size && fseek(fp, 0, SEEK_SET) == 0
+              && fwrite(header, 1, 8, fp) == 8;
+  }
+
+  free(ifd);
+  free(offsets);
+  free(byte_counts);
+  free(raw);
+  free(packed);
+  free(sizes);
+
+  // without every block and the directory the file is of no use
+  written = written && !ferror(fp);
+  if (fclose(fp) != 0 || !written)
+    remove(filename);
+}
+
+float* import_tiff_window(char* filename, int x, int y, int size) {
+  struct tiff_info info;
+  FILE* fp = fopen(filename, "rb");
+
+  if (fp == NULL)
+    return NULL;
+
+  if (!read_tiff_info(fp, &info)) {
+    fclose(fp);
+    return NULL;
+  }
+
+  float* heights = NULL;
+  if (size > 0 && x >= 0 && y >= 0 && x <= info.width - size && y <= info.height - size)
+    heights = malloc((size_t) size * size * sizeof(float));
+  if (heights == NULL) {
+    free(info.offsets);
+    free(info.byte_counts);
+    fclose(fp);
+    return NULL;
+  }
+
+  // the blocks overlapping the window
+  int bx0 = x / info.block_width, bx1 = (x + size - 1) / info.block_width;
+  int by0 = y / info.block_height, by1 = (y + size - 1) / info.block_height;
+  int across = bx1 - bx0 + 1;
+  int count = across * (by1 - by0 + 1);
+  size_t block_bytes = (size_t) info.block_width * info.block_height * info.bits / 8;
+  int failed = 0;
+
+  #pragma omp parallel
+  {
+    uint8_t* block = malloc(block_bytes);
+    uint8_t* scratch = malloc((size_t) info.block_width * info.bits / 8);
+
+    #pragma omp for schedule(dynamic, 1)
+    for (int i = 0; i < count; i++) {
+      int bx = bx0 + i % across, by = by0 + i / across;
+      int index = by * info.across + bx;
+      uint32_t length = info.byte_counts[index];
+      int rows = info.height - by * info.block_height;
+      rows = rows < info.block_height ? rows : info.block_height;
+      size_t needed = (size_t) rows * info.block_width * info.bits / 8;
+      int ok = block != NULL && scratch != NULL;
+
+      // one reader at a time, decoding runs in parallel
+      uint8_t* data = ok ? malloc(length) : NULL;
+      ok = data != NULL;
+      #pragma omp critical(tiff_read)
+      {
+        ok = ok && fseek(fp, info.offsets[index], SEEK_SET) == 0
+             && fread(data, 1, length, fp) == length;
+      }
+
+      if (ok && info.compression == COMPRESSION_NONE) {
+        ok = length >= needed;
+        if (ok)
+          memcpy(block, data, needed);
+      } else if (ok) {
+        ok = inflate_block(data, length, block, block_bytes) >= needed;
+      }
+      free(data);
+
+      if (ok) {
+        undo_predictor(&info, block, rows, scratch);
+        convert_block(&info, block, bx, by, x, y, size, heights);
+      } else {
+        #pragma omp atomic write
+        failed = 1;
+      }
+    }
+
+    free(block);
+    free(scratch);
+  }
+
+  free(info.offsets);
+  free(info.byte_counts);
+  fclose(fp);
+  if (failed) {
+    free(heights);
+    return NULL;
+  }
+  return heights;
+}
+
+float* import_tiff(char* filename, int* map_size) {
+  struct tiff_info info;
+  FILE* fp = fopen(filename, "rb");
+
+  if (fp == NULL)
+    return NULL;
+
+  int ok = read_tiff_info(fp, &info);
+  fclose(fp);
+  if (!ok)
+    return NULL;
+  free(info.offsets);
+  free(info.byte_counts);
+  if (info.width != info.height)
+    return NULL;
+
+  float* heights = import_tiff_window(filename, 0, 0, info.width);
+  if (heights != NULL)
+    *map_size = info.width;
+  return heights;
+}
@@ -0,0 +1,82 @@
+/***********************************************************************
+* FILENAME :        tiff.h   tiff.c
+*
+* DESCRIPTION :
+*       Baseline tiled or striped TIFF heightfield export and import
+*       [.tif] with float32 or uint16 samples for GIS tools
+*
+* PUBLIC FUNCTIONS :
+*       void   export_tiff( float* heightmap, int map_size, int format,
+*                           int tile_size, int level, char* filename )
+*       float* import_tiff( char* filename, int* map_size )
+*       float* import_tiff_window( char* filename, int x, int y,
+*                                  int size )
+*
+* NOTES :
+*       Exports are little endian, one gray sample per pixel, either
+*       uncompressed or deflate compressed [compression 8] with the
+*       horizontal [uint16] or floating point [float32] predictor, which
+*       GDAL, QGIS and libtiff read. Imports also take big endian files,
+*       uint8 samples and both byte orders of the predictors. BigTIFF,
+*       LZW and multiple samples per pixel are not supported, GeoTIFF
+*       georeferencing tags are ignored on import and not written.
+*H*/
+
+#ifndef TIFF_H_
+#define TIFF_H_
+
+/**
+ * @brief Sample formats of the tiff heightfield
+ */
+enum tiff_format {
+  TIFF_U16 = 0,   /* unsigned 16 bit integers, [0, 1] to [0, 65535] */
+  TIFF_F32 = 1    /* 32 bit floats, the heights as they are */
+};
+
+/**
+ * @brief Export heightmap as a tiled or striped tiff
+ *
+ * Exports the @param heightmap with @param map_size as tiles of
+ * @param tile_size pixels per side, or as strips of rows when it is 0.
+ * Tiles are converted and compressed in parallel and written in order.
+ * Offsets are 32 bit, a file that would pass 4 GiB is not written, or
+ * removed once its compressed blocks reach that size. A file that could
+ * not be written completely is removed as well.
+ *
+ * @param heightmap the heightmap to export
+ * @param map_size  the heightmap size
+ * @param format    TIFF_U16 or TIFF_F32
+ * @param tile_size a multiple of 16, 0 for strips
+ * @param level     the deflate level in [0, 9], 0 leaves it uncompressed
+ * @param filename  the filename [include extension]
+ */
+void export_tiff( float* heightmap, int map_size, int format, int tile_size, int level,
+                  char* filename );
+
+/**
+ * @brief Imports a square tiff heightfield
+ *
+ * Float samples are heights as they are, integer samples are scaled to
+ * [0, 1].
+ *
+ * @param filename  the filename [include extension]
+ * @param map_size  set to the heightmap size
+ * @return          the heightmap [free with free], NULL on failure
+ */
+float* import_tiff( char* filename, int* map_size );
+
+/**
+ * @brief Imports a square window of a larger tiff heightfield
+ *
+ * Only the tiles or strips overlapping the window are read and
+ * decompressed, in parallel.
+ *
+ * @param filename  the filename [include extension]
+ * @param x         the left column of the window
+ * @param y         the top row of the window
+ * @param size      the window size, the window must be inside the image
+ * @return          the heightmap [free with free], NULL on failure
+ */
+float* import_tiff_window( char* filename, int x, int y, int size );
+
+#endif
@@ -0,0 +1,374 @@
+/***********************************************************************
+* FILENAME :        timelapse.h   timelapse.c
+*
+* DESCRIPTION :
+*       Timelapse capture of erosion runs into one file of delta
+*       compressed heightmap frames, and a decoder for any frame
+*
+* PUBLIC FUNCTIONS :
+*       int    timelapse_begin( struct timelapse* tl, const float* heightmap,
+*                               int map_size, int keyframes, int level,
+*                               char* filename )
+*       int    timelapse_frame( struct timelapse* tl, const float* heightmap,
+*                               int map_size, int64_t droplets )
+*       void   timelapse_end( struct timelapse* tl )
+*       int    timelapse_count( char* filename )
+*       float* timelapse_read( char* filename, int frame, int* map_size,
+*                              int64_t* droplets )
+*
+* PRIVATE FUNCTIONS :
+*       zigzag, unzigzag, tile_extent, quantize, tile_changed, encode,
+*       decode, read_frame_header, memory_input, memory_output
+*
+* NOTES :
+*       File layout:
+*         header  "ETLP", version, map size, tile size, keyframes
+*                 [5 x uint32], low, step [2 x float]
+*         frame   deflated bytes [uint32], payload bytes [uint32],
+*                 flags [uint32, 1 for keyframes], droplets [int64],
+*                 the raw deflate stream of the payload
+*         payload one bit per tile [row major, lsb first] set when the
+*                 tile is stored, the low bytes of the differences of
+*                 every stored tile, then their high bytes
+*H*/
+
+#include "timelapse.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "deflate.h"
+
+#define TIMELAPSE_MAGIC   0x504c5445u   /* "ETLP" */
+#define TIMELAPSE_VERSION 1
+#define HEADER_BYTES      28
+#define FRAME_BYTES       20
+#define FRAME_KEY         1
+
+/* inflates from memory into a buffer of known size */
+struct memory_stream {
+  const uint8_t* data;
+  size_t left;
+  uint8_t* out;
+  size_t out_left;
+};
+
+
+/* differences as small unsigned values, 0 -1 1 -2 to 0 1 2 3 */
+static inline uint16_t zigzag(uint16_t d) {
+  return (uint16_t) ((d << 1) ^ (d & 0x8000 ? 0xffff : 0));
+}
+
+static inline uint16_t unzigzag(uint16_t z) {
+  return (uint16_t) ((z >> 1) ^ (z & 1 ? 0xffff : 0));
+}
+
+/* width of tile column t, or height of tile row t, the last may be cut */
+static int tile_extent(int map_size, int t) {
+  int extent = map_size - t * TIMELAPSE_TILE;
+  return extent < TIMELAPSE_TILE ? extent : TIMELAPSE_TILE;
+}
+
+static void quantize(const struct timelapse* tl, const float* heightmap, uint16_t* q) {
+  int size = tl->map_size;
+  float scale = 1 / tl->step;
+
+  #pragma omp parallel for
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      size_t i = (size_t) y * size + x;
+      float v = (heightmap[i] - tl->low) * scale + 0.5f;
+      q[i] = v <= 0 ? 0 : v >= 65535 ? 65535 : (uint16_t) v;
+    }
+  }
+}
+
+static int tile_changed(const struct timelapse* tl, int t) {
+  int tx = t % tl->tiles;
+  int ty = t / tl->tiles;
+  int width = tile_extent(tl->map_size, tx);
+  int height = tile_extent(tl->map_size, ty);
+
+  for (int y = 0; y < height; y++) {
+    size_t row = (size_t) (ty * TIMELAPSE_TILE + y) * tl->map_size + tx * TIMELAPSE_TILE;
+    if (memcmp(tl->current + row, tl->previous + row, width * sizeof(uint16_t)) != 0)
+      return 1;
+  }
+  return 0;
+}
+
+/* builds the payload of the current frame, returns its length */
+static size_t encode(struct timelapse* tl, int key) {
+  int tiles = tl->tiles;
+  size_t mask_bytes = ((size_t) tiles * tiles + 7) / 8;
+  uint8_t* mask = tl->payload;
+  size_t cells = 0;
+
+  memset(mask, 0, mask_bytes);
+  for (int t = 0; t < tiles * tiles; t++) {
+    if (key || tile_changed(tl, t)) {
+      mask[t >> 3] |= 1 << (t & 7);
+      cells += (size_t) tile_extent(tl->map_size, t % tiles) * tile_extent(tl->map_size, t / tiles);
+    }
+  }
+
+  uint8_t* low = tl->payload + mask_bytes;
+  uint8_t* high = low + cells;
+  for (int t = 0; t < tiles * tiles; t++) {
+    if (!(mask[t >> 3] >> (t & 7) & 1))
+      continue;
+    int tx = t % tiles;
+    int ty = t / tiles;
+    int width = tile_extent(tl->map_size, tx);
+    int height = tile_extent(tl->map_size, ty);
+    for (int y = 0; y < height; y++) {
+      size_t row = (size_t) (ty * TIMELAPSE_TILE + y) * tl->map_size + tx * TIMELAPSE_TILE;
+      const uint16_t* q = tl->current + row;
+      // keyframes predict from the left neighbour, the others from the frame before
+      const uint16_t* p = tl->previous + row;
+      for (int x = 0; x < width; x++) {
+        uint16_t prediction = key ? (x > 0 ? q[x - 1] : 0) : p[x];
+        uint16_t z = zigzag((uint16_t) (q[x] - prediction));
+        *low++ = z & 0xff;
+        *high++ = z >> 8;
+      }
+    }
+  }
+  return mask_bytes + 2 * cells;
+}
+
+/* applies a payload to the quantized frame q, returns 0 when it is malformed */
+static int decode(uint16_t* q, int map_size, const uint8_t* payload, size_t length, int key) {
+  int tiles = (map_size + TIMELAPSE_TILE - 1) / TIMELAPSE_TILE;
+  size_t mask_bytes = ((size_t) tiles * tiles + 7) / 8;
+  const uint8_t* mask = payload;
+  size_t cells = 0;
+
+  if (length < mask_bytes)
+    return 0;
+  for (int t = 0; t < tiles * tiles; t++) {
+    if (mask[t >> 3] >> (t & 7) & 1)
+      cells += (size_t) tile_extent(map_size, t % tiles) * tile_extent(map_size, t / tiles);
+  }
+  if (length != mask_bytes + 2 * cells)
+    return 0;
+
+  const uint8_t* low = payload + mask_bytes;
+  const uint8_t* high = low + cells;
+  for (int t = 0; t < tiles * tiles; t++) {
+    if (!(mask[t >> 3] >> (t & 7) & 1))
+      continue;
+    int tx = t % tiles;
+    int ty = t / tiles;
+    int width = tile_extent(map_size, tx);
+    int height = tile_extent(map_size, ty);
+    for (int y = 0; y < height; y++) {
+      uint16_t* row = q + (size_t) (ty * TIMELAPSE_TILE + y) * map_size + tx * TIMELAPSE_TILE;
+      for (int x = 0; x < width; x++) {
+        uint16_t d = unzigzag((uint16_t) (*low++ | *high++ << 8));
+        uint16_t prediction = key ? (x > 0 ? row[x - 1] : 0) : row[x];
+        row[x] = (uint16_t) (prediction + d);
+      }
+    }
+  }
+  return 1;
+}
+
+/* reads the header of the frame at the file position */
+static int read_frame_header(FILE* fp, uint32_t* packed, uint32_t* length, uint32_t* flags,
+                             int64_t* droplets) {
+  return fread(packed, sizeof(uint32_t), 1, fp) == 1
+         && fread(length, sizeof(uint32_t), 1, fp) == 1
+         && fread(flags, sizeof(uint32_t), 1, fp) == 1
+         && fread(droplets, sizeof(int64_t), 1, fp) == 1;
+}
+
+static size_t memory_input(void* ctx, const uint8_t** data) {
+  struct memory_stream* s = ctx;
+  size_t n = s->left;
+  *data = s->data;
+  s->data += n;
+  s->left = 0;
+  return n;
+}
+
+static int memory_output(void* ctx, const uint8_t* data, size_t length) {
+  struct memory_stream* s = ctx;
+  if (length > s->out_left)
+    return 0;
+  memcpy(s->out, data, length);
+  s->out += length;
+  s->out_left -= length;
+  return 1;
+}
+
+
+int timelapse_begin(struct timelapse* tl, const float* heightmap, int map_size, int keyframes,
+                    int level, char* filename) {
+  size_t count = (size_t) map_size * map_size;
+  memset(tl, 0, sizeof(struct timelapse));
+
+  // the range of the first frame with a margin for deposits
+  float min = heightmap[0], max = heightmap[0];
+  for (size_t i = 1; i < count; i++) {
+    min = heightmap[i] < min ? heightmap[i] : min;
+    max = heightmap[i] > max ? heightmap[i] : max;
+  }
+  float margin = max > min ? (max - min) * 0.05f : 0.5f;
+  tl->low = min - margin;
+  tl->step = (max - min + 2 * margin) / 65535;
+
+  tl->map_size = map_size;
+  tl->tiles = (map_size + TIMELAPSE_TILE - 1) / TIMELAPSE_TILE;
+  tl->keyframes = keyframes < 1 ? 1 : keyframes;
+  tl->level = level < 1 ? 1 : level > 9 ? 9 : level;
+
+  size_t payload = ((size_t) tl->tiles * tl->tiles + 7) / 8 + 2 * count;
+  tl->previous = malloc(count * sizeof(uint16_t));
+  tl->current = malloc(count * sizeof(uint16_t));
+  tl->payload = malloc(payload);
+  tl->packed = malloc(deflate_bound(payload));
+  tl->fp = fopen(filename, "wb");
+
+  uint32_t header[5] = { TIMELAPSE_MAGIC, TIMELAPSE_VERSION, map_size, TIMELAPSE_TILE,
+                         tl->keyframes };
+  if (tl->previous == NULL || tl->current == NULL || tl->payload == NULL || tl->packed == NULL
+      || tl->fp == NULL || fwrite(header, sizeof(uint32_t), 5, tl->fp) != 5
+      || fwrite(&tl->low, sizeof(float), 1, tl->fp) != 1
+      || fwrite(&tl->step, sizeof(float), 1, tl->fp) != 1) {
+    timelapse_end(tl);
+    return 0;
+  }
+  return 1;
+}
+
+int timelapse_frame(struct timelapse* tl, const float* heightmap, int map_size,
+                    int64_t droplets) {
+  if (tl->fp == NULL || map_size != tl->map_size)
+    return 0;
+
+  int key = tl->frames % tl->keyframes == 0;
+  quantize(tl, heightmap, tl->current);
+  size_t length = encode(tl, key);
+  size_t packed = deflate_raw(tl->payload, length, tl->level, 1, tl->packed);
+
+  uint32_t header[3] = { (uint32_t) packed, (uint32_t) length, key ? FRAME_KEY : 0 };
+  if (fwrite(header, sizeof(uint32_t), 3, tl->fp) != 3
+      || fwrite(&droplets, sizeof(int64_t), 1, tl->fp) != 1
+      || fwrite(tl->packed, 1, packed, tl->fp) != packed)
+    return 0;
+
+  uint16_t* swap = tl->previous;
+  tl->previous = tl->current;
+  tl->current = swap;
+  tl->frames++;
+  return 1;
+}
+
+void timelapse_end(struct timelapse* tl) {
+  if (tl->fp != NULL)
+    fclose(tl->fp);
+  free(tl->previous);
+  free(tl->current);
+  free(tl->payload);
+  free(tl->packed);
+  memset(tl, 0, sizeof(struct timelapse));
+}
+
+int timelapse_count(char* filename) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL)
+    return 0;
+
+  fseek(fp, 0, SEEK_END);
+  long end = ftell(fp);
+  long offset = HEADER_BYTES;
+  int frames = 0;
+  uint32_t packed, length, flags;
+  int64_t droplets;
+
+  // frames are counted up to the first one cut off
+  while (fseek(fp, offset, SEEK_SET) == 0
+         && read_frame_header(fp, &packed, &length, &flags, &droplets)
+         && offset + FRAME_BYTES + (long) packed <= end) {
+    offset += FRAME_BYTES + packed;
+    frames++;
+  }
+  fclose(fp);
+  return frames;
+}
+
+float* timelapse_read(char* filename, int frame, int* map_size, int64_t* droplets) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL)
+    return NULL;
+
+  uint32_t header[5];
+  float low, step;
+  if (fread(header, sizeof(uint32_t), 5, fp) != 5 || header[0] != TIMELAPSE_MAGIC
+      || header[1] != TIMELAPSE_VERSION || header[2] < 1 || header[2] > 65536
+      || header[3] != TIMELAPSE_TILE || fread(&low, sizeof(float), 1, fp) != 1
+      || fread(&step, sizeof(float), 1, fp) != 1 || frame < 0) {
+    fclose(fp);
+    return NULL;
+  }
+  int size = header[2];
+  size_t count = (size_t) size * size;
+  int tiles = (size + TIMELAPSE_TILE - 1) / TIMELAPSE_TILE;
+  size_t max_payload = ((size_t) tiles * tiles + 7) / 8 + 2 * count;
+
+  // the last keyframe at or before the frame, only headers are read
+  long offset = HEADER_BYTES;
+  long key_offset = -1;
+  int key_index = 0;
+  uint32_t packed, length, flags;
+  int64_t frame_droplets;
+  for (int index = 0; index <= frame; index++) {
+    if (fseek(fp, offset, SEEK_SET) != 0
+        || !read_frame_header(fp, &packed, &length, &flags, &frame_droplets)) {
+      key_offset = -1;
+      break;
+    }
+    if (flags & FRAME_KEY) {
+      key_offset = offset;
+      key_index = index;
+    }
+    offset += FRAME_BYTES + packed;
+  }
+
+  uint16_t* q = malloc(count * sizeof(uint16_t));
+  uint8_t* payload = malloc(max_payload);
+  uint8_t* data = NULL;
+  int ok = key_offset >= 0 && q != NULL && payload != NULL
+           && fseek(fp, key_offset, SEEK_SET) == 0;
+
+  // decode forward from the keyframe
+  for (int index = key_index; ok && index <= frame; index++) {
+    ok = read_frame_header(fp, &packed, &length, &flags, &frame_droplets)
+         && length <= max_payload && (index > key_index || (flags & FRAME_KEY));
+    uint8_t* grown = ok ? realloc(data, packed > 0 ? packed : 1) : NULL;
+    ok = grown != NULL;
+    if (!ok)
+      break;
+    data = grown;
+
+    struct memory_stream s = { data, packed, payload, length };
+    ok = fread(data, 1, packed, fp) == packed && inflate_raw(memory_input, memory_output, &s)
+         && s.out_left == 0 && decode(q, size, payload, length, flags & FRAME_KEY);
+  }
+  fclose(fp);
+  free(data);
+  free(payload);
+
+  float* heightmap = ok ? malloc(count * sizeof(float)) : NULL;
+  if (heightmap != NULL) {
+    for (size_t i = 0; i < count; i++) {
+      heightmap[i] = low + q[i] * step;
+    }
+    *map_size = size;
+    if (droplets != NULL)
+      *droplets = frame_droplets;
+  }
+  free(q);
+  return heightmap;
+}
@@ -0,0 +1,106 @@
+/***********************************************************************
+* FILENAME :        timelapse.h   timelapse.c
+*
+* DESCRIPTION :
+*       Timelapse capture of erosion runs into one file of delta
+*       compressed heightmap frames, and a decoder for any frame
+*
+* PUBLIC FUNCTIONS :
+*       int    timelapse_begin( struct timelapse* tl, const float* heightmap,
+*                               int map_size, int keyframes, int level,
+*                               char* filename )
+*       int    timelapse_frame( struct timelapse* tl, const float* heightmap,
+*                               int map_size, int64_t droplets )
+*       void   timelapse_end( struct timelapse* tl )
+*       int    timelapse_count( char* filename )
+*       float* timelapse_read( char* filename, int frame, int* map_size,
+*                              int64_t* droplets )
+*
+* NOTES :
+*       Heights are quantized to 16 bits over the range of the first frame
+*       plus a margin, heights leaving it are clamped. A keyframe stores
+*       every tile, each height as the difference to its left neighbour.
+*       The frames between keyframes store the difference to the frame
+*       before for the TIMELAPSE_TILE tiles that changed and skip the
+*       others. The differences are zigzag coded and split into a low and
+*       a high byte plane before deflate, so the mostly zero high bytes
+*       compress to almost nothing. Reading frame n decodes forward from
+*       the keyframe at or before it.
+*       Little endian, like the other binary formats.
+*H*/
+
+#ifndef TIMELAPSE_H_
+#define TIMELAPSE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TIMELAPSE_TILE 32
+
+/**
+ * @brief An open timelapse being captured
+ */
+struct timelapse {
+  FILE* fp;
+  int map_size;
+  int tiles;                  /* tiles per side */
+  int keyframes;              /* frames from one keyframe to the next */
+  int level;                  /* deflate level */
+  int frames;                 /* frames written */
+  float low, step;            /* height of quantized 0 and of one step */
+  uint16_t* previous;         /* quantized last frame */
+  uint16_t* current;
+  uint8_t* payload;           /* mask and byte planes before deflate */
+  uint8_t* packed;
+};
+
+/**
+ * @brief Creates the timelapse file, frames are added with timelapse_frame
+ *
+ * @param tl        the timelapse to start
+ * @param heightmap the heightmap at the start, sets the quantization range
+ * @param map_size  the heightmap size
+ * @param keyframes frames from one keyframe to the next, at least 1
+ * @param level     the deflate level in [1, 9]
+ * @param filename  the filename [include extension]
+ * @return          1 on success, 0 when the file could not be created
+ */
+int timelapse_begin( struct timelapse* tl, const float* heightmap, int map_size, int keyframes,
+                     int level, char* filename );
+
+/**
+ * @brief Appends the heightmap as the next frame
+ *
+ * @param tl        a started timelapse
+ * @param heightmap the heightmap
+ * @param map_size  the heightmap size, must be the size given to
+ *                  timelapse_begin
+ * @param droplets  droplets eroded by this frame, stored with it
+ * @return          1 on success, 0 when the size differs or the frame
+ *                  could not be written
+ */
+int timelapse_frame( struct timelapse* tl, const float* heightmap, int map_size,
+                     int64_t droplets );
+
+/**
+ * @brief Closes the file and frees the timelapse buffers
+ */
+void timelapse_end( struct timelapse* tl );
+
+/**
+ * @brief The number of complete frames in a timelapse file, 0 on failure
+ */
+int timelapse_count( char* filename );
+
+/**
+ * @brief Decodes one frame of a timelapse file
+ *
+ * @param filename  the filename [include extension]
+ * @param frame     the frame, from 0
+ * @param map_size  set to the heightmap size
+ * @param droplets  set to the droplets eroded by the frame, may be NULL
+ * @return          the heightmap [free with free], NULL on failure
+ */
+float* timelapse_read( char* filename, int frame, int* map_size, int64_t* droplets );
+
+#endif